@@ -0,0 +1,180 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wpc/decoder.h"
+#include "wpc/wpc_imagemagick.h"
+__attribute__((used)) static void _mark_magick_used(void) {
+    _wpc_magick_include_marker();
+}
+
+/*
+ * Compares the time the native decoders take to decode an image into
+ * 8 bit RGBA with the time MagickReadImage and MagickExportImagePixels
+ * take, at full size and per format. Without arguments it writes a 4k
+ * test image as JPEG, PNG and WebP, otherwise it decodes the given files.
+ * The best of ITERATIONS runs is reported, so the page cache is warm for
+ * both decoders.
+ */
+
+#define ITERATIONS 5
+#define IMAGE_WIDTH 3840
+#define IMAGE_HEIGHT 2160
+
+static const gchar *formats[] = {"JPEG", "PNG", "WEBP"};
+
+/* smooth gradients with some noise, so it compresses like a photo */
+static guchar *create_test_pixels(void) {
+    guchar *rgb = malloc((gsize)IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+    guint32 state = 2463534242u;
+    guint x, y;
+    guchar *pixel = rgb;
+
+    if (!rgb) return NULL;
+    for (y = 0; y < IMAGE_HEIGHT; y++) {
+        for (x = 0; x < IMAGE_WIDTH; x++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            pixel[0] = (guchar)(x * 223 / IMAGE_WIDTH + (state & 31));
+            pixel[1] = (guchar)(y * 223 / IMAGE_HEIGHT + (state >> 8 & 31));
+            pixel[2] = (guchar)((x + y) * 111 / IMAGE_HEIGHT % 224 +
+                                (state >> 16 & 31));
+            pixel += 3;
+        }
+    }
+    return rgb;
+}
+
+static gchar *write_test_image(const gchar *dir, const guchar *rgb,
+                               const gchar *format) {
+    MagickWand *wand = NewMagickWand();
+    gchar *name = g_ascii_strdown(format, -1);
+    gchar *path = g_strdup_printf("%s/test.%s", dir, name);
+    gboolean written;
+
+    written = MagickConstituteImage(wand, IMAGE_WIDTH, IMAGE_HEIGHT, "RGB",
+                                    CharPixel, rgb) == MagickTrue &&
+              MagickSetImageFormat(wand, format) == MagickTrue &&
+              MagickSetImageCompressionQuality(wand, 90) == MagickTrue &&
+              MagickWriteImage(wand, path) == MagickTrue;
+    DestroyMagickWand(wand);
+    g_free(name);
+    if (!written) {
+        printf("%-5s skipped, ImageMagick can not write it\n", format);
+        g_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/* returns the best time in microseconds, or -1 if it did not decode */
+static gint64 time_native_decode(const gchar *path, const gchar **decoder) {
+    DecodedImage *image;
+    gint64 start, time, best = -1;
+    guint i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        start = g_get_monotonic_time();
+        image = decode_image(path, NULL, NULL);
+        time = g_get_monotonic_time() - start;
+        if (!image) return -1;
+        *decoder = image->decoder;
+        decoded_image_unref(image);
+        if (best < 0 || time < best) best = time;
+    }
+    return best;
+}
+
+static gint64 time_magick_decode(const gchar *path) {
+    MagickWand *wand;
+    guchar *rgba = NULL;
+    gsize width, height;
+    gboolean decoded;
+    gint64 start, time, best = -1;
+    guint i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        start = g_get_monotonic_time();
+        wand = NewMagickWand();
+        decoded = MagickReadImage(wand, path) == MagickTrue;
+        if (decoded) {
+            width = MagickGetImageWidth(wand);
+            height = MagickGetImageHeight(wand);
+            rgba = malloc(width * height * 4);
+            decoded = rgba && MagickExportImagePixels(wand, 0, 0, width, height,
+                                                      "RGBA", CharPixel,
+                                                      rgba) == MagickTrue;
+            free(rgba);
+        }
+        DestroyMagickWand(wand);
+        time = g_get_monotonic_time() - start;
+        if (!decoded) return -1;
+        if (best < 0 || time < best) best = time;
+    }
+    return best;
+}
+
+static void bench_file(const gchar *label, const gchar *path) {
+    const gchar *decoder = NULL;
+    gint64 native = time_native_decode(path, &decoder);
+    gint64 magick = time_magick_decode(path);
+
+    if (magick < 0) {
+        printf("%-5s %s: ImageMagick could not decode it\n", label, path);
+    } else if (native < 0) {
+        printf("%-5s ImageMagick %.2f ms, no native decoder\n", label,
+               (double)magick / 1000.0);
+    } else {
+        printf("%-5s %s %.2f ms, ImageMagick %.2f ms, %.2fx faster\n", label,
+               decoder, (double)native / 1000.0, (double)magick / 1000.0,
+               (double)magick / (double)MAX(native, 1));
+    }
+}
+
+extern int main(int argc, char **argv) {
+    GError *error = NULL;
+    gchar *dir, *path, *name;
+    guchar *rgb;
+    int i;
+    guint f;
+
+    MagickWandGenesis();
+    if (argc > 1) {
+        for (i = 1; i < argc; i++) {
+            name = g_path_get_basename(argv[i]);
+            bench_file(name, argv[i]);
+            g_free(name);
+        }
+        MagickWandTerminus();
+        return 0;
+    }
+
+    dir = g_dir_make_tmp("wpc-decode-bench-XXXXXX", &error);
+    rgb = create_test_pixels();
+    if (!dir || !rgb) {
+        fprintf(stderr, "Failed to create test images: %s\n",
+                error ? error->message : "out of memory");
+        MagickWandTerminus();
+        return 1;
+    }
+
+    printf("decoding a %dx%d image, best of %d runs\n", IMAGE_WIDTH,
+           IMAGE_HEIGHT, ITERATIONS);
+    for (f = 0; f < G_N_ELEMENTS(formats); f++) {
+        path = write_test_image(dir, rgb, formats[f]);
+        if (!path) continue;
+        bench_file(formats[f], path);
+        g_remove(path);
+        g_free(path);
+    }
+
+    g_rmdir(dir);
+    g_free(dir);
+    free(rgb);
+    MagickWandTerminus();
+    return 0;
+}
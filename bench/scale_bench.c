@@ -0,0 +1,204 @@
+// Copyright 2025 webdevred
+
+#include <X11/Xlib.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wpc/monitors.h"
+#include "wpc/pixel_format.h"
+#include "wpc/render_context.h"
+#include "wpc/rendering_region.h"
+#include "wpc/upload.h"
+#include "wpc/wallpaper_transformation.h"
+#include "wpc/xrender.h"
+
+/*
+ * Compares client side scaling, resample and convert in our process and
+ * upload the frame, with server side scaling, upload the source once and
+ * let XRender scale it onto every monitor. Every step ends with an XSync,
+ * and the server is idle before each timer starts, so the time the server
+ * spends scaling is measured on its own and not left to a later round
+ * trip. Needs an X server with the RENDER extension, the benchmark is
+ * skipped without one.
+ */
+
+#define ITERATIONS 5
+#define SOURCE_WIDTH 3840
+#define SOURCE_HEIGHT 2160
+
+typedef struct {
+    guint width, height;
+    Quality quality;
+} ScaleCase;
+
+static const ScaleCase cases[] = {
+    {1920, 1080, QUALITY_BEST},  {1920, 1080, QUALITY_FAST},
+    {2560, 1440, QUALITY_BEST},  {2560, 1440, QUALITY_FAST},
+    {3840, 2160, QUALITY_BEST},
+};
+
+static const gchar *quality_names[] = {"best", "balanced", "fast"};
+
+static const guchar black[4] = {0, 0, 0, 255};
+
+static guchar *create_source_pixels(void) {
+    guchar *rgba = malloc((gsize)SOURCE_WIDTH * SOURCE_HEIGHT * 4);
+    guint x, y;
+    guchar *pixel = rgba;
+
+    if (!rgba) return NULL;
+    for (y = 0; y < SOURCE_HEIGHT; y++) {
+        for (x = 0; x < SOURCE_WIDTH; x++) {
+            pixel[0] = (guchar)(x * 255 / SOURCE_WIDTH);
+            pixel[1] = (guchar)(y * 255 / SOURCE_HEIGHT);
+            pixel[2] = ((x / 16 + y / 16) % 2) ? 255 : 0;
+            pixel[3] = 255;
+            pixel += 4;
+        }
+    }
+    return rgba;
+}
+
+static double elapsed_ms(gint64 start) {
+    return (double)(g_get_monotonic_time() - start) / 1000.0;
+}
+
+/* the best scale and upload times of rendering the frame in our process */
+static gboolean time_client(RenderContext *ctx, const DecodedImage *image,
+                            Monitor *monitor, Quality quality, Pixmap pmap,
+                            double *scale_ms, double *upload_ms) {
+    RenderingRegion rr = create_rendering_region_for_size(
+        image->width, image->height, monitor, BG_MODE_FILL);
+    gsize stride = pixel_format_stride(&ctx->format, (guint)rr.width);
+    guchar *rgba = malloc(rr.width * rr.height * 4);
+    guchar *frame = malloc(stride * rr.height);
+    gboolean scaled = rgba && frame;
+    gint64 start;
+    guint i;
+
+    for (i = 0; scaled && i < ITERATIONS; i++) {
+        XSync(ctx->display, False);
+        start = g_get_monotonic_time();
+        scaled = transform_wallpaper_pixels(image, &rr, black, quality, rgba);
+        convert_rgba_pixels(&ctx->format, rgba, (guint)rr.width,
+                            (guint)rr.height, frame, stride);
+        *scale_ms = i ? MIN(*scale_ms, elapsed_ms(start)) : elapsed_ms(start);
+
+        start = g_get_monotonic_time();
+        put_pixels(ctx->display, pmap, ctx->visual, ctx->depth, frame,
+                   (guint)rr.width, (guint)rr.height, (gint)rr.monitor_x,
+                   (gint)rr.monitor_y);
+        XSync(ctx->display, False);
+        *upload_ms =
+            i ? MIN(*upload_ms, elapsed_ms(start)) : elapsed_ms(start);
+    }
+    free(rgba);
+    free(frame);
+    return scaled;
+}
+
+/* the upload is paid once per source, the scale once per monitor */
+static gboolean time_server(RenderContext *ctx, const DecodedImage *image,
+                            Monitor *monitor, Quality quality, Pixmap pmap,
+                            double *scale_ms, double *upload_ms) {
+    gsize size = (gsize)image->width * image->height * 4;
+    guchar *argb = malloc(size);
+    ServerImage *source = NULL;
+    gint64 start;
+    guint i;
+
+    for (i = 0; argb && i < ITERATIONS; i++) {
+        XSync(ctx->display, False);
+        start = g_get_monotonic_time();
+        premultiply_rgba(image->pixels, image->width, image->height, argb);
+        source = upload_server_image(ctx->display, ctx->root, ctx->visual,
+                                     argb, image->width, image->height, FALSE);
+        XSync(ctx->display, False);
+        *upload_ms =
+            i ? MIN(*upload_ms, elapsed_ms(start)) : elapsed_ms(start);
+        if (!source) break;
+        if (i + 1 < ITERATIONS) destroy_server_image(ctx->display, source);
+    }
+    free(argb);
+    if (!source) return FALSE;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        XSync(ctx->display, False);
+        start = g_get_monotonic_time();
+        paint_server_image(ctx->display, source, pmap, ctx->visual, monitor,
+                           BG_MODE_FILL, black, quality);
+        XSync(ctx->display, False);
+        *scale_ms = i ? MIN(*scale_ms, elapsed_ms(start)) : elapsed_ms(start);
+    }
+    destroy_server_image(ctx->display, source);
+    return TRUE;
+}
+
+static void run_case(RenderContext *ctx, const DecodedImage *image,
+                     const ScaleCase *sc) {
+    Monitor monitor = {0};
+    Pixmap pmap;
+    double client_scale = 0, client_upload = 0;
+    double server_scale = 0, server_upload = 0;
+
+    monitor.width = sc->width;
+    monitor.height = sc->height;
+    monitor.name = "bench";
+    pmap = XCreatePixmap(ctx->display, ctx->root, sc->width, sc->height,
+                         (guint)ctx->depth);
+
+    printf("%ux%u to %ux%u, %s quality\n", image->width, image->height,
+           sc->width, sc->height, quality_names[sc->quality]);
+    if (time_client(ctx, image, &monitor, sc->quality, pmap, &client_scale,
+                    &client_upload)) {
+        printf("  client: scale %.2f ms, upload frame %.2f ms, %.2f ms per "
+               "monitor\n",
+               client_scale, client_upload, client_scale + client_upload);
+    } else {
+        printf("  client: could not scale\n");
+    }
+    if (time_server(ctx, image, &monitor, sc->quality, pmap, &server_scale,
+                    &server_upload)) {
+        printf("  server: upload source %.2f ms once, scale %.2f ms per "
+               "monitor\n",
+               server_upload, server_scale);
+    } else {
+        printf("  server: could not upload the source\n");
+    }
+    XFreePixmap(ctx->display, pmap);
+}
+
+extern int main(void) {
+    RenderContext *ctx;
+    DecodedImage image = {0};
+    guint i;
+
+    if (!g_getenv("DISPLAY")) {
+        printf("skipped, there is no X display\n");
+        return 0;
+    }
+    init_x11();
+    ctx = get_render_context();
+    if (!xrender_available(ctx->display, ctx->visual)) {
+        printf("skipped, the X server can not scale with XRender\n");
+        return 0;
+    }
+
+    image.pixels = create_source_pixels();
+    if (!image.pixels) return 1;
+    image.width = image.full_width = SOURCE_WIDTH;
+    image.height = image.full_height = SOURCE_HEIGHT;
+    image.decoder = "bench";
+    image.refs = 1;
+
+    printf("best of %d runs\n", ITERATIONS);
+    for (i = 0; i < G_N_ELEMENTS(cases); i++) {
+        run_case(ctx, &image, &cases[i]);
+    }
+
+    free(image.pixels);
+    XCloseDisplay(querying_display);
+    XCloseDisplay(rendering_display);
+    return 0;
+}
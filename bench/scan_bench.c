@@ -0,0 +1,170 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wpc/filesystem.h"
+
+/*
+ * Times list_wallpapers on directories of 1k, 10k and 100k files, nine in
+ * ten of them small PNGs and the rest text files, so every file is sniffed
+ * and every image probed. Each directory is scanned without an index on
+ * one worker and on one worker per processor, and then again with the
+ * index the last scan wrote. The index is kept in a temporary cache
+ * directory, the files themselves stay in the page cache between runs.
+ * Wallpapers are handed out while the scan goes on, so the time until the
+ * first one arrives is reported too.
+ */
+
+#define ITERATIONS 3
+
+static const guint file_counts[] = {1000, 10000, 100000};
+
+/* a 1x1 RGBA PNG */
+static const guchar png_bytes[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0x15, 0xc4, 0x89, 0x00, 0x00, 0x00,
+    0x0d, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9c, 0x63, 0x00, 0x01, 0x00, 0x00,
+    0x05, 0x00, 0x01, 0x0d, 0x0a, 0x2d, 0xb4, 0x00, 0x00, 0x00, 0x00, 0x49,
+    0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82};
+
+static const gchar text_bytes[] = "not a wallpaper\n";
+
+/* removes everything below path, but not path itself */
+static void remove_contents(const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+    gchar *child;
+
+    if (!dir) return;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        child = g_build_filename(path, name, NULL);
+        if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+            !g_file_test(child, G_FILE_TEST_IS_SYMLINK)) {
+            remove_contents(child);
+            g_rmdir(child);
+        } else {
+            g_remove(child);
+        }
+        g_free(child);
+    }
+    g_dir_close(dir);
+}
+
+static gboolean create_files(const gchar *dir, guint count) {
+    gchar *path;
+    gboolean created = TRUE;
+    guint i;
+
+    for (i = 0; created && i < count; i++) {
+        if (i % 10 == 9) {
+            path = g_strdup_printf("%s/notes-%06u.txt", dir, i);
+            created = g_file_set_contents(path, text_bytes,
+                                          sizeof(text_bytes) - 1, NULL);
+        } else {
+            path = g_strdup_printf("%s/image-%06u.png", dir, i);
+            created = g_file_set_contents(path, (const gchar *)png_bytes,
+                                          sizeof(png_bytes), NULL);
+        }
+        g_free(path);
+    }
+    return created;
+}
+
+static void note_first_wallpaper(const Wallpaper *wallpaper, guint index,
+                                 gpointer user_data) {
+    gint64 *first = user_data;
+    (void)wallpaper;
+    if (index == 0) *first = g_get_monotonic_time();
+}
+
+/* returns the best time in milliseconds, or a negative one on failure, and
+   the time until the first wallpaper arrived in that run */
+static double time_scan(gchar *dir, const gchar *cache_dir, guint workers,
+                        gboolean indexed, guint *found, double *first_ms) {
+    ScanOptions options = {0};
+    WallpaperArray *wallpapers;
+    double time, best = -1;
+    gint64 start, first = 0;
+    guint i;
+
+    options.workers = workers;
+    options.found = note_first_wallpaper;
+    options.user_data = &first;
+    for (i = 0; i < ITERATIONS; i++) {
+        if (!indexed) remove_contents(cache_dir);
+        start = g_get_monotonic_time();
+        wallpapers = list_wallpapers(dir, &options);
+        time = (double)(g_get_monotonic_time() - start) / 1000.0;
+        if (!wallpapers) return -1;
+        *found = wallpapers->amount_used;
+        free_wallpapers(wallpapers);
+        if (best < 0 || time < best) {
+            best = time;
+            *first_ms = (double)(first - start) / 1000.0;
+        }
+    }
+    return best;
+}
+
+static gboolean run_count(const gchar *root, const gchar *cache_dir,
+                          guint count) {
+    gchar *dir = g_strdup_printf("%s/files-%u", root, count);
+    double serial, parallel, indexed, first = 0, ignored = 0;
+    guint found = 0;
+    gboolean scanned;
+
+    scanned = g_mkdir(dir, 0700) == 0 && create_files(dir, count);
+    if (scanned) {
+        serial = time_scan(dir, cache_dir, 1, FALSE, &found, &ignored);
+        parallel = time_scan(dir, cache_dir, 0, FALSE, &found, &first);
+        /* the last cold scan left an index behind */
+        indexed = time_scan(dir, cache_dir, 0, TRUE, &found, &ignored);
+        scanned = serial >= 0 && parallel >= 0 && indexed >= 0;
+    }
+    if (scanned) {
+        printf("%6u files, %6u wallpapers: 1 worker %.2f ms, %u workers "
+               "%.2f ms (%.2fx, first wallpaper after %.2f ms), indexed "
+               "%.2f ms\n",
+               count, found, serial, g_get_num_processors(), parallel,
+               serial / MAX(parallel, 0.001), first, indexed);
+    } else {
+        printf("%6u files: could not create or scan them\n", count);
+    }
+
+    remove_contents(dir);
+    g_rmdir(dir);
+    g_free(dir);
+    return scanned;
+}
+
+extern int main(void) {
+    GError *error = NULL;
+    gchar *root, *cache_dir;
+    guint i, failed = 0;
+
+    root = g_dir_make_tmp("wpc-scan-bench-XXXXXX", &error);
+    if (!root) {
+        fprintf(stderr, "Failed to create a directory: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    /* before anything asks glib for the cache directory */
+    cache_dir = g_build_filename(root, "cache", NULL);
+    g_mkdir(cache_dir, 0700);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    printf("best of %d runs\n", ITERATIONS);
+    for (i = 0; i < G_N_ELEMENTS(file_counts); i++) {
+        if (!run_count(root, cache_dir, file_counts[i])) failed++;
+    }
+
+    remove_contents(root);
+    g_rmdir(root);
+    g_free(cache_dir);
+    g_free(root);
+    return failed ? 1 : 0;
+}
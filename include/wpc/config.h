@@ -11,18 +11,37 @@ typedef enum {
     BG_MODE_NOT_SET
 } BgMode;
 
+typedef enum { QUALITY_BEST = 0, QUALITY_BALANCED, QUALITY_FAST } Quality;
+
 typedef struct {
     BgMode bg_mode;
+    Quality quality;
     gchar *name;
     gchar *image_path;
     gchar *bg_fallback_color;
     gchar *valid_bg_fallback_color;
 } ConfigMonitor;
 
+typedef enum {
+    RESAMPLER_NATIVE = 0,
+    RESAMPLER_IMAGEMAGICK,
+    RESAMPLER_XRENDER
+} Resampler;
+
+#define DEFAULT_FRAME_CACHE_BUDGET 256
+#define DEFAULT_RENDER_MEMORY_BUDGET 256
+/* 0 scans with one worker per processor */
+#define DEFAULT_SCAN_WORKERS 0
+
 typedef struct {
     gushort number_of_monitors;
     gboolean valid_source_directory;
     gchar *source_directory;
+    guint frame_cache_budget;
+    guint render_memory_budget;
+    guint scan_workers;
+    gboolean recursive_scan;
+    Resampler resampler;
     ConfigMonitor *monitors_with_backgrounds;
 } Config;
 
@@ -30,6 +49,9 @@ extern void init_config_monitor(Config *config, const gchar *monitor_name,
                                 const gchar *wallpaper_path,
                                 const BgMode bg_mode);
 
+extern ConfigMonitor *get_config_monitor(Config *config,
+                                         const gchar *monitor_name);
+
 extern void free_config(Config *config);
 
 extern void update_source_directory(Config *config, const gchar *new_src_dir);
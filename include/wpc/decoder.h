@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glib.h>
+#include <stdio.h>
+
+typedef struct DecoderBackend DecoderBackend;
+
+/*
+ * Decodes an image row by row, top to bottom, into 8 bit RGBA. width and
+ * height are the size the rows come out at, the decoder may have scaled
+ * the image down from full_width x full_height. Unless streams is set the
+ * whole image is decoded on the first read and held until the reader is
+ * closed.
+ */
+typedef struct {
+    guint width, height;
+    guint full_width, full_height;
+    gboolean has_alpha;
+    gboolean streams;
+    const gchar *decoder;
+    guint rows_read;
+    FILE *file;
+    const DecoderBackend *backend;
+    gpointer state;
+} ImageReader;
+
+typedef struct {
+    guchar *pixels;
+    guint width, height;
+    /* the size stored in the file, the decoder may have scaled it down */
+    guint full_width, full_height;
+    gboolean has_alpha;
+    const gchar *decoder;
+    gint refs;
+} DecodedImage;
+
+/*
+ * Called once the header is read with the size stored in the file. Sets
+ * the smallest size the caller needs, the decoder never goes below it.
+ */
+typedef void (*DecodeSizeFunc)(guint full_width, guint full_height,
+                               guint *min_width, guint *min_height,
+                               gpointer data);
+
+extern ImageReader *open_image_reader(const gchar *path,
+                                      DecodeSizeFunc size_func, gpointer data);
+
+extern gboolean reduce_image_reader(ImageReader *reader, guint width,
+                                    guint height);
+
+extern gboolean read_image_rows(ImageReader *reader, guchar *dst,
+                                guint rows);
+
+extern void close_image_reader(ImageReader *reader);
+
+extern DecodedImage *decode_image(const gchar *path, DecodeSizeFunc size_func,
+                                  gpointer data);
+
+extern DecodedImage *decoded_image_ref(DecodedImage *image);
+
+extern void decoded_image_unref(DecodedImage *image);
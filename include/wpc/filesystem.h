@@ -14,21 +14,51 @@ typedef struct {
 
 typedef struct {
     Wallpaper *data;
-    gushort amount_allocated;
-    gushort amount_used;
+    guint amount_allocated;
+    guint amount_used;
 } WallpaperArray;
 
+/*
+ * Called for every wallpaper as soon as it is found, before the scan is
+ * done. index is its position in the array list_wallpapers returns, the
+ * array may still move until then.
+ */
+typedef void (*WallpaperFoundFunc)(const Wallpaper *wallpaper, guint index,
+                                   gpointer user_data);
+
+typedef struct {
+    /* threads checking and probing files, 0 for one per processor */
+    guint workers;
+    /* whether the subdirectories are listed too */
+    gboolean recursive;
+    WallpaperFoundFunc found;
+    gpointer user_data;
+} ScanOptions;
+
+/*
+ * Paths of wallpapers in the order a scan running on its own thread finds
+ * them, so they can be set before the scan is done.
+ */
 typedef struct {
-    WallpaperArray *wallpapers;
+    GPtrArray *paths;
     guint current_wallpaper;
+    gchar *source_directory;
+    ScanOptions options;
+    GThread *scanner;
+    GMutex lock;
+    /* signalled when a path is added or the scan ends */
+    GCond changed;
+    gboolean scanning;
 } WallpaperQueue;
 
 extern void free_wallpapers(WallpaperArray *arr);
 
-extern WallpaperQueue *new_wallpaper_queue(gchar *source_directory);
+extern WallpaperQueue *new_wallpaper_queue(gchar *source_directory,
+                                           const ScanOptions *options);
 
 extern void free_wallpaper_queue(WallpaperQueue *queue);
 
 extern gchar *next_wallpaper_in_queue(WallpaperQueue *queue);
 
-extern WallpaperArray *list_wallpapers(char *source_directory);
+extern WallpaperArray *list_wallpapers(char *source_directory,
+                                       const ScanOptions *options);
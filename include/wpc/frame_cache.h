@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glib.h>
+
+#include "wpc/config.h"
+#include "wpc/monitors.h"
+
+/*
+ * A frame covers width x height pixels at x, y of its monitor, the rest
+ * of the monitor is painted in the fallback color.
+ */
+typedef struct {
+    guint x, y;
+    guint width, height;
+    gsize mapping_size;
+    void *mapping;
+    guchar *pixels;
+} CachedFrame;
+
+extern gchar *frame_cache_key(const gchar *image_path, Monitor *monitor,
+                              BgMode bg_mode, const gchar *bg_fallback_color,
+                              Resampler resampler, Quality quality,
+                              const gchar *pixel_format);
+
+extern gboolean frame_cache_lookup(const gchar *key, Monitor *monitor,
+                                   CachedFrame *frame);
+
+extern void frame_cache_release(CachedFrame *frame);
+
+extern gboolean frame_cache_store(const gchar *key, Monitor *monitor,
+                                  const CachedFrame *frame, gsize stride,
+                                  guint64 budget);
+
+extern void frame_cache_evict(guint64 budget);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glib.h>
+#include <sys/stat.h>
+
+typedef enum {
+    IMAGE_FORMAT_NONE = 0,
+    /* an image libmagic recognized but the signatures did not */
+    IMAGE_FORMAT_OTHER,
+    IMAGE_FORMAT_JPEG,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_WEBP,
+    IMAGE_FORMAT_GIF,
+    IMAGE_FORMAT_BMP,
+    IMAGE_FORMAT_TIFF,
+    IMAGE_FORMAT_AVIF
+} ImageFormat;
+
+/*
+ * One file of the source directory as it was when it was last checked.
+ * Files that are not images are recorded as IMAGE_FORMAT_NONE, so they
+ * are not checked again until they change.
+ */
+typedef struct {
+    guint64 size;
+    guint64 inode;
+    gint64 mtime_sec;
+    guint32 mtime_nsec;
+    guint32 format;
+    guint32 width, height;
+    guint32 name_offset, name_length;
+} LibraryRecord;
+
+typedef struct {
+    const LibraryRecord *records;
+    const gchar *strings;
+    guint count;
+    gint64 dir_mtime_sec;
+    guint32 dir_mtime_nsec;
+    gsize mapping_size;
+    void *mapping;
+} LibraryIndex;
+
+typedef struct LibraryIndexWriter LibraryIndexWriter;
+
+extern gboolean library_index_load(const gchar *directory,
+                                   gboolean recursive, LibraryIndex *index);
+
+extern void library_index_release(LibraryIndex *index);
+
+extern gboolean library_index_is_current(const LibraryIndex *index,
+                                         const struct stat *dir_stat);
+
+extern const gchar *library_record_name(const LibraryIndex *index,
+                                        const LibraryRecord *record);
+
+extern gboolean library_record_is_current(const LibraryRecord *record,
+                                          const struct stat *file_stat);
+
+extern LibraryIndexWriter *
+library_index_writer_new(const gchar *directory, gboolean recursive,
+                         const struct stat *dir_stat);
+
+extern void library_index_writer_add(LibraryIndexWriter *writer,
+                                     const gchar *name,
+                                     const struct stat *file_stat,
+                                     ImageFormat format, guint width,
+                                     guint height);
+
+extern void library_index_writer_mark_incomplete(LibraryIndexWriter *writer);
+
+extern void library_index_writer_commit(LibraryIndexWriter *writer);
+
+extern void library_index_writer_free(LibraryIndexWriter *writer);
@@ -33,6 +33,10 @@ extern Screen *rendering_screen;
 
 extern void init_x11(void);
 
+extern void trap_x_errors(Display *display);
+
+extern gboolean untrap_x_errors(Display *display);
+
 extern void free_monitors(MonitorArray *arr);
 
 extern MonitorArray *list_monitors(const bool virtual_monitors);
@@ -1,13 +1,19 @@
 #pragma once
 
+#include "wpc/config.h"
+
 typedef enum {
     DAEMON_SET_BACKGROUNDS,
     SET_BACKGROUNDS_AND_EXIT,
+    SET_MONITOR_BACKGROUND,
     START_GUI
 } Action;
 
 typedef struct {
     Action action;
+    char *monitor_name;
+    char *image_path;
+    BgMode bg_mode;
 } Options;
 
 void parse_options(char **argv, Options *options);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+typedef struct PixelFormat PixelFormat;
+
+typedef void (*ConvertRow)(const PixelFormat *format, const guchar *src,
+                           guchar *dst, guint width);
+
+struct PixelFormat {
+    gchar name[32];
+    guint bits_per_pixel;
+    gboolean msb_first;
+    guint shifts[3], bits[3];
+    /* set if every pixel is the RGB bytes of RGBA reordered, shuffle holds
+       the source byte of every destination byte, -1 for zero */
+    gboolean swizzle;
+    gint8 shuffle[4];
+    ConvertRow convert_row;
+};
+
+extern void init_pixel_format(PixelFormat *format, Display *display,
+                              Visual *visual, int depth);
+
+extern gsize pixel_format_stride(const PixelFormat *format, guint width);
+
+extern gulong pixel_format_value(const PixelFormat *format,
+                                 const guchar *rgba);
+
+extern void convert_rgba_pixels(const PixelFormat *format, const guchar *src,
+                                guint width, guint height, guchar *dst,
+                                gsize dst_stride);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+#include "wpc/pixel_format.h"
+
+typedef struct {
+    Display *display;
+    Window root;
+    Visual *visual;
+    int depth;
+    Screen *screen;
+    PixelFormat format;
+    Pixmap pmap;
+    Pixmap retired_pmap;
+    guint pmap_width, pmap_height;
+    guint reclaimed_pixmaps;
+} RenderContext;
+
+extern RenderContext *get_render_context(void);
@@ -9,8 +9,14 @@ typedef struct _MagickWand MagickWand;
 typedef struct {
     gulong width, height;
     glong src_x, src_y;
+    gulong src_width, src_height;
     glong monitor_x, monitor_y;
 } RenderingRegion;
 
+extern RenderingRegion create_rendering_region_for_size(gulong img_w,
+                                                       gulong img_h,
+                                                       Monitor *monitor,
+                                                       BgMode bg_mode);
+
 extern RenderingRegion
 create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode);
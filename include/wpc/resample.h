@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glib.h>
+
+typedef enum {
+    RESAMPLE_FILTER_BOX,
+    RESAMPLE_FILTER_TRIANGLE,
+    RESAMPLE_FILTER_LANCZOS
+} ResampleFilter;
+
+typedef enum {
+    RESAMPLE_PLAN_COPY,
+    RESAMPLE_PLAN_INTEGER_BOX,
+    RESAMPLE_PLAN_GENERAL
+} ResamplePlan;
+
+extern ResamplePlan plan_resample(guint src_width, guint src_height,
+                                  guint dst_width, guint dst_height);
+
+extern const gchar *resample_plan_name(ResamplePlan plan);
+
+extern const gchar *resample_isa_name(void);
+
+extern gboolean resample_set_isa(const gchar *name);
+
+extern gboolean resample_rgba(const guchar *src, gsize src_stride,
+                              guint src_width, guint src_height, guchar *dst,
+                              guint dst_width, guint dst_height,
+                              ResampleFilter filter);
+
+typedef struct ResampleStream ResampleStream;
+
+/* returns the next source row, or NULL if it could not be produced */
+typedef const guchar *(*ResampleSource)(gpointer data);
+
+extern ResampleStream *resample_stream_new(guint src_width, guint src_height,
+                                           guint dst_width, guint dst_height,
+                                           ResampleFilter filter,
+                                           guint max_rows,
+                                           ResampleSource source,
+                                           gpointer data);
+
+extern gboolean resample_stream_read(ResampleStream *stream, guchar *dst,
+                                     guint rows);
+
+extern gsize resample_stream_size(const ResampleStream *stream);
+
+extern void resample_stream_free(ResampleStream *stream);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <glib.h>
+
+typedef struct {
+    XImage *ximage;
+    XShmSegmentInfo shminfo;
+    gboolean shared;
+    /* a put of the shared image the server has not confirmed yet */
+    gboolean pending;
+    guint width, height;
+    guchar *pixels;
+} UploadImage;
+
+extern gboolean shm_upload_available(Display *display);
+
+extern UploadImage *create_upload_image(Display *display, Visual *visual,
+                                        int depth, guint width, guint height);
+
+extern void put_upload_area(Display *display, Drawable drawable,
+                            UploadImage *image, guint width, guint rows,
+                            gint x, gint y);
+
+extern void put_upload_rows(Display *display, Drawable drawable,
+                            UploadImage *image, guint rows, gint x, gint y);
+
+extern void wait_upload_image(Display *display, UploadImage *image);
+
+extern void put_upload_image(Display *display, Drawable drawable,
+                             UploadImage *image, gint x, gint y);
+
+extern void destroy_upload_image(Display *display, UploadImage *image);
+
+extern void put_pixels(Display *display, Drawable drawable, Visual *visual,
+                       int depth, guchar *pixels, guint width, guint height,
+                       gint x, gint y);
@@ -6,4 +6,7 @@
 
 extern void set_wallpapers(Config *config, WallpaperQueue *queue,
                            MonitorArray *mon_arr_wrapper);
+extern void set_wallpaper_for_monitor(Config *config,
+                                      MonitorArray *mon_arr_wrapper,
+                                      Monitor *monitor);
 extern void init_x(void);
@@ -1,11 +1,70 @@
 #pragma once
 
 #include "wpc/config.h"
+#include "wpc/decoder.h"
 #include "wpc/monitors.h"
+#include "wpc/rendering_region.h"
+#include "wpc/resample.h"
 
 typedef struct _MagickWand MagickWand;
 
+extern ResampleFilter native_filter(Quality quality);
+
+extern void resize_magick(MagickWand *wand, gulong width, gulong height,
+                          Quality quality);
+
+extern void grow_decode_size(gulong img_w, gulong img_h, Monitor *monitor,
+                             BgMode bg_mode, gulong *width, gulong *height);
+
+extern gboolean read_wallpaper(MagickWand *wand, const gchar *path,
+                               gulong width, gulong height);
+
 extern bool transform_wallpaper_tiled(MagickWand **wand_ptr, Monitor *monitor);
 
+extern RenderingRegion scale_wallpaper(MagickWand **wand_ptr,
+                                       Monitor *monitor, BgMode bg_mode,
+                                       const gchar *bg_fallback_color,
+                                       Resampler resampler, Quality quality);
+
 extern void transform_wallpaper(MagickWand **wand_ptr, Monitor *monitor,
-                                BgMode bg_mode, const gchar *conf_bg_fb_color);
+                                BgMode bg_mode, const gchar *conf_bg_fb_color,
+                                Resampler resampler, Quality quality);
+
+extern void parse_fallback_color(const gchar *name, guchar *rgba);
+
+extern MagickWand *new_wand_from_decoded_image(const DecodedImage *image);
+
+extern gboolean frame_region_fits(const RenderingRegion *rr,
+                                  const Monitor *monitor);
+
+extern gboolean transform_wallpaper_pixels(const DecodedImage *image,
+                                           const RenderingRegion *rr,
+                                           const guchar *bg_fallback_rgba,
+                                           Quality quality, guchar *dst);
+
+/* receives rows rows of RGBA, starting at row y of the frame */
+typedef void (*WallpaperBandFunc)(const guchar *rgba, guint y, guint rows,
+                                  gpointer data);
+
+extern gboolean transform_wallpaper_bands(const DecodedImage *image,
+                                          const RenderingRegion *rr,
+                                          const guchar *bg_fallback_rgba,
+                                          Quality quality, guint band_rows,
+                                          WallpaperBandFunc band,
+                                          gpointer data);
+
+typedef struct WallpaperStripes WallpaperStripes;
+
+extern WallpaperStripes *new_wallpaper_stripes(ImageReader *reader,
+                                               Monitor *monitor,
+                                               BgMode bg_mode,
+                                               const gchar *bg_fallback_color,
+                                               Quality quality,
+                                               guint max_rows);
+
+extern gboolean read_wallpaper_stripe(WallpaperStripes *stripes, guchar *dst,
+                                      guint rows);
+
+extern gsize wallpaper_stripes_size(const WallpaperStripes *stripes);
+
+extern void free_wallpaper_stripes(WallpaperStripes *stripes);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+#include <glib.h>
+
+#include "wpc/config.h"
+#include "wpc/monitors.h"
+
+/* coordinates are signed 16 bit, so no pixmap may be larger on a side */
+#define SERVER_IMAGE_MAX_SIZE 32767
+
+typedef struct {
+    Pixmap pixmap;
+    Picture picture;
+    guint width, height;
+    gboolean has_alpha;
+} ServerImage;
+
+extern gboolean xrender_available(Display *display, Visual *visual);
+
+extern void premultiply_rgba(const guchar *src, guint width, guint height,
+                             guchar *dst);
+
+extern ServerImage *upload_server_image(Display *display, Drawable root,
+                                        Visual *visual, guchar *pixels,
+                                        guint width, guint height,
+                                        gboolean has_alpha);
+
+extern void paint_server_image(Display *display, ServerImage *image,
+                               Drawable drawable, Visual *visual,
+                               Monitor *monitor, BgMode bg_mode,
+                               const guchar *bg_fallback_rgba,
+                               Quality quality);
+
+extern void destroy_server_image(Display *display, ServerImage *image);
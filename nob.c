@@ -17,6 +17,8 @@
 #define BUILD_FOLDER "build"
 #define SRC_FOLDER "src"
 #define HEADER_FOLDER "include"
+#define TEST_FOLDER "tests"
+#define BENCH_FOLDER "bench"
 
 typedef struct {
     uint count;
@@ -25,6 +27,7 @@ typedef struct {
 } LibFlagsDa;
 
 bool use_imagemagick7 = false;
+bool use_webp = false;
 bool enable_lightdm_helper = true;
 bool enable_dev_tooling = false;
 char lightdm_helper_path[256];
@@ -34,6 +37,7 @@ void build_object(Nob_Cmd *cmd, LibFlagsDa *main_flags,
     char *lib = nob_temp_sprintf("-I%s", HEADER_FOLDER);
     nob_cmd_append(cmd, "-std=c11");
     if (use_imagemagick7) nob_cmd_append(cmd, "-DWPC_IMAGEMAGICK_7=1");
+    if (use_webp) nob_cmd_append(cmd, "-DWPC_HAVE_WEBP=1");
     if (enable_lightdm_helper) {
         nob_cmd_append(
             cmd, "-DWPC_ENABLE_HELPER=1",
@@ -240,6 +244,49 @@ int build_target(Nob_Cmd *cmd, const char *target, Nob_File_Paths objects,
     cmd->count = 0;
     return 0;
 }
+// builds every program in folder against the wpc objects except the one
+// with main, and runs them. returns the number of programs that failed
+int build_and_run_programs(Nob_Cmd *cmd, const char *folder,
+                           Nob_File_Paths objects, LibFlagsDa *main_cflags,
+                           LibFlagsDa *common_cflags, LibFlagsDa *main_ldflags,
+                           LibFlagsDa *common_ldflags) {
+    Nob_File_Paths files = {0};
+    int failed = 0;
+    if (!nob_read_entire_dir(folder, &files)) return 1;
+
+    for (uint i = 0; i < files.count; i++) {
+        const char *filename = files.items[i];
+        uint filename_len = strlen(filename);
+        if (filename_len < 3 || strcmp(filename + filename_len - 2, ".c") != 0)
+            continue;
+
+        const char *program = nob_temp_sprintf(
+            "%s/%.*s", BUILD_FOLDER, (int)(filename_len - 2), filename);
+        if (enable_dev_tooling) {
+            nob_cmd_append(cmd, "clang");
+        } else {
+            nob_cc(cmd);
+        }
+        build_object(cmd, main_cflags, common_cflags);
+        nob_cc_inputs(cmd, nob_temp_sprintf("%s/%s", folder, filename));
+        for (uint j = 0; j < objects.count; j++) {
+            if (strcmp(objects.items[j], BUILD_FOLDER "/wpc.o") == 0) continue;
+            nob_cmd_append(cmd, objects.items[j]);
+        }
+        build_object(cmd, main_ldflags, common_ldflags);
+        nob_cc_output(cmd, program);
+        if (!nob_cmd_run(cmd)) {
+            failed++;
+            continue;
+        }
+
+        nob_cmd_append(cmd, program);
+        if (!nob_cmd_run(cmd)) failed++;
+    }
+    nob_da_free(files);
+    return failed;
+}
+
 void should_use_imagemagick7(Nob_Cmd *cmd) {
     char *imagemagick_version_env = getenv("WPC_IMAGEMAGICK_7");
     if (imagemagick_version_env != NULL) {
@@ -272,6 +319,20 @@ log:
     return;
 }
 
+void should_use_webp(Nob_Cmd *cmd) {
+    char *webp_env = getenv("WPC_WEBP");
+    if (webp_env != NULL) {
+        use_webp = strcmp(webp_env, "1") == 0;
+    } else {
+        // the native WebP decoder is optional, ImageMagick decodes WebP too
+        nob_cmd_append(cmd, "pkg-config", "--exists", "libwebp");
+        use_webp = nob_cmd_run(cmd);
+        cmd->count = 0;
+    }
+    nob_log(NOB_INFO, "Native WebP decoder %s",
+            use_webp ? "enabled" : "disabled");
+}
+
 void setup_lightdm_helper_flags(void) {
     char *enable_helper_var = getenv("WPC_HELPER");
     char *helper_path_var = getenv("WPC_HELPER_PATH");
@@ -331,10 +392,14 @@ int main(int argc, char **argv) {
 
     Nob_Cmd cmd = {0};
     should_use_imagemagick7(&cmd);
+    should_use_webp(&cmd);
     setup_lightdm_helper_flags();
 
-    char *wpc_libs[] = {"gtk4",       "x11",      "xrandr",
-                        "MagickWand", "libmagic", NULL};
+    // libwebp is last so that leaving it out ends the list early
+    char *wpc_libs[] = {"gtk4",     "x11",        "xext",
+                        "xrandr",   "xrender",    "MagickWand",
+                        "libmagic", "libjpeg",    "libpng",
+                        use_webp ? "libwebp" : NULL, NULL};
     char *wpc_common_libs[] = {"glib-2.0", "libcjson", NULL};
 
     LibFlagsDa wpc_common_cflags = list_lib_cflags(&cmd, wpc_common_libs);
@@ -342,6 +407,8 @@ int main(int argc, char **argv) {
 
     LibFlagsDa wpc_cflags = list_lib_cflags(&cmd, wpc_libs);
     LibFlagsDa wpc_ldflags = list_lib_ldflags(&cmd, wpc_libs);
+    // the resampler computes its filter weights with libm
+    nob_da_append(&wpc_ldflags, "-lm");
 
     LibFlagsDa wpc_helper_cflags = {0};
     LibFlagsDa wpc_helper_ldflags = {0};
@@ -351,6 +418,25 @@ int main(int argc, char **argv) {
 
     build_target(&cmd, "wpc", object_names, &wpc_ldflags, &wpc_common_ldflags);
 
+    // ./nob test and ./nob bench build the programs in tests/ or bench/
+    // and fail if one of them does
+    int failed_programs = 0;
+    const char *programs_folder = NULL;
+    if (argc > 1 && strcmp(argv[1], "test") == 0) {
+        programs_folder = TEST_FOLDER;
+    } else if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        programs_folder = BENCH_FOLDER;
+    }
+    if (programs_folder) {
+        failed_programs = build_and_run_programs(
+            &cmd, programs_folder, object_names, &wpc_cflags,
+            &wpc_common_cflags, &wpc_ldflags, &wpc_common_ldflags);
+        if (failed_programs > 0) {
+            nob_log(NOB_ERROR, "%d programs in %s failed", failed_programs,
+                    programs_folder);
+        }
+    }
+
     if (enable_lightdm_helper) {
         Nob_File_Paths helper_objects = build_source_files(
             &cmd, "wpc_lightdm_helper", &wpc_helper_cflags, &wpc_common_cflags);
@@ -368,5 +454,5 @@ int main(int argc, char **argv) {
     nob_da_free(wpc_common_cflags);
     nob_da_free(wpc_common_ldflags);
 
-    return 0;
+    return failed_programs > 0 ? 1 : 0;
 }
@@ -87,6 +87,26 @@ static BgMode bg_mode_from_string(const gchar *str) {
         return BG_MODE_FILL;
 }
 
+static const gchar *quality_to_string(Quality quality) {
+    switch (quality) {
+    case QUALITY_FAST:
+        return "fast";
+    case QUALITY_BALANCED:
+        return "balanced";
+    default:
+        return "best";
+    }
+}
+
+static Quality quality_from_string(const gchar *str) {
+    if (strcmp(str, "fast") == 0)
+        return QUALITY_FAST;
+    else if (strcmp(str, "balanced") == 0)
+        return QUALITY_BALANCED;
+    else
+        return QUALITY_BEST;
+}
+
 static void get_xdg_pictures_dir(Config *config) {
     const gchar *xdg_pictures_dir =
         g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
@@ -187,10 +207,23 @@ extern void init_config_monitor(Config *config, const gchar *monitor_name,
     new_monitor->name = g_strdup(monitor_name);
     new_monitor->image_path = g_strdup(wallpaper_path);
     new_monitor->bg_mode = bg_mode;
+    new_monitor->quality = QUALITY_BEST;
     new_monitor->bg_fallback_color = g_strdup("");
     new_monitor->valid_bg_fallback_color = g_strdup("");
 }
 
+extern ConfigMonitor *get_config_monitor(Config *config,
+                                         const gchar *monitor_name) {
+    gushort i;
+    for (i = 0; i < config->number_of_monitors; i++) {
+        if (g_strcmp0(config->monitors_with_backgrounds[i].name,
+                      monitor_name) == 0) {
+            return &config->monitors_with_backgrounds[i];
+        }
+    }
+    return NULL;
+}
+
 extern Config *load_config(void) {
     gchar *temp;
     size_t capacity, file_size;
@@ -202,8 +235,10 @@ extern Config *load_config(void) {
     Config *config;
     ConfigMonitor *monitor_background_pair;
     cJSON *settings_json, *monitor_name_json, *monitors_json,
-        *monitor_background_json, *bg_mode_json, *bg_fallback_color_json,
-        *source_directory_json;
+        *monitor_background_json, *image_path_json, *bg_mode_json,
+        *bg_fallback_color_json, *quality_json,
+        *source_directory_json, *frame_cache_budget_json, *resampler_json,
+        *render_memory_budget_json, *scan_workers_json, *recursive_scan_json;
     FILE *file;
     file = fopen(config_filename, "r");
     free(config_filename);
@@ -215,6 +250,11 @@ extern Config *load_config(void) {
 
     config->monitors_with_backgrounds = NULL;
     config->number_of_monitors = 0;
+    config->frame_cache_budget = DEFAULT_FRAME_CACHE_BUDGET;
+    config->render_memory_budget = DEFAULT_RENDER_MEMORY_BUDGET;
+    config->scan_workers = DEFAULT_SCAN_WORKERS;
+    config->recursive_scan = FALSE;
+    config->resampler = RESAMPLER_NATIVE;
 
     if (file == NULL) {
         get_xdg_pictures_dir(config);
@@ -277,6 +317,42 @@ extern Config *load_config(void) {
     config->valid_source_directory =
         validate_src_dir(config->source_directory) ? TRUE : FALSE;
 
+    frame_cache_budget_json =
+        cJSON_GetObjectItemCaseSensitive(settings_json, "frameCacheBudgetMiB");
+    if (cJSON_IsNumber(frame_cache_budget_json) &&
+        frame_cache_budget_json->valueint >= 0) {
+        config->frame_cache_budget = (guint)frame_cache_budget_json->valueint;
+    }
+
+    render_memory_budget_json = cJSON_GetObjectItemCaseSensitive(
+        settings_json, "renderMemoryBudgetMiB");
+    if (cJSON_IsNumber(render_memory_budget_json) &&
+        render_memory_budget_json->valueint >= 0) {
+        config->render_memory_budget =
+            (guint)render_memory_budget_json->valueint;
+    }
+
+    scan_workers_json =
+        cJSON_GetObjectItemCaseSensitive(settings_json, "scanWorkers");
+    if (cJSON_IsNumber(scan_workers_json) &&
+        scan_workers_json->valueint >= 0) {
+        config->scan_workers = (guint)scan_workers_json->valueint;
+    }
+
+    recursive_scan_json =
+        cJSON_GetObjectItemCaseSensitive(settings_json, "recursiveScan");
+    config->recursive_scan = cJSON_IsTrue(recursive_scan_json);
+
+    resampler_json =
+        cJSON_GetObjectItemCaseSensitive(settings_json, "resampler");
+    if (cJSON_IsString(resampler_json) &&
+        g_strcmp0(resampler_json->valuestring, "imagemagick") == 0) {
+        config->resampler = RESAMPLER_IMAGEMAGICK;
+    } else if (cJSON_IsString(resampler_json) &&
+               g_strcmp0(resampler_json->valuestring, "xrender") == 0) {
+        config->resampler = RESAMPLER_XRENDER;
+    }
+
     monitors_json = cJSON_GetObjectItemCaseSensitive(settings_json,
                                                      "monitorsWithBackgrounds");
 
@@ -299,7 +375,7 @@ extern Config *load_config(void) {
 
         monitor_name_json =
             cJSON_GetObjectItemCaseSensitive(monitor_background_json, "name");
-        monitor_background_json = cJSON_GetObjectItemCaseSensitive(
+        image_path_json = cJSON_GetObjectItemCaseSensitive(
             monitor_background_json, "imagePath");
         bg_mode_json =
             cJSON_GetObjectItemCaseSensitive(monitor_background_json, "bgMode");
@@ -307,14 +383,16 @@ extern Config *load_config(void) {
         bg_fallback_color_json = cJSON_GetObjectItemCaseSensitive(
             monitor_background_json, "bgFallbackColor");
 
+        quality_json = cJSON_GetObjectItemCaseSensitive(
+            monitor_background_json, "quality");
+
         if (!cJSON_IsString(monitor_name_json) ||
             !monitor_name_json->valuestring) {
             fprintf(stderr, "Warning: Monitor name is missing or invalid, "
                             "skipping this monitor.\n");
             continue;
         }
-        if (!cJSON_IsString(monitor_background_json) ||
-            !monitor_background_json->valuestring) {
+        if (!cJSON_IsString(image_path_json) || !image_path_json->valuestring) {
             fprintf(stderr, "Warning: Image path is missing or invalid, "
                             "skipping this monitor.\n");
             continue;
@@ -330,7 +408,7 @@ extern Config *load_config(void) {
         }
 
         monitor_background_pair->image_path =
-            g_strdup(monitor_background_json->valuestring);
+            g_strdup(image_path_json->valuestring);
         if (!monitor_background_pair->image_path) {
             perror("Memory allocation failed for image path");
             free(monitor_background_pair->name);
@@ -353,6 +431,13 @@ extern Config *load_config(void) {
             monitor_background_pair->bg_fallback_color = g_strdup("");
         }
 
+        if (cJSON_IsString(quality_json)) {
+            monitor_background_pair->quality =
+                quality_from_string(quality_json->valuestring);
+        } else {
+            monitor_background_pair->quality = QUALITY_BEST;
+        }
+
         validate_bg_fallback(monitor_background_pair);
 
         number_of_monitors++;
@@ -389,6 +474,41 @@ extern void dump_config(Config *config) {
         goto end;
     }
 
+    if (config->frame_cache_budget != DEFAULT_FRAME_CACHE_BUDGET &&
+        cJSON_AddNumberToObject(settings_json, "frameCacheBudgetMiB",
+                                config->frame_cache_budget) == NULL) {
+        goto end;
+    }
+
+    if (config->render_memory_budget != DEFAULT_RENDER_MEMORY_BUDGET &&
+        cJSON_AddNumberToObject(settings_json, "renderMemoryBudgetMiB",
+                                config->render_memory_budget) == NULL) {
+        goto end;
+    }
+
+    if (config->scan_workers != DEFAULT_SCAN_WORKERS &&
+        cJSON_AddNumberToObject(settings_json, "scanWorkers",
+                                config->scan_workers) == NULL) {
+        goto end;
+    }
+
+    if (config->recursive_scan &&
+        cJSON_AddBoolToObject(settings_json, "recursiveScan", TRUE) == NULL) {
+        goto end;
+    }
+
+    if (config->resampler == RESAMPLER_IMAGEMAGICK &&
+        cJSON_AddStringToObject(settings_json, "resampler", "imagemagick") ==
+            NULL) {
+        goto end;
+    }
+
+    if (config->resampler == RESAMPLER_XRENDER &&
+        cJSON_AddStringToObject(settings_json, "resampler", "xrender") ==
+            NULL) {
+        goto end;
+    }
+
     monitors_with_backgrounds_json =
         cJSON_AddArrayToObject(settings_json, "monitorsWithBackgrounds");
     if (monitors_with_backgrounds_json == NULL) {
@@ -416,6 +536,14 @@ extern void dump_config(Config *config) {
                                     bg_mode_to_string(bg_mode));
         }
 
+        if (monitor_background_pair->quality != QUALITY_BEST &&
+            cJSON_AddStringToObject(
+                monitor_background_json, "quality",
+                quality_to_string(monitor_background_pair->quality)) == NULL) {
+            cJSON_Delete(monitor_background_json);
+            goto end;
+        }
+
         if (cJSON_AddStringToObject(monitor_background_json, "name",
                                     monitor_background_pair->name) == NULL) {
             goto end;
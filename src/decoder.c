@@ -0,0 +1,556 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+#ifdef WPC_HAVE_WEBP
+    #include <webp/decode.h>
+#endif
+
+#include "wpc/decoder.h"
+
+/*
+ * A backend decodes one format straight into 8 bit RGBA. open only reads
+ * the header, read_rows decodes the next rows. reduce is optional and
+ * makes the rows come out at a smaller size. Formats without a backend,
+ * or files a backend fails on, are left to ImageMagick by the callers.
+ */
+struct DecoderBackend {
+    const gchar *name;
+    gboolean (*matches)(const guchar *header, gsize length);
+    gboolean (*open)(ImageReader *reader, DecodeSizeFunc size_func,
+                     gpointer data);
+    gboolean (*reduce)(ImageReader *reader, guint width, guint height);
+    gboolean (*read_rows)(ImageReader *reader, guchar *dst, guint rows);
+    void (*close)(ImageReader *reader);
+};
+
+typedef struct {
+    struct jpeg_error_mgr base;
+    jmp_buf jump;
+} JpegError;
+
+typedef struct {
+    struct jpeg_decompress_struct cinfo;
+    JpegError error;
+    gboolean created, started;
+} JpegState;
+
+static gboolean is_jpeg(const guchar *header, gsize length) {
+    return length >= 3 && header[0] == 0xff && header[1] == 0xd8 &&
+           header[2] == 0xff;
+}
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    g_info("libjpeg: %s", message);
+    longjmp(((JpegError *)cinfo->err)->jump, 1);
+}
+
+static void jpeg_output_message(j_common_ptr cinfo) {
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    g_info("libjpeg: %s", message);
+}
+
+#ifndef JCS_EXTENSIONS
+/* spreads RGB out to RGBA in place, from the end so nothing is overwritten */
+static void expand_rgb_row(guchar *row, guint width) {
+    guint x;
+    for (x = width; x-- > 0;) {
+        row[x * 4 + 3] = 0xff;
+        row[x * 4 + 2] = row[x * 3 + 2];
+        row[x * 4 + 1] = row[x * 3 + 1];
+        row[x * 4] = row[x * 3];
+    }
+}
+#endif
+
+/*
+ * Function: open_jpeg
+ * -------------------
+ * Reads the header of a JPEG. The IDCT can scale by 1/2, 1/4 and 1/8 for
+ * free, so the largest of those that keeps the image at or above the size
+ * the caller asked for is used.
+ *
+ * libjpeg only converts YCbCr, RGB and grayscale to RGB, CMYK and YCCK
+ * would only fail once decompression starts, so they are left to
+ * ImageMagick right away.
+ */
+static gboolean open_jpeg(ImageReader *reader, DecodeSizeFunc size_func,
+                          gpointer data) {
+    JpegState *state;
+    struct jpeg_decompress_struct *cinfo;
+    guint min_width, min_height, denom;
+
+    state = g_new0(JpegState, 1);
+    reader->state = state;
+    cinfo = &state->cinfo;
+    cinfo->err = jpeg_std_error(&state->error.base);
+    state->error.base.error_exit = jpeg_error_exit;
+    state->error.base.output_message = jpeg_output_message;
+    if (setjmp(state->error.jump)) return FALSE;
+
+    jpeg_create_decompress(cinfo);
+    state->created = TRUE;
+    jpeg_stdio_src(cinfo, reader->file);
+    jpeg_read_header(cinfo, TRUE);
+    if (cinfo->jpeg_color_space != JCS_YCbCr &&
+        cinfo->jpeg_color_space != JCS_RGB &&
+        cinfo->jpeg_color_space != JCS_GRAYSCALE) {
+        return FALSE;
+    }
+
+    reader->full_width = cinfo->image_width;
+    reader->full_height = cinfo->image_height;
+    min_width = cinfo->image_width;
+    min_height = cinfo->image_height;
+    if (size_func) {
+        size_func(cinfo->image_width, cinfo->image_height, &min_width,
+                  &min_height, data);
+    }
+    for (denom = 8; denom > 1; denom /= 2) {
+        if ((cinfo->image_width + denom - 1) / denom >= min_width &&
+            (cinfo->image_height + denom - 1) / denom >= min_height) {
+            break;
+        }
+    }
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = denom;
+#ifdef JCS_EXTENSIONS
+    cinfo->out_color_space = JCS_EXT_RGBA;
+#else
+    cinfo->out_color_space = JCS_RGB;
+#endif
+    jpeg_calc_output_dimensions(cinfo);
+
+    reader->width = cinfo->output_width;
+    reader->height = cinfo->output_height;
+    reader->has_alpha = FALSE;
+    reader->streams = TRUE;
+    return TRUE;
+}
+
+static gboolean read_jpeg_rows(ImageReader *reader, guchar *dst,
+                               guint rows) {
+    JpegState *state = reader->state;
+    JSAMPROW row;
+    guint i;
+
+    if (setjmp(state->error.jump)) return FALSE;
+
+    if (!state->started) {
+        jpeg_start_decompress(&state->cinfo);
+        state->started = TRUE;
+    }
+    for (i = 0; i < rows; i++) {
+        row = dst + (gsize)i * reader->width * 4;
+        if (jpeg_read_scanlines(&state->cinfo, &row, 1) != 1) return FALSE;
+#ifndef JCS_EXTENSIONS
+        expand_rgb_row(row, reader->width);
+#endif
+    }
+    return TRUE;
+}
+
+static void close_jpeg(ImageReader *reader) {
+    JpegState *state = reader->state;
+    if (state->created) jpeg_destroy_decompress(&state->cinfo);
+    g_free(state);
+}
+
+typedef struct {
+    png_structp png;
+    png_infop info;
+    gboolean interlaced;
+    /* interlaced images can only be decoded as a whole */
+    guchar *pixels;
+    png_bytep *row_pointers;
+} PngState;
+
+static gboolean is_png(const guchar *header, gsize length) {
+    return length >= 8 && png_sig_cmp(header, 0, 8) == 0;
+}
+
+static void png_error_fn(png_structp png, png_const_charp message) {
+    g_info("libpng: %s", message);
+    png_longjmp(png, 1);
+}
+
+static void png_warning_fn(png_structp png, png_const_charp message) {
+    (void)png;
+    g_info("libpng: %s", message);
+}
+
+/*
+ * Function: open_png
+ * ------------------
+ * Reads the header of a PNG and sets up libpng to turn every color type
+ * and bit depth into 8 bit RGBA. PNG cannot be decoded at a smaller size,
+ * so size_func is not called.
+ */
+static gboolean open_png(ImageReader *reader, DecodeSizeFunc size_func,
+                         gpointer data) {
+    PngState *state;
+    png_byte color_type;
+
+    (void)size_func, (void)data;
+
+    state = g_new0(PngState, 1);
+    reader->state = state;
+    state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+                                        png_error_fn, png_warning_fn);
+    if (!state->png) return FALSE;
+    state->info = png_create_info_struct(state->png);
+    if (!state->info) return FALSE;
+    if (setjmp(png_jmpbuf(state->png))) return FALSE;
+
+    png_init_io(state->png, reader->file);
+    png_read_info(state->png, state->info);
+
+    color_type = png_get_color_type(state->png, state->info);
+    reader->has_alpha =
+        (color_type & PNG_COLOR_MASK_ALPHA) != 0 ||
+        png_get_valid(state->png, state->info, PNG_INFO_tRNS) != 0;
+
+    png_set_expand(state->png);
+    png_set_scale_16(state->png);
+    png_set_gray_to_rgb(state->png);
+    png_set_add_alpha(state->png, 0xff, PNG_FILLER_AFTER);
+    state->interlaced = png_set_interlace_handling(state->png) > 1;
+    png_read_update_info(state->png, state->info);
+
+    reader->width = png_get_image_width(state->png, state->info);
+    reader->height = png_get_image_height(state->png, state->info);
+    reader->full_width = reader->width;
+    reader->full_height = reader->height;
+    reader->streams = !state->interlaced;
+    return png_get_rowbytes(state->png, state->info) ==
+           (gsize)reader->width * 4;
+}
+
+static gboolean read_png_rows(ImageReader *reader, guchar *dst, guint rows) {
+    PngState *state = reader->state;
+    gsize stride = (gsize)reader->width * 4;
+    guint i;
+
+    if (setjmp(png_jmpbuf(state->png))) return FALSE;
+
+    if (!state->interlaced) {
+        for (i = 0; i < rows; i++) {
+            png_read_row(state->png, dst + i * stride, NULL);
+        }
+        return TRUE;
+    }
+
+    if (!state->pixels) {
+        state->pixels = malloc(stride * reader->height);
+        state->row_pointers = malloc(reader->height * sizeof(png_bytep));
+        if (!state->pixels || !state->row_pointers) return FALSE;
+        for (i = 0; i < reader->height; i++) {
+            state->row_pointers[i] = state->pixels + i * stride;
+        }
+        png_read_image(state->png, state->row_pointers);
+    }
+    memcpy(dst, state->pixels + reader->rows_read * stride, rows * stride);
+    return TRUE;
+}
+
+static void close_png(ImageReader *reader) {
+    PngState *state = reader->state;
+    png_destroy_read_struct(&state->png, &state->info, NULL);
+    free(state->pixels);
+    free(state->row_pointers);
+    g_free(state);
+}
+
+#ifdef WPC_HAVE_WEBP
+typedef struct {
+    guchar *contents;
+    gsize size;
+    /* libwebp decodes the whole image at once */
+    guchar *pixels;
+    gboolean scaled;
+} WebpState;
+
+static gboolean is_webp(const guchar *header, gsize length) {
+    return length >= 12 && memcmp(header, "RIFF", 4) == 0 &&
+           memcmp(header + 8, "WEBP", 4) == 0;
+}
+
+static guchar *read_whole_file(FILE *file, gsize *size) {
+    glong length;
+    guchar *contents;
+
+    if (fseek(file, 0, SEEK_END) != 0) return NULL;
+    length = ftell(file);
+    rewind(file);
+    if (length <= 0) return NULL;
+    *size = (gsize)length;
+    contents = malloc(*size);
+    if (!contents) return NULL;
+    if (fread(contents, 1, *size, file) != *size) {
+        free(contents);
+        return NULL;
+    }
+    return contents;
+}
+
+/* enough for the VP8X, VP8L and VP8 headers that hold the size */
+#define WEBP_HEADER_SIZE 64
+
+/*
+ * Function: open_webp
+ * -------------------
+ * Parses the header of a still WebP. Animations are left to ImageMagick.
+ * The whole file is only read once rows are read, libwebp needs all of it
+ * to decode.
+ */
+static gboolean open_webp(ImageReader *reader, DecodeSizeFunc size_func,
+                          gpointer data) {
+    WebpState *state;
+    WebPBitstreamFeatures features;
+    guchar header[WEBP_HEADER_SIZE];
+    gsize length;
+    VP8StatusCode status;
+
+    (void)size_func, (void)data;
+
+    state = g_new0(WebpState, 1);
+    reader->state = state;
+    length = fread(header, 1, sizeof(header), reader->file);
+    status = WebPGetFeatures(header, length, &features);
+    if (status == VP8_STATUS_NOT_ENOUGH_DATA) {
+        state->contents = read_whole_file(reader->file, &state->size);
+        if (!state->contents) return FALSE;
+        status = WebPGetFeatures(state->contents, state->size, &features);
+    }
+    if (status != VP8_STATUS_OK || features.has_animation) return FALSE;
+
+    reader->width = (guint)features.width;
+    reader->height = (guint)features.height;
+    reader->full_width = reader->width;
+    reader->full_height = reader->height;
+    reader->has_alpha = features.has_alpha != 0;
+    return TRUE;
+}
+
+/* libwebp scales while it decodes, with a box filter */
+static gboolean reduce_webp(ImageReader *reader, guint width, guint height) {
+    WebpState *state = reader->state;
+
+    reader->width = width;
+    reader->height = height;
+    state->scaled = TRUE;
+    return TRUE;
+}
+
+static gboolean read_webp_rows(ImageReader *reader, guchar *dst,
+                               guint rows) {
+    WebpState *state = reader->state;
+    WebPDecoderConfig config;
+    gsize stride = (gsize)reader->width * 4;
+    VP8StatusCode status;
+
+    if (!state->pixels) {
+        if (!state->contents) {
+            state->contents = read_whole_file(reader->file, &state->size);
+            if (!state->contents) return FALSE;
+        }
+        state->pixels = malloc(stride * reader->height);
+        if (!state->pixels || !WebPInitDecoderConfig(&config)) return FALSE;
+
+        if (state->scaled) {
+            config.options.use_scaling = 1;
+            config.options.scaled_width = (int)reader->width;
+            config.options.scaled_height = (int)reader->height;
+        }
+        config.output.colorspace = MODE_RGBA;
+        config.output.is_external_memory = 1;
+        config.output.u.RGBA.rgba = state->pixels;
+        config.output.u.RGBA.stride = (int)stride;
+        config.output.u.RGBA.size = stride * reader->height;
+        status = WebPDecode(state->contents, state->size, &config);
+        WebPFreeDecBuffer(&config.output);
+        free(state->contents);
+        state->contents = NULL;
+        if (status != VP8_STATUS_OK) return FALSE;
+    }
+    memcpy(dst, state->pixels + reader->rows_read * stride, rows * stride);
+    return TRUE;
+}
+
+static void close_webp(ImageReader *reader) {
+    WebpState *state = reader->state;
+    free(state->contents);
+    free(state->pixels);
+    g_free(state);
+}
+#endif
+
+static const DecoderBackend backends[] = {
+    {"libjpeg", is_jpeg, open_jpeg, NULL, read_jpeg_rows, close_jpeg},
+    {"libpng", is_png, open_png, NULL, read_png_rows, close_png},
+#ifdef WPC_HAVE_WEBP
+    {"libwebp", is_webp, open_webp, reduce_webp, read_webp_rows,
+     close_webp},
+#endif
+};
+
+/*
+ * Function: open_image_reader
+ * ---------------------------
+ * Opens the image at path with the native backend for its format and
+ * reads its header, no pixels are decoded yet.
+ *
+ * Parameters:
+ *   - size_func: Optional, tells the decoder how small the image may be
+ * decoded. Only JPEG can be decoded at a smaller size, other formats do
+ * not call it.
+ *
+ * Returns:
+ *   The reader, or NULL if the format has no native backend or the header
+ *   could not be read, in which case the caller should fall back to
+ *   ImageMagick.
+ */
+extern ImageReader *open_image_reader(const gchar *path,
+                                      DecodeSizeFunc size_func,
+                                      gpointer data) {
+    ImageReader *reader;
+    FILE *file;
+    guchar header[16];
+    gsize length, i;
+
+    file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    length = fread(header, 1, sizeof(header), file);
+    for (i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (backends[i].matches(header, length)) break;
+    }
+    if (i == G_N_ELEMENTS(backends)) {
+        fclose(file);
+        return NULL;
+    }
+
+    rewind(file);
+    reader = g_new0(ImageReader, 1);
+    reader->file = file;
+    reader->backend = &backends[i];
+    reader->decoder = backends[i].name;
+    if (!reader->backend->open(reader, size_func, data)) {
+        g_info("%s could not read the header of %s", reader->decoder, path);
+        close_image_reader(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+/*
+ * Function: reduce_image_reader
+ * -----------------------------
+ * Makes the rows of an image that is decoded whole, see ImageReader, come
+ * out at width x height, so less than the whole image is held. Must be
+ * called before the first rows are read.
+ *
+ * Returns:
+ *   FALSE if the backend can not decode at a smaller size, the reader is
+ *   left unchanged then.
+ */
+extern gboolean reduce_image_reader(ImageReader *reader, guint width,
+                                    guint height) {
+    if (!reader->backend->reduce || reader->rows_read > 0 || width == 0 ||
+        height == 0 || width > reader->width || height > reader->height) {
+        return FALSE;
+    }
+    return reader->backend->reduce(reader, width, height);
+}
+
+/*
+ * Function: read_image_rows
+ * -------------------------
+ * Decodes the next rows rows into dst as tightly packed 8 bit RGBA.
+ *
+ * Returns:
+ *   FALSE if the rows could not be decoded or the image has fewer rows
+ *   left.
+ */
+extern gboolean read_image_rows(ImageReader *reader, guchar *dst,
+                                guint rows) {
+    if (rows > reader->height - reader->rows_read ||
+        !reader->backend->read_rows(reader, dst, rows)) {
+        return FALSE;
+    }
+    reader->rows_read += rows;
+    return TRUE;
+}
+
+extern void close_image_reader(ImageReader *reader) {
+    if (!reader) return;
+    reader->backend->close(reader);
+    fclose(reader->file);
+    g_free(reader);
+}
+
+/*
+ * Function: decode_image
+ * ----------------------
+ * Decodes the whole image at path into tightly packed 8 bit RGBA pixels,
+ * see open_image_reader.
+ *
+ * Returns:
+ *   A new image with one reference, or NULL if the image has no native
+ *   backend or could not be decoded.
+ */
+extern DecodedImage *decode_image(const gchar *path, DecodeSizeFunc size_func,
+                                  gpointer data) {
+    ImageReader *reader;
+    DecodedImage *image;
+    guchar *pixels;
+    gint64 start = g_get_monotonic_time();
+
+    reader = open_image_reader(path, size_func, data);
+    if (!reader) return NULL;
+
+    pixels = malloc((gsize)reader->width * reader->height * 4);
+    if (!pixels || !read_image_rows(reader, pixels, reader->height)) {
+        g_info("%s could not decode %s", reader->decoder, path);
+        free(pixels);
+        close_image_reader(reader);
+        return NULL;
+    }
+
+    image = g_new0(DecodedImage, 1);
+    image->pixels = pixels;
+    image->width = reader->width;
+    image->height = reader->height;
+    image->full_width = reader->full_width;
+    image->full_height = reader->full_height;
+    image->has_alpha = reader->has_alpha;
+    image->decoder = reader->decoder;
+    image->refs = 1;
+    close_image_reader(reader);
+
+    g_info("decoded %s with %s at %ux%u of %ux%u in %.2f ms", path,
+           image->decoder, image->width, image->height, image->full_width,
+           image->full_height,
+           (double)(g_get_monotonic_time() - start) / 1000.0);
+    return image;
+}
+
+extern DecodedImage *decoded_image_ref(DecodedImage *image) {
+    g_atomic_int_inc(&image->refs);
+    return image;
+}
+
+extern void decoded_image_unref(DecodedImage *image) {
+    if (!image || !g_atomic_int_dec_and_test(&image->refs)) return;
+    free(image->pixels);
+    g_free(image);
+}
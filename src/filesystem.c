@@ -1,57 +1,204 @@
 // Copyright 2025 webdevred
 
+#define _POSIX_C_SOURCE 200809L
+/* d_type of directory entries */
+#define _DEFAULT_SOURCE
+
 #include <dirent.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <magic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "wpc/decoder.h"
 #include "wpc/filesystem.h"
+#include "wpc/library_index.h"
 #include "wpc/wpc_imagemagick.h"
 __attribute__((used)) static void _mark_magick_used(void) {
     _wpc_magick_include_marker();
 }
 
-static bool check_image(const char *filename) {
-    bool valid;
-    const char *mime_type;
-    magic_t magic = magic_open(MAGIC_MIME_TYPE);
-    if (!magic) {
-        fprintf(stderr, "Failed to initialize libmagic\n");
-        return FALSE;
+#define SNIFF_LENGTH 32
+
+/* the libmagic cookie of a scan, only opened once a file needs it */
+typedef struct {
+    magic_t magic;
+    gboolean magic_failed;
+    guint sniffed, looked_up;
+    /* the files libmagic took for an image */
+    guint magic_recognized;
+} ImageCheck;
+
+static gboolean has_bytes(const guchar *header, gsize length, gsize offset,
+                          const char *bytes, gsize count) {
+    return offset + count <= length &&
+           memcmp(header + offset, bytes, count) == 0;
+}
+
+static guint32 read_le32(const guchar *bytes) {
+    return (guint32)bytes[0] | (guint32)bytes[1] << 8 |
+           (guint32)bytes[2] << 16 | (guint32)bytes[3] << 24;
+}
+
+static guint32 read_be32(const guchar *bytes) {
+    return (guint32)bytes[0] << 24 | (guint32)bytes[1] << 16 |
+           (guint32)bytes[2] << 8 | (guint32)bytes[3];
+}
+
+/* an ISO BMFF file type box with an AVIF brand among its first brands */
+static gboolean is_avif(const guchar *header, gsize length) {
+    gsize offset, end;
+
+    if (!has_bytes(header, length, 4, "ftyp", 4)) return FALSE;
+    end = MIN(read_be32(header), length);
+    for (offset = 8; offset + 4 <= end; offset += 4) {
+        /* the minor version sits between the major and compatible brands */
+        if (offset == 12) continue;
+        if (has_bytes(header, end, offset, "avif", 4) ||
+            has_bytes(header, end, offset, "avis", 4)) {
+            return TRUE;
+        }
     }
+    return FALSE;
+}
 
-    magic_load(magic, NULL);
+/*
+ * Function: sniff_image_format
+ * ----------------------------
+ * Recognizes the common image formats by the signature at the start of
+ * the file, without libmagic.
+ *
+ * Returns:
+ *   The format, or IMAGE_FORMAT_NONE if the header matches none of them.
+ */
+static ImageFormat sniff_image_format(const guchar *header, gsize length) {
+    guint32 dib_size;
+
+    if (has_bytes(header, length, 0, "\xff\xd8\xff", 3)) {
+        return IMAGE_FORMAT_JPEG;
+    }
+    if (has_bytes(header, length, 0, "\x89PNG\r\n\x1a\n", 8)) {
+        return IMAGE_FORMAT_PNG;
+    }
+    if (has_bytes(header, length, 0, "RIFF", 4) &&
+        has_bytes(header, length, 8, "WEBP", 4)) {
+        return IMAGE_FORMAT_WEBP;
+    }
+    if (has_bytes(header, length, 0, "GIF87a", 6) ||
+        has_bytes(header, length, 0, "GIF89a", 6)) {
+        return IMAGE_FORMAT_GIF;
+    }
+    if (has_bytes(header, length, 0, "II*\0", 4) ||
+        has_bytes(header, length, 0, "MM\0*", 4)) {
+        return IMAGE_FORMAT_TIFF;
+    }
+    /* "BM" alone is too common, the DIB header size must be a known one */
+    if (has_bytes(header, length, 0, "BM", 2) && length >= 18) {
+        dib_size = read_le32(header + 14);
+        if (dib_size == 12 || dib_size == 40 || dib_size == 52 ||
+            dib_size == 56 || dib_size == 64 || dib_size == 108 ||
+            dib_size == 124) {
+            return IMAGE_FORMAT_BMP;
+        }
+    }
+    if (is_avif(header, length)) return IMAGE_FORMAT_AVIF;
+    return IMAGE_FORMAT_NONE;
+}
 
-    valid = TRUE;
-    mime_type = magic_file(magic, filename);
-    if (!mime_type || strncmp(mime_type, "image/", 6) != 0) {
-        valid = FALSE;
-        g_info("File %s has invalid MIME type %s", filename, mime_type);
+static const char *lookup_mime_type(ImageCheck *check, const char *filename) {
+    if (!check->magic && !check->magic_failed) {
+        check->magic = magic_open(MAGIC_MIME_TYPE);
+        if (!check->magic || magic_load(check->magic, NULL) == -1) {
+            fprintf(stderr, "Failed to initialize libmagic\n");
+            if (check->magic) magic_close(check->magic);
+            check->magic = NULL;
+            check->magic_failed = TRUE;
+        }
     }
+    if (!check->magic) return NULL;
 
-    magic_close(magic);
+    check->looked_up++;
+    return magic_file(check->magic, filename);
+}
 
-    return valid;
+/*
+ * Function: check_image
+ * ---------------------
+ * Checks that a file is an image. The first bytes are matched against the
+ * signatures of the common formats, libmagic is only asked about files
+ * none of them match.
+ *
+ * Parameters:
+ *   - format: Set to the format, IMAGE_FORMAT_OTHER for images only
+ * libmagic recognized and IMAGE_FORMAT_NONE for anything else.
+ *
+ * Returns:
+ *   FALSE if the file could not be checked, because it could not be read
+ *   or libmagic failed.
+ */
+static gboolean check_image(ImageCheck *check, const char *filename,
+                            ImageFormat *format) {
+    guchar header[SNIFF_LENGTH];
+    gsize length;
+    const char *mime_type;
+    FILE *file;
+
+    file = fopen(filename, "rb");
+    if (!file) return FALSE;
+    length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+
+    *format = sniff_image_format(header, length);
+    if (*format != IMAGE_FORMAT_NONE) {
+        check->sniffed++;
+        return TRUE;
+    }
+
+    mime_type = lookup_mime_type(check, filename);
+    if (!mime_type) return FALSE;
+    if (strncmp(mime_type, "image/", 6) != 0) {
+        g_info("File %s has invalid MIME type %s", filename, mime_type);
+        return TRUE;
+    }
+    check->magic_recognized++;
+    *format = IMAGE_FORMAT_OTHER;
+    return TRUE;
 }
 
+/*
+ * Function: set_width_and_height
+ * ------------------------------
+ * Reads the size of the wallpaper from the header of the file, nothing is
+ * decoded until the wallpaper is rendered. JPEG, PNG and WebP headers are
+ * parsed natively, other formats are pinged by ImageMagick.
+ */
 static bool set_width_and_height(Wallpaper *wallpaper) {
-    size_t width, height;
-    MagickWand *wand = NewMagickWand();
+    ImageReader *reader;
+    MagickWand *wand;
+
+    reader = open_image_reader(wallpaper->path, NULL, NULL);
+    if (reader) {
+        wallpaper->width = reader->full_width;
+        wallpaper->height = reader->full_height;
+        close_image_reader(reader);
+        return TRUE;
+    }
+
+    wand = NewMagickWand();
 
-    if (MagickReadImage(wand, wallpaper->path) == MagickFalse) {
+    if (MagickPingImage(wand, wallpaper->path) == MagickFalse) {
         g_warning("Failed to read image when setting width and height: %s\n",
                   wallpaper->path);
         DestroyMagickWand(wand);
-        MagickWandTerminus();
         return FALSE;
     }
 
-    width = MagickGetImageWidth(wand);
-    height = MagickGetImageHeight(wand);
-
-    wallpaper->width = width;
-    wallpaper->height = height;
+    wallpaper->width = MagickGetImageWidth(wand);
+    wallpaper->height = MagickGetImageHeight(wand);
 
     DestroyMagickWand(wand);
     return TRUE;
@@ -67,116 +214,601 @@ extern void free_wallpapers(WallpaperArray *arr) {
     free(arr);
 }
 
-extern WallpaperQueue *new_wallpaper_queue(gchar *source_directory) {
-    WallpaperArray *wallpapers = list_wallpapers(source_directory);
-    WallpaperQueue *queue = malloc(sizeof(WallpaperQueue));
-    queue->wallpapers = wallpapers;
-    queue->current_wallpaper = 0;
+static void queue_found_wallpaper(const Wallpaper *wallpaper, guint index,
+                                  gpointer user_data) {
+    WallpaperQueue *queue = user_data;
+    (void)index;
+    g_mutex_lock(&queue->lock);
+    g_ptr_array_add(queue->paths, g_strdup(wallpaper->path));
+    g_cond_broadcast(&queue->changed);
+    g_mutex_unlock(&queue->lock);
+}
+
+static gpointer scan_into_queue(gpointer data) {
+    WallpaperQueue *queue = data;
+    WallpaperArray *wallpapers;
+
+    wallpapers = list_wallpapers(queue->source_directory, &queue->options);
+    if (wallpapers) free_wallpapers(wallpapers);
+
+    g_mutex_lock(&queue->lock);
+    queue->scanning = FALSE;
+    g_cond_broadcast(&queue->changed);
+    g_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/*
+ * Function: new_wallpaper_queue
+ * -----------------------------
+ * Starts listing source_directory on a thread of its own and returns the
+ * queue the wallpapers are handed out from while they are found.
+ * options->found is replaced by the queue's own callback.
+ */
+extern WallpaperQueue *new_wallpaper_queue(gchar *source_directory,
+                                           const ScanOptions *options) {
+    WallpaperQueue *queue = g_new0(WallpaperQueue, 1);
+
+    queue->paths = g_ptr_array_new_with_free_func(g_free);
+    queue->source_directory = g_strdup(source_directory);
+    queue->options = *options;
+    queue->options.found = queue_found_wallpaper;
+    queue->options.user_data = queue;
+    g_mutex_init(&queue->lock);
+    g_cond_init(&queue->changed);
+    queue->scanning = TRUE;
+    queue->scanner = g_thread_new("wpc-scan", scan_into_queue, queue);
     return queue;
 }
 
+/* waits for the scan to finish, so its library index is written */
 extern void free_wallpaper_queue(WallpaperQueue *queue) {
-    free_wallpapers(queue->wallpapers);
-    free(queue);
+    g_thread_join(queue->scanner);
+    g_ptr_array_free(queue->paths, TRUE);
+    g_free(queue->source_directory);
+    g_mutex_clear(&queue->lock);
+    g_cond_clear(&queue->changed);
+    g_free(queue);
 }
 
+/*
+ * Function: next_wallpaper_in_queue
+ * ---------------------------------
+ * Returns the next wallpaper in the order they were found. While the scan
+ * is running this waits for the next one to be found, only once the scan
+ * is done does the queue start over.
+ *
+ * Returns:
+ *   The path, owned by the queue, or NULL if no wallpaper was found.
+ */
 gchar *next_wallpaper_in_queue(WallpaperQueue *queue) {
-    WallpaperArray *array = queue->wallpapers;
+    gchar *path = NULL;
+
+    g_mutex_lock(&queue->lock);
+    while (queue->scanning && queue->current_wallpaper >= queue->paths->len) {
+        g_cond_wait(&queue->changed, &queue->lock);
+    }
+    if (queue->paths->len > 0) {
+        if (queue->current_wallpaper >= queue->paths->len) {
+            queue->current_wallpaper = 0;
+        }
+        path = g_ptr_array_index(queue->paths, queue->current_wallpaper++);
+    }
+    g_mutex_unlock(&queue->lock);
+    return path;
+}
+
+/* fewer files than this per worker are not worth starting a thread for */
+#define FILES_PER_SCAN_WORKER 64
+
+/*
+ * One file of the source directory. dir_fd, the names and record are set
+ * when the directory is listed, the rest is filled in by the worker
+ * probing it.
+ */
+typedef struct {
+    /* the directory the file is in, base_name is relative to it */
+    int dir_fd;
+    /* the path relative to the source directory */
+    const gchar *name;
+    const gchar *base_name;
+    const LibraryRecord *record;
     gchar *path;
-    if (array->amount_used == 0) {
-        return NULL;
+    struct stat file_stat;
+    gboolean regular, reused;
+    /* the check failed, the file is neither indexed nor listed */
+    gboolean unchecked;
+    ImageFormat format;
+    guint width, height;
+    /* set atomically once the item is probed */
+    gint probed;
+} ScanItem;
+
+/* the state of one list_wallpapers call */
+typedef struct {
+    WallpaperArray *array;
+    const gchar *source_directory;
+    const ScanOptions *options;
+    gboolean slash_needed;
+    /* the items of the directory being scanned */
+    GArray *items;
+    /* the names read from the directory, index names stay in its mapping */
+    GStringChunk *names;
+    /* the directory being read, relative to the source directory */
+    GString *relative_path;
+    GHashTable *records;
+    /* the next item to be claimed by a worker */
+    gint next_item;
+    /* the item the collecting thread waits for, -1 if it is not waiting,
+       it is signalled through probed_cond once that item is probed */
+    gint awaited;
+    GMutex probed_lock;
+    GCond probed_cond;
+    gint sniffed, looked_up, magic_recognized;
+    LibraryIndexWriter *writer;
+    guint scanned, reused, indexed, directories, workers;
+    /* whether the index has to be written again */
+    gboolean changed;
+} DirectoryScan;
+
+static void add_item(DirectoryScan *scan, int dir_fd, const gchar *name,
+                     const gchar *base_name, const LibraryRecord *record) {
+    ScanItem item = {0};
+    item.dir_fd = dir_fd;
+    item.name = name;
+    item.base_name = base_name;
+    item.record = record;
+    g_array_append_val(scan->items, item);
+}
+
+static gboolean append_wallpaper(WallpaperArray *array, gchar *path,
+                                 guint width, guint height) {
+    Wallpaper *wallpapers;
+
+    if (array->amount_used >= array->amount_allocated) {
+        wallpapers =
+            realloc(array->data,
+                    (array->amount_allocated + 8) * sizeof(Wallpaper));
+        if (!wallpapers) return FALSE;
+        array->data = wallpapers;
+        array->amount_allocated += 8;
     }
 
-    path = array->data[queue->current_wallpaper].path;
+    array->data[array->amount_used++] = (Wallpaper){
+        .width = width,
+        .height = height,
+        .path = path,
+        .flow_child = NULL,
+    };
+    return TRUE;
+}
 
-    queue->current_wallpaper =
-        (queue->current_wallpaper + 1) % array->amount_used;
+/*
+ * Function: probe_item
+ * --------------------
+ * Checks whether the file of item is an image and reads its size. The
+ * file is only checked and probed again if it changed since the index
+ * recorded it. A file that could not be checked or probed is marked
+ * unchecked rather than taken for something else than an image.
+ */
+static void probe_item(DirectoryScan *scan, ImageCheck *check,
+                       ScanItem *item) {
+    Wallpaper wallpaper = {0};
+
+    item->regular =
+        fstatat(item->dir_fd, item->base_name, &item->file_stat, 0) == 0 &&
+        S_ISREG(item->file_stat.st_mode);
+    if (!item->regular) return;
+
+    item->path = g_strdup_printf("%s%s%s", scan->source_directory,
+                                 scan->slash_needed ? "/" : "", item->name);
+    if (item->record &&
+        library_record_is_current(item->record, &item->file_stat)) {
+        item->reused = TRUE;
+        item->format = item->record->format;
+        item->width = item->record->width;
+        item->height = item->record->height;
+        return;
+    }
 
-    return path;
+    if (!check_image(check, item->path, &item->format)) {
+        item->unchecked = TRUE;
+        return;
+    }
+    if (item->format == IMAGE_FORMAT_NONE) return;
+
+    wallpaper.path = item->path;
+    if (!set_width_and_height(&wallpaper)) {
+        item->unchecked = TRUE;
+        return;
+    }
+    item->width = (guint)wallpaper.width;
+    item->height = (guint)wallpaper.height;
 }
 
-extern WallpaperArray *list_wallpapers(gchar *source_directory) {
-    Wallpaper *wallpaper_array, *wallpaper;
-    WallpaperArray *array_wrapper;
-    gushort amount_used, amount_allocated;
-    bool slash_needed;
-    struct dirent *file;
-    DIR *dir = opendir(source_directory);
-    gulong src_dir_len, path_size;
-    if (!dir) {
-        closedir(dir);
-        g_warning("dir %s does not exist", source_directory);
-        return NULL;
+/*
+ * Function: probe_next_item
+ * -------------------------
+ * Claims the next item through an atomic counter and probes it. Every item
+ * is claimed by exactly one thread and only written by that thread until
+ * its probed flag is set, so the workers never lock or wait on each other.
+ * Only the item the collecting thread waits for is signalled.
+ *
+ * Returns:
+ *   FALSE if every item was already claimed.
+ */
+static gboolean probe_next_item(DirectoryScan *scan, ImageCheck *check) {
+    ScanItem *item;
+    guint i = (guint)g_atomic_int_add(&scan->next_item, 1);
+
+    if (i >= scan->items->len) return FALSE;
+    item = &g_array_index(scan->items, ScanItem, i);
+    probe_item(scan, check, item);
+
+    g_atomic_int_set(&item->probed, TRUE);
+    if (g_atomic_int_get(&scan->awaited) == (gint)i) {
+        g_mutex_lock(&scan->probed_lock);
+        g_cond_broadcast(&scan->probed_cond);
+        g_mutex_unlock(&scan->probed_lock);
     }
+    return TRUE;
+}
 
-    array_wrapper = malloc(sizeof(WallpaperArray));
-    if (!array_wrapper) {
-        closedir(dir);
-        return NULL;
+/* a libmagic cookie must not be shared between threads, each thread
+   opens its own and adds its counts to the scan when it is done */
+static void finish_check(DirectoryScan *scan, ImageCheck *check) {
+    if (check->magic) magic_close(check->magic);
+    g_atomic_int_add(&scan->sniffed, (gint)check->sniffed);
+    g_atomic_int_add(&scan->looked_up, (gint)check->looked_up);
+    g_atomic_int_add(&scan->magic_recognized, (gint)check->magic_recognized);
+}
+
+static void scan_worker(gpointer data, gpointer user_data) {
+    DirectoryScan *scan = user_data;
+    ImageCheck check = {0};
+    (void)data;
+
+    while (probe_next_item(scan, &check)) {
     }
+    finish_check(scan, &check);
+}
 
-    array_wrapper->data = malloc(8 * sizeof(Wallpaper));
-    if (!array_wrapper->data) {
-        free(array_wrapper);
-        return NULL;
+/*
+ * Function: wait_for_item
+ * -----------------------
+ * Blocks until the worker that claimed item i has probed it. The flag is
+ * checked again under the lock after awaited is set, and the worker reads
+ * awaited after it set the flag, so the signal can not be missed.
+ */
+static void wait_for_item(DirectoryScan *scan, guint i) {
+    ScanItem *item = &g_array_index(scan->items, ScanItem, i);
+
+    g_atomic_int_set(&scan->awaited, (gint)i);
+    g_mutex_lock(&scan->probed_lock);
+    while (!g_atomic_int_get(&item->probed)) {
+        g_cond_wait(&scan->probed_cond, &scan->probed_lock);
     }
+    g_mutex_unlock(&scan->probed_lock);
+    g_atomic_int_set(&scan->awaited, -1);
+}
 
-    wallpaper_array = (Wallpaper *)array_wrapper->data;
-    amount_used = 0;
-    amount_allocated = 8;
+/*
+ * Function: collect_item
+ * ----------------------
+ * Adds a probed item to the index and, if it is an image, to the
+ * wallpapers, and hands the wallpaper to options->found.
+ *
+ * Returns:
+ *   FALSE if memory ran out.
+ */
+static gboolean collect_item(DirectoryScan *scan, ScanItem *item) {
+    WallpaperArray *array = scan->array;
+
+    if (!item->regular) {
+        if (item->record) scan->changed = TRUE;
+        return TRUE;
+    }
 
-    src_dir_len = strlen(source_directory);
-    slash_needed = source_directory[src_dir_len - 1] != '/';
-    src_dir_len += slash_needed ? 1 : 0;
+    scan->scanned++;
+    if (item->record) scan->indexed++;
+    if (item->reused) {
+        scan->reused++;
+    } else {
+        scan->changed = TRUE;
+    }
+    if (item->unchecked) {
+        library_index_writer_mark_incomplete(scan->writer);
+        return TRUE;
+    }
 
-    while ((file = readdir(dir)) != NULL) {
-        gchar *filename = file->d_name;
+    library_index_writer_add(scan->writer, item->name, &item->file_stat,
+                             item->format, item->width, item->height);
+    if (item->format == IMAGE_FORMAT_NONE) return TRUE;
+    if (!append_wallpaper(array, item->path, item->width, item->height)) {
+        return FALSE;
+    }
+    /* the path belongs to the wallpaper now */
+    item->path = NULL;
+
+    if (scan->options->found) {
+        scan->options->found(&array->data[array->amount_used - 1],
+                             array->amount_used - 1,
+                             scan->options->user_data);
+    }
+    return TRUE;
+}
+
+/*
+ * Function: scan_items
+ * --------------------
+ * Probes the listed items on up to options->workers threads and collects
+ * them, then clears them for the next list.
+ *
+ * Notes:
+ *   The calling thread collects items in the order they were listed, so
+ * the result does not depend on which worker finished first, but it does
+ * so as soon as the next item is probed rather than after all of them.
+ * While that item is not probed yet it probes the next unclaimed one
+ * itself, and it only waits once every item is claimed.
+ *
+ * Returns:
+ *   FALSE if memory ran out.
+ */
+static gboolean scan_items(DirectoryScan *scan) {
+    GThreadPool *pool = NULL;
+    ImageCheck check = {0};
+    ScanItem *item;
+    guint i, workers;
+    gboolean collected = TRUE;
+
+    workers = scan->options->workers ? scan->options->workers
+                                     : g_get_num_processors();
+    workers = MIN(workers, scan->items->len / FILES_PER_SCAN_WORKER);
+    if (workers > 1) {
+        pool = g_thread_pool_new(scan_worker, scan, (gint)workers - 1, TRUE,
+                                 NULL);
+    }
+    if (!pool) workers = 1;
+    scan->workers = MAX(scan->workers, workers);
+
+    /* the pool only runs tasks with data, the index is never read */
+    for (i = 1; i < workers; i++) {
+        g_thread_pool_push(pool, GUINT_TO_POINTER(i), NULL);
+    }
+
+    for (i = 0; collected && i < scan->items->len;) {
+        item = &g_array_index(scan->items, ScanItem, i);
+        if (g_atomic_int_get(&item->probed)) {
+            collected = collect_item(scan, item);
+            i++;
+        } else if (!probe_next_item(scan, &check)) {
+            wait_for_item(scan, i);
+        }
+    }
+    /* the workers finish the items left if memory ran out */
+    if (pool) g_thread_pool_free(pool, FALSE, TRUE);
+    finish_check(scan, &check);
+
+    for (i = 0; i < scan->items->len; i++) {
+        g_free(g_array_index(scan->items, ScanItem, i).path);
+    }
+    g_array_set_size(scan->items, 0);
+    scan->next_item = 0;
+    return collected;
+}
+
+/*
+ * Function: walk_directory
+ * ------------------------
+ * Scans the files of the directory fd refers to and, if the scan is
+ * recursive, its subdirectories after them. fd is closed.
+ *
+ * Notes:
+ *   Entries are opened relative to fd and their type is taken from the
+ * directory entry, so only what may be a file is stat'ed. Hidden
+ * subdirectories and links to directories are not followed. Each
+ * directory is scanned before the next one is read, so wallpapers are
+ * found while the walk goes on.
+ *
+ * Returns:
+ *   FALSE if memory ran out.
+ */
+static gboolean walk_directory(DirectoryScan *scan, int fd) {
+    DIR *dir;
+    struct dirent *file;
+    struct stat entry_stat;
+    GPtrArray *subdirectories;
+    gsize prefix_length = scan->relative_path->len;
+    const gchar *name, *subdirectory;
+    gboolean is_directory, scanned;
+    guint i;
+    int subdirectory_fd;
+
+    dir = fdopendir(fd);
+    if (!dir) {
+        g_warning("failed to read dir %s in %s", scan->relative_path->str,
+                  scan->source_directory);
+        close(fd);
+        return TRUE;
+    }
+    scan->directories++;
+    subdirectories = g_ptr_array_new();
 
-        if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0) {
+    while ((file = readdir(dir)) != NULL) {
+        if (strcmp(file->d_name, ".") == 0 || strcmp(file->d_name, "..") == 0) {
             continue;
         }
 
-        if (amount_used >= amount_allocated) {
-            amount_allocated += 8;
-            wallpaper_array = realloc(array_wrapper->data,
-                                      amount_allocated * sizeof(Wallpaper));
-            if (!wallpaper_array) {
-                free(array_wrapper->data);
-                free(array_wrapper);
-                closedir(dir);
-                return NULL;
+        is_directory = file->d_type == DT_DIR;
+        /* not every file system fills in the type */
+        if (file->d_type == DT_UNKNOWN) {
+            is_directory = fstatat(fd, file->d_name, &entry_stat,
+                                   AT_SYMLINK_NOFOLLOW) == 0 &&
+                           S_ISDIR(entry_stat.st_mode);
+        }
+        if (is_directory) {
+            if (scan->options->recursive && file->d_name[0] != '.') {
+                g_ptr_array_add(subdirectories,
+                                g_string_chunk_insert(scan->names,
+                                                      file->d_name));
             }
-            array_wrapper->data = wallpaper_array;
+            continue;
+        }
+        if (file->d_type != DT_REG && file->d_type != DT_LNK &&
+            file->d_type != DT_UNKNOWN) {
+            continue;
         }
 
-        wallpaper = &wallpaper_array[amount_used];
+        g_string_append(scan->relative_path, file->d_name);
+        name = g_string_chunk_insert_len(scan->names, scan->relative_path->str,
+                                         (gssize)scan->relative_path->len);
+        g_string_truncate(scan->relative_path, prefix_length);
+        add_item(scan, fd, name, name + prefix_length,
+                 g_hash_table_lookup(scan->records, name));
+    }
 
-        path_size = src_dir_len + strlen(filename) + 1;
-        wallpaper->path = malloc(path_size);
-        if (!wallpaper->path) {
-            free(array_wrapper->data);
-            free(array_wrapper);
-            closedir(dir);
-            return NULL;
+    scanned = scan_items(scan);
+
+    for (i = 0; scanned && i < subdirectories->len; i++) {
+        subdirectory = g_ptr_array_index(subdirectories, i);
+        subdirectory_fd =
+            openat(fd, subdirectory,
+                   O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (subdirectory_fd == -1) {
+            g_warning("failed to open dir %s%s in %s",
+                      scan->relative_path->str, subdirectory,
+                      scan->source_directory);
+            continue;
         }
+        g_string_append_printf(scan->relative_path, "%s/", subdirectory);
+        scanned = walk_directory(scan, subdirectory_fd);
+        g_string_truncate(scan->relative_path, prefix_length);
+    }
 
-        snprintf(wallpaper->path, path_size, "%s%s%s", source_directory,
-                 slash_needed ? "/" : "", filename);
+    g_ptr_array_free(subdirectories, TRUE);
+    closedir(dir);
+    return scanned;
+}
 
-        wallpaper->flow_child = NULL;
+/*
+ * Function: list_wallpapers
+ * -------------------------
+ * Lists the images in the source directory with their sizes.
+ *
+ * Parameters:
+ *   - source_directory: The directory to list.
+ *   - options: How to scan it, see ScanOptions.
+ *
+ * Notes:
+ *   What is known about every file is kept in a library index in
+ * ~/.cache/wpc/library. If no file was added or removed since it was
+ * written, the directory is not read at all and only the indexed files
+ * are stat'ed. Files are only checked and probed again when their size,
+ * inode or modification time changed. A recursive scan always walks the
+ * directories, since a change within a subdirectory is not visible from
+ * the source directory.
+ */
+extern WallpaperArray *list_wallpapers(gchar *source_directory,
+                                       const ScanOptions *options) {
+    WallpaperArray *array_wrapper;
+    DirectoryScan scan = {0};
+    LibraryIndex index = {0};
+    struct stat dir_stat;
+    gboolean loaded, current, scanned;
+    gsize src_dir_len;
+    guint i;
+    int dir_fd;
+    const gchar *name;
+    gint64 start = g_get_monotonic_time(), elapsed;
+
+    dir_fd = open(source_directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1 || fstat(dir_fd, &dir_stat) == -1) {
+        g_warning("dir %s does not exist", source_directory);
+        if (dir_fd != -1) close(dir_fd);
+        return NULL;
+    }
 
-        if (!check_image(wallpaper->path) || !set_width_and_height(wallpaper)) {
-            free(wallpaper->path);
-            continue;
-        }
+    array_wrapper = malloc(sizeof(WallpaperArray));
+    if (!array_wrapper) {
+        close(dir_fd);
+        return NULL;
+    }
 
-        amount_used++;
+    array_wrapper->data = malloc(8 * sizeof(Wallpaper));
+    if (!array_wrapper->data) {
+        free(array_wrapper);
+        close(dir_fd);
+        return NULL;
     }
+    array_wrapper->amount_used = 0;
+    array_wrapper->amount_allocated = 8;
 
-    closedir(dir);
+    src_dir_len = strlen(source_directory);
+    scan.array = array_wrapper;
+    scan.source_directory = source_directory;
+    scan.options = options;
+    scan.slash_needed = source_directory[src_dir_len - 1] != '/';
+    scan.items = g_array_new(FALSE, TRUE, sizeof(ScanItem));
+    scan.names = g_string_chunk_new(4096);
+    scan.relative_path = g_string_new(NULL);
+    scan.writer = library_index_writer_new(source_directory,
+                                           options->recursive, &dir_stat);
+    scan.awaited = -1;
+    g_mutex_init(&scan.probed_lock);
+    g_cond_init(&scan.probed_cond);
+
+    loaded = library_index_load(source_directory, options->recursive, &index);
+    current = loaded && !options->recursive &&
+              library_index_is_current(&index, &dir_stat);
+    /* a recursive index is only written again if one of its files changed */
+    scan.changed = !current && !options->recursive;
+    if (current) {
+        for (i = 0; i < index.count; i++) {
+            name = library_record_name(&index, &index.records[i]);
+            add_item(&scan, dir_fd, name, name, &index.records[i]);
+        }
+        scan.directories = 1;
+        scanned = scan_items(&scan);
+        close(dir_fd);
+    } else {
+        scan.records = g_hash_table_new(g_str_hash, g_str_equal);
+        for (i = 0; i < index.count; i++) {
+            g_hash_table_insert(
+                scan.records,
+                (gpointer)library_record_name(&index, &index.records[i]),
+                (gpointer)&index.records[i]);
+        }
+        scanned = walk_directory(&scan, dir_fd);
+        g_hash_table_destroy(scan.records);
+    }
+    /* some indexed file was removed */
+    if (scan.indexed != index.count) scan.changed = TRUE;
+
+    if (scanned && scan.changed) {
+        library_index_writer_commit(scan.writer);
+    } else {
+        library_index_writer_free(scan.writer);
+    }
+    g_array_free(scan.items, TRUE);
+    g_mutex_clear(&scan.probed_lock);
+    g_cond_clear(&scan.probed_cond);
+    g_string_chunk_free(scan.names);
+    g_string_free(scan.relative_path, TRUE);
+    library_index_release(&index);
+
+    if (!scanned) {
+        free_wallpapers(array_wrapper);
+        return NULL;
+    }
 
-    array_wrapper->amount_allocated = amount_allocated;
-    array_wrapper->amount_used = amount_used;
+    elapsed = g_get_monotonic_time() - start;
+    g_info("scanned %u files in %u directories of %s on %u workers in %.2f "
+           "ms, %.2f ms per 1k files, %u from the library index, %d "
+           "recognized by signature, %d by libmagic out of %d lookups",
+           scan.scanned, scan.directories, source_directory, scan.workers,
+           (double)elapsed / 1000.0,
+           scan.scanned ? (double)elapsed / scan.scanned : 0.0, scan.reused,
+           scan.sniffed, scan.magic_recognized, scan.looked_up);
 
     return array_wrapper;
 }
@@ -0,0 +1,377 @@
+// Copyright 2025 webdevred
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "wpc/common.h"
+#include "wpc/frame_cache.h"
+
+#define FRAME_CACHE_DIR "wpc/frames"
+#define FRAME_CACHE_SUFFIX ".frame"
+#define FRAME_CACHE_TMP_SUFFIX ".tmp"
+/* a temporary frame this old was left behind by a writer that crashed */
+#define FRAME_CACHE_STALE_TMP_SECONDS 600
+#define FRAME_CACHE_MAGIC "WPCFRAME"
+#define FRAME_CACHE_VERSION 2
+#define FRAME_CACHE_ALIGNMENT 64
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 x, y;
+    guint32 width, height;
+    guint32 key_length;
+    guint64 pixels_offset;
+} FrameCacheHeader;
+
+typedef struct {
+    gchar *path;
+    off_t size;
+    struct timespec mtime;
+} FrameCacheEntry;
+
+static gchar *get_frame_cache_dir(void) {
+    return g_strdup_printf("%s/%s", g_get_user_cache_dir(), FRAME_CACHE_DIR);
+}
+
+static gchar *get_frame_path(const gchar *key) {
+    gchar *cache_dir, *digest, *path;
+    cache_dir = get_frame_cache_dir();
+    digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    path = g_strdup_printf("%s/%s%s", cache_dir, digest, FRAME_CACHE_SUFFIX);
+    g_free(digest);
+    g_free(cache_dir);
+    return path;
+}
+
+static guint64 frame_pixels_offset(gsize key_length) {
+    guint64 offset = sizeof(FrameCacheHeader) + key_length;
+    return (offset + FRAME_CACHE_ALIGNMENT - 1) &
+           ~(guint64)(FRAME_CACHE_ALIGNMENT - 1);
+}
+
+static gsize frame_pixels_size(guint width, guint height) {
+    return (gsize)width * height * 4;
+}
+
+static gboolean frame_fits(guint x, guint y, guint width, guint height,
+                           Monitor *monitor) {
+    return width > 0 && height > 0 && width <= monitor->width &&
+           height <= monitor->height && x <= monitor->width - width &&
+           y <= monitor->height - height;
+}
+
+/*
+ * Function: frame_cache_key
+ * -------------------------
+ * Builds the key identifying a rendered frame. Besides the render settings
+ * the key contains the size and modification time of the source image, so
+ * an edited image never hits a stale frame.
+ *
+ * Returns:
+ *   A newly allocated key, or NULL if the image could not be stat'ed.
+ */
+extern gchar *frame_cache_key(const gchar *image_path, Monitor *monitor,
+                              BgMode bg_mode, const gchar *bg_fallback_color,
+                              Resampler resampler, Quality quality,
+                              const gchar *pixel_format) {
+    struct stat image_stat;
+    if (stat(image_path, &image_stat) == -1) return NULL;
+
+    return g_strdup_printf(
+        "%s\n%lld\n%lld.%09ld\n%ux%u\n%d\n%s\n%d\n%d\n%s", image_path,
+        (long long)image_stat.st_size, (long long)image_stat.st_mtim.tv_sec,
+        image_stat.st_mtim.tv_nsec, monitor->width, monitor->height, bg_mode,
+        bg_fallback_color ? bg_fallback_color : "", resampler, quality,
+        pixel_format);
+}
+
+/*
+ * Function: frame_cache_lookup
+ * ----------------------------
+ * Maps a cached frame into memory. On success frame->pixels points at
+ * width * height * 4 bytes ready to be handed to XCreateImage, to be put
+ * at frame->x, frame->y of the monitor, and the entry is marked as
+ * recently used.
+ *
+ * Returns:
+ *   TRUE on a cache hit, FALSE otherwise. frame_cache_release must be
+ *   called on every hit.
+ */
+extern gboolean frame_cache_lookup(const gchar *key, Monitor *monitor,
+                                   CachedFrame *frame) {
+    gchar *path;
+    int fd;
+    struct stat frame_stat;
+    FrameCacheHeader *header;
+    gsize key_length;
+    void *mapping;
+
+    path = get_frame_path(key);
+    fd = open(path, O_RDONLY);
+    g_free(path);
+    if (fd == -1) return FALSE;
+
+    if (fstat(fd, &frame_stat) == -1 ||
+        (gsize)frame_stat.st_size < sizeof(FrameCacheHeader)) {
+        close(fd);
+        return FALSE;
+    }
+
+    mapping = mmap(NULL, (gsize)frame_stat.st_size, PROT_READ, MAP_SHARED, fd,
+                   0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return FALSE;
+    }
+
+    header = (FrameCacheHeader *)mapping;
+    key_length = strlen(key);
+    if (memcmp(header->magic, FRAME_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != FRAME_CACHE_VERSION ||
+        !frame_fits(header->x, header->y, header->width, header->height,
+                    monitor) ||
+        header->key_length != key_length ||
+        header->pixels_offset != frame_pixels_offset(key_length) ||
+        (gsize)frame_stat.st_size !=
+            header->pixels_offset +
+                frame_pixels_size(header->width, header->height) ||
+        memcmp((gchar *)mapping + sizeof(FrameCacheHeader), key, key_length) !=
+            0) {
+        munmap(mapping, (gsize)frame_stat.st_size);
+        close(fd);
+        return FALSE;
+    }
+
+    /* bump the modification time, eviction drops the oldest frames first */
+    futimens(fd, NULL);
+    close(fd);
+
+    frame->x = header->x;
+    frame->y = header->y;
+    frame->width = header->width;
+    frame->height = header->height;
+    frame->mapping = mapping;
+    frame->mapping_size = (gsize)frame_stat.st_size;
+    frame->pixels = (guchar *)mapping + header->pixels_offset;
+    return TRUE;
+}
+
+extern void frame_cache_release(CachedFrame *frame) {
+    if (frame->mapping) munmap(frame->mapping, frame->mapping_size);
+    frame->mapping = NULL;
+    frame->pixels = NULL;
+}
+
+static gint compare_entries_by_mtime(const void *a, const void *b) {
+    const FrameCacheEntry *entry_a = a, *entry_b = b;
+    if (entry_a->mtime.tv_sec != entry_b->mtime.tv_sec)
+        return entry_a->mtime.tv_sec < entry_b->mtime.tv_sec ? -1 : 1;
+    if (entry_a->mtime.tv_nsec != entry_b->mtime.tv_nsec)
+        return entry_a->mtime.tv_nsec < entry_b->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Function: frame_cache_evict
+ * ---------------------------
+ * Removes the least recently used frames until the cache fits within
+ * budget bytes. Temporary files of writers that crashed before renaming
+ * them are removed too, younger ones may still be written and only count
+ * towards the budget.
+ */
+extern void frame_cache_evict(guint64 budget) {
+    gchar *cache_dir;
+    DIR *dir;
+    struct dirent *file;
+    struct stat frame_stat;
+    FrameCacheEntry *entries, *temp;
+    gsize amount_used, amount_allocated, i;
+    guint64 total_size;
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    gboolean tmp;
+
+    cache_dir = get_frame_cache_dir();
+    dir = opendir(cache_dir);
+    if (!dir) {
+        g_free(cache_dir);
+        return;
+    }
+
+    entries = NULL;
+    amount_used = 0;
+    amount_allocated = 0;
+    total_size = 0;
+
+    while ((file = readdir(dir)) != NULL) {
+        gchar *path;
+        tmp = g_str_has_suffix(file->d_name, FRAME_CACHE_TMP_SUFFIX);
+        if (!tmp && !g_str_has_suffix(file->d_name, FRAME_CACHE_SUFFIX)) {
+            continue;
+        }
+
+        path = g_strdup_printf("%s/%s", cache_dir, file->d_name);
+        if (stat(path, &frame_stat) == -1) {
+            g_free(path);
+            continue;
+        }
+        if (tmp) {
+            if (now - frame_stat.st_mtim.tv_sec >=
+                    FRAME_CACHE_STALE_TMP_SECONDS &&
+                unlink(path) == 0) {
+                g_info("removed stale temporary frame %s", path);
+            } else {
+                total_size += (guint64)frame_stat.st_size;
+            }
+            g_free(path);
+            continue;
+        }
+
+        if (amount_used >= amount_allocated) {
+            amount_allocated += 16;
+            temp = realloc(entries, amount_allocated * sizeof(FrameCacheEntry));
+            if (!temp) {
+                g_free(path);
+                break;
+            }
+            entries = temp;
+        }
+
+        entries[amount_used++] = (FrameCacheEntry){
+            .path = path,
+            .size = frame_stat.st_size,
+            .mtime = frame_stat.st_mtim,
+        };
+        total_size += (guint64)frame_stat.st_size;
+    }
+    closedir(dir);
+
+    if (total_size > budget) {
+        qsort(entries, amount_used, sizeof(FrameCacheEntry),
+              compare_entries_by_mtime);
+        for (i = 0; i < amount_used && total_size > budget; i++) {
+            if (unlink(entries[i].path) == 0) {
+                total_size -= (guint64)entries[i].size;
+                g_info("evicted cached frame %s", entries[i].path);
+            }
+        }
+    }
+
+    for (i = 0; i < amount_used; i++) {
+        g_free(entries[i].path);
+    }
+    free(entries);
+    g_free(cache_dir);
+}
+
+static gboolean write_all(int fd, const void *data, gsize size) {
+    const guchar *bytes = data;
+    ssize_t written;
+    while (size > 0) {
+        written = write(fd, bytes, size);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        bytes += written;
+        size -= (gsize)written;
+    }
+    return TRUE;
+}
+
+/*
+ * Function: frame_cache_store
+ * ---------------------------
+ * Writes a rendered frame to the cache. The frame is written to a
+ * temporary file first so readers never map a partial frame. The cache
+ * may exceed the budget until frame_cache_evict is called.
+ *
+ * Parameters:
+ *   - key: Key created by frame_cache_key.
+ *   - monitor: Monitor the frame was rendered for.
+ *   - frame: The area of the monitor that was rendered and its pixels,
+ * 4 bytes each.
+ *   - stride: Bytes per line of frame->pixels.
+ *   - budget: Maximum size of the cache in bytes, 0 disables the cache.
+ *
+ * Returns:
+ *   TRUE if the frame was stored.
+ */
+extern gboolean frame_cache_store(const gchar *key, Monitor *monitor,
+                                  const CachedFrame *frame, gsize stride,
+                                  guint64 budget) {
+    FrameCacheHeader header;
+    gchar *path, *tmp_path;
+    gsize key_length, padding, pixels_size, row_size;
+    guint y;
+    static const gchar zeros[FRAME_CACHE_ALIGNMENT] = {0};
+    int fd;
+    gboolean written = FALSE;
+    static gint tmp_serial = 0;
+
+    if (!frame_fits(frame->x, frame->y, frame->width, frame->height,
+                    monitor)) {
+        return FALSE;
+    }
+    pixels_size = frame_pixels_size(frame->width, frame->height);
+    row_size = (gsize)frame->width * 4;
+    key_length = strlen(key);
+    if (budget == 0 ||
+        frame_pixels_offset(key_length) + pixels_size > budget) {
+        return FALSE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_CACHE_MAGIC, sizeof(header.magic));
+    header.version = FRAME_CACHE_VERSION;
+    header.x = frame->x;
+    header.y = frame->y;
+    header.width = frame->width;
+    header.height = frame->height;
+    header.key_length = (guint32)key_length;
+    header.pixels_offset = frame_pixels_offset(key_length);
+    padding = header.pixels_offset - sizeof(header) - key_length;
+
+    /* frames may be stored from several render workers at once */
+    path = get_frame_path(key);
+    tmp_path = g_strdup_printf("%s.%d.%d" FRAME_CACHE_TMP_SUFFIX, path,
+                               getpid(), g_atomic_int_add(&tmp_serial, 1));
+    create_parent_dirs(path, 0700);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        g_warning("failed to create cached frame %s: %s", tmp_path,
+                  strerror(errno));
+        goto cleanup;
+    }
+
+    written = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, key, key_length) && write_all(fd, zeros, padding);
+    for (y = 0; written && y < frame->height; y++) {
+        written = write_all(fd, frame->pixels + y * stride, row_size);
+    }
+    close(fd);
+
+    if (!written || rename(tmp_path, path) == -1) {
+        g_warning("failed to write cached frame %s: %s", path,
+                  strerror(errno));
+        unlink(tmp_path);
+        written = FALSE;
+    }
+
+cleanup:
+    g_free(tmp_path);
+    g_free(path);
+    return written;
+}
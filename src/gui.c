@@ -115,7 +115,7 @@ static void image_selected(GtkFlowBox *flowbox, gpointer user_data) {
             }
             dump_config(config);
             monitors = g_object_get_data(G_OBJECT(app), "monitors");
-            set_wallpapers(config, NULL, monitors);
+            set_wallpaper_for_monitor(config, monitors, monitor);
 #ifdef WPC_ENABLE_HELPER
         }
     }
@@ -138,56 +138,154 @@ static gint sort_flow_images(GtkFlowBoxChild *child1, GtkFlowBoxChild *child2,
     return g_strcmp0(image_path1, image_path2);
 }
 
-static void show_images_src_dir(GtkApplication *app) {
-    gushort i;
-    WallpaperArray *old_wp_arr_wrapper, *wp_arr_wrapper;
-    WallpaperArray *mon_wrap;
-    Wallpaper *wallpapers;
-    Monitor *monitors;
-    gushort monitor_id;
-    GtkAdjustment *adjustment;
-    Config *config = g_object_get_data(G_OBJECT(app), "configuration");
-    char *source_directory = config->source_directory;
-    GtkWidget *flowbox = g_object_get_data(G_OBJECT(app), "flowbox");
-    if (!flowbox || !config->valid_source_directory) return;
+/* selects the wallpaper of the selected monitor, if it is shown */
+static void select_monitor_wallpaper(GtkApplication *app, GtkWidget *flowbox) {
+    Monitor *monitor = g_object_get_data(G_OBJECT(app), "selected_monitor");
+    GtkButton *button_menu_choice =
+        g_object_get_data(G_OBJECT(app), "menu_choice");
+    AppTab *menu_choice =
+        g_object_get_data(G_OBJECT(button_menu_choice), "name");
 
-    old_wp_arr_wrapper = g_object_get_data(G_OBJECT(app), "wallpapers");
-    if (old_wp_arr_wrapper) {
-        free_wallpapers(old_wp_arr_wrapper);
-        g_object_set_data(G_OBJECT(app), "wallpapers", NULL);
+    widget_block_handler(flowbox);
+
+    if (*menu_choice == WM_BACKGROUND && monitor && monitor->wallpaper &&
+        monitor->wallpaper->flow_child) {
+        GtkFlowBoxChild *flow_child =
+            GTK_FLOW_BOX_CHILD(monitor->wallpaper->flow_child);
+        gtk_flow_box_select_child(GTK_FLOW_BOX(flowbox), flow_child);
+    } else {
+        gtk_flow_box_unselect_all(GTK_FLOW_BOX(flowbox));
     }
 
-    adjustment = gtk_adjustment_new(0, 0, 100, 1, 10, 0);
-    gtk_flow_box_set_vadjustment(GTK_FLOW_BOX(flowbox), adjustment);
-    gtk_flow_box_set_min_children_per_line(GTK_FLOW_BOX(flowbox), 3);
+    widget_unblock_handler(flowbox);
+}
 
-    widget_block_handler(flowbox);
+/*
+ * A scan of the source directory running on a worker thread. The flowbox
+ * is only touched on the main thread, and not at all once the scan is
+ * cancelled by a newer one or by closing the window.
+ */
+typedef struct {
+    GtkWidget *flowbox;
+    gchar *source_directory;
+    ScanOptions options;
+    /* children appended so far, only used on the main thread */
+    guint shown;
+} GuiScan;
+
+typedef struct {
+    GTask *task;
+    gchar *path;
+    guint index;
+} FoundWallpaper;
+
+static void free_gui_scan(gpointer data) {
+    GuiScan *scan = data;
+    g_free(scan->source_directory);
+    g_free(scan);
+}
 
-    gtk_flow_box_remove_all(GTK_FLOW_BOX(flowbox));
+static void free_found_wallpaper(gpointer data) {
+    FoundWallpaper *found = data;
+    g_object_unref(found->task);
+    g_free(found->path);
+    g_free(found);
+}
+
+static void append_wallpaper_child(GtkWidget *flowbox, const gchar *path) {
+    GtkWidget *flow_child = gtk_flow_box_child_new();
+    GtkWidget *image = gtk_picture_new_for_filename(path);
+    gtk_flow_box_child_set_child(GTK_FLOW_BOX_CHILD(flow_child), image);
+    gtk_flow_box_append(GTK_FLOW_BOX(flowbox), flow_child);
+    gtk_widget_set_visible(image, TRUE);
+}
+
+/* shows a wallpaper the scan found, runs on the main thread */
+static gboolean show_found_wallpaper(gpointer data) {
+    FoundWallpaper *found = data;
+    GuiScan *scan = g_task_get_task_data(found->task);
+
+    /* children are appended in the order they were found, the scan may
+       also have finished and shown the rest already */
+    if (!g_cancellable_is_cancelled(g_task_get_cancellable(found->task)) &&
+        found->index == scan->shown) {
+        append_wallpaper_child(scan->flowbox, found->path);
+        scan->shown++;
+    }
+    return G_SOURCE_REMOVE;
+}
 
-    wp_arr_wrapper = list_wallpapers(source_directory);
-    if (!wp_arr_wrapper) return;
+/* hands a wallpaper from the scanning thread to the main thread */
+static void forward_found_wallpaper(const Wallpaper *wallpaper, guint index,
+                                    gpointer user_data) {
+    FoundWallpaper *found = g_new(FoundWallpaper, 1);
+    found->task = g_object_ref(user_data);
+    found->path = g_strdup(wallpaper->path);
+    found->index = index;
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, show_found_wallpaper,
+                               found, free_found_wallpaper);
+}
+
+static void scan_source_dir(GTask *task, gpointer source_object,
+                            gpointer task_data, GCancellable *cancellable) {
+    GuiScan *scan = task_data;
+    (void)source_object, (void)cancellable;
+    g_task_return_pointer(
+        task, list_wallpapers(scan->source_directory, &scan->options),
+        (GDestroyNotify)free_wallpapers);
+}
+
+/*
+ * Function: source_dir_scanned
+ * ----------------------------
+ * Finishes a scan of the source directory on the main thread. Wallpapers
+ * whose child has not been appended yet are appended now, then every child
+ * is linked to its wallpaper and the monitors to the wallpapers they show.
+ */
+static void source_dir_scanned(GObject *source_object, GAsyncResult *result,
+                               gpointer user_data) {
+    guint i;
+    GTask *task = G_TASK(result);
+    GuiScan *scan = g_task_get_task_data(task);
+    GtkApplication *app = GTK_APPLICATION(source_object);
+    WallpaperArray *wp_arr_wrapper, *mon_wrap;
+    Wallpaper *wallpapers;
+    Monitor *monitors;
+    gushort monitor_id;
+    Config *config;
+    GtkWidget *flowbox = scan->flowbox;
+    (void)user_data;
+
+    wp_arr_wrapper = g_task_propagate_pointer(task, NULL);
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+        if (wp_arr_wrapper) free_wallpapers(wp_arr_wrapper);
+        return;
+    }
+    /* only a running scan is cancelled */
+    g_object_set_data(G_OBJECT(app), "scan_cancellable", NULL);
+    if (!wp_arr_wrapper) {
+        gtk_flow_box_remove_all(GTK_FLOW_BOX(flowbox));
+        widget_unblock_handler(flowbox);
+        return;
+    }
     wallpapers = (Wallpaper *)wp_arr_wrapper->data;
+    config = g_object_get_data(G_OBJECT(app), "configuration");
+
+    for (; scan->shown < wp_arr_wrapper->amount_used; scan->shown++) {
+        append_wallpaper_child(flowbox, wallpapers[scan->shown].path);
+    }
 
     mon_wrap = g_object_get_data(G_OBJECT(app), "monitors");
     monitors = (Monitor *)mon_wrap->data;
 
-    for (monitor_id = 0; monitor_id < mon_wrap->amount_used; monitor_id++) {
-        Monitor *monitor = &monitors[monitor_id];
-        monitor->wallpaper = NULL;
-    }
-
-    if (wallpapers) {
-        gtk_flow_box_set_sort_func(GTK_FLOW_BOX(flowbox), NULL, NULL, NULL);
+    if (wp_arr_wrapper->amount_used > 0) {
         for (i = 0; i < wp_arr_wrapper->amount_used; i++) {
-            GtkWidget *flow_child = gtk_flow_box_child_new();
-            GtkWidget *image = gtk_picture_new_for_filename(wallpapers[i].path);
-            gtk_flow_box_child_set_child(GTK_FLOW_BOX_CHILD(flow_child), image);
-            gtk_flow_box_append(GTK_FLOW_BOX(flowbox), flow_child);
-            gtk_widget_set_visible(image, TRUE);
+            GtkFlowBoxChild *flow_child =
+                gtk_flow_box_get_child_at_index(GTK_FLOW_BOX(flowbox), (int)i);
+            GtkWidget *image = gtk_flow_box_child_get_child(flow_child);
             g_object_set_data(G_OBJECT(image), "wallpaper",
                               (gpointer)&wallpapers[i]);
-            wallpapers[i].flow_child = GTK_FLOW_BOX_CHILD(flow_child);
+            wallpapers[i].flow_child = flow_child;
 
             for (monitor_id = 0; monitor_id < mon_wrap->amount_used;
                  monitor_id++) {
@@ -204,14 +302,85 @@ static void show_images_src_dir(GtkApplication *app) {
 
         gtk_flow_box_set_sort_func(GTK_FLOW_BOX(flowbox), sort_flow_images,
                                    NULL, NULL);
-
-        g_object_set_data(G_OBJECT(app), "wallpapers",
-                          (gpointer)wp_arr_wrapper);
     } else {
-        g_print("No images found in %s\n", source_directory);
+        g_print("No images found in %s\n", scan->source_directory);
     }
+    g_object_set_data(G_OBJECT(app), "wallpapers", (gpointer)wp_arr_wrapper);
 
     widget_unblock_handler(flowbox);
+    select_monitor_wallpaper(app, flowbox);
+}
+
+/*
+ * Function: show_images_src_dir
+ * -----------------------------
+ * Lists the source directory on a worker thread so the window stays
+ * responsive, wallpapers are shown as they are found. A scan still running
+ * from an earlier call is cancelled, its results are dropped.
+ */
+static void show_images_src_dir(GtkApplication *app) {
+    GuiScan *scan;
+    GTask *task;
+    GCancellable *cancellable;
+    WallpaperArray *old_wp_arr_wrapper;
+    WallpaperArray *mon_wrap;
+    Monitor *monitors;
+    gushort monitor_id;
+    GtkAdjustment *adjustment;
+    Config *config = g_object_get_data(G_OBJECT(app), "configuration");
+    GtkWidget *flowbox = g_object_get_data(G_OBJECT(app), "flowbox");
+    if (!flowbox || !config->valid_source_directory) return;
+
+    /* the scan still running blocked the handler, it never unblocks it */
+    cancellable = g_object_get_data(G_OBJECT(app), "scan_cancellable");
+    if (cancellable) {
+        g_cancellable_cancel(cancellable);
+        widget_unblock_handler(flowbox);
+    }
+
+    /* the monitors must not point into the old wallpapers while scanning */
+    mon_wrap = g_object_get_data(G_OBJECT(app), "monitors");
+    monitors = (Monitor *)mon_wrap->data;
+    for (monitor_id = 0; monitor_id < mon_wrap->amount_used; monitor_id++) {
+        Monitor *monitor = &monitors[monitor_id];
+        monitor->wallpaper = NULL;
+    }
+
+    old_wp_arr_wrapper = g_object_get_data(G_OBJECT(app), "wallpapers");
+    if (old_wp_arr_wrapper) {
+        free_wallpapers(old_wp_arr_wrapper);
+        g_object_set_data(G_OBJECT(app), "wallpapers", NULL);
+    }
+
+    adjustment = gtk_adjustment_new(0, 0, 100, 1, 10, 0);
+    gtk_flow_box_set_vadjustment(GTK_FLOW_BOX(flowbox), adjustment);
+    gtk_flow_box_set_min_children_per_line(GTK_FLOW_BOX(flowbox), 3);
+
+    widget_block_handler(flowbox);
+
+    gtk_flow_box_remove_all(GTK_FLOW_BOX(flowbox));
+
+    /* children are appended in the order they are found */
+    gtk_flow_box_set_sort_func(GTK_FLOW_BOX(flowbox), NULL, NULL, NULL);
+
+    cancellable = g_cancellable_new();
+    g_object_set_data_full(G_OBJECT(app), "scan_cancellable", cancellable,
+                           g_object_unref);
+
+    scan = g_new0(GuiScan, 1);
+    scan->flowbox = flowbox;
+    scan->source_directory = g_strdup(config->source_directory);
+    scan->options.workers = config->scan_workers;
+    scan->options.recursive = config->recursive_scan;
+    scan->options.found = forward_found_wallpaper;
+
+    task = g_task_new(app, cancellable, source_dir_scanned, NULL);
+    /* a cancelled scan still returns its wallpapers, they must be freed */
+    g_task_set_check_cancellable(task, FALSE);
+    g_task_set_task_data(task, scan, free_gui_scan);
+    scan->options.user_data = task;
+    g_task_run_in_thread(task, scan_source_dir);
+    g_object_unref(task);
 }
 
 static void on_option_selected(GtkDropDown *dropdown, GParamSpec *spec,
@@ -253,7 +422,7 @@ static void on_option_selected(GtkDropDown *dropdown, GParamSpec *spec,
 
         dump_config(config);
         monitors = g_object_get_data(G_OBJECT(app), "monitors");
-        set_wallpapers(config, NULL, monitors);
+        set_wallpaper_for_monitor(config, monitors, monitor);
     }
 }
 
@@ -328,18 +497,7 @@ static void show_images(GtkButton *button, GtkApplication *app) {
     show_images_src_dir(app);
 
 update_selection:
-    widget_block_handler(flowbox);
-
-    if (*menu_choice == WM_BACKGROUND && monitor->wallpaper &&
-        monitor->wallpaper->flow_child) {
-        GtkFlowBoxChild *flow_child =
-            GTK_FLOW_BOX_CHILD(monitor->wallpaper->flow_child);
-        gtk_flow_box_select_child(GTK_FLOW_BOX(flowbox), flow_child);
-    } else {
-        gtk_flow_box_unselect_all(GTK_FLOW_BOX(flowbox));
-    }
-
-    widget_unblock_handler(flowbox);
+    select_monitor_wallpaper(app, flowbox);
 }
 
 static void show_monitors(GtkApplication *app) {
@@ -473,9 +631,14 @@ static gboolean on_window_close(GtkWindow *window, gpointer user_data) {
     WallpaperArray *wp_arr_wrapper;
     GtkWidget *flowbox, *bg_mode_dropdown;
     gulong *flowbox_handler, *bg_mode_handler;
+    GCancellable *scan_cancellable;
     (void)window;
     app = GTK_APPLICATION(user_data);
 
+    /* a running scan must not touch what is freed here once it finishes */
+    scan_cancellable = g_object_get_data(G_OBJECT(app), "scan_cancellable");
+    if (scan_cancellable) g_cancellable_cancel(scan_cancellable);
+
     config = g_object_get_data(G_OBJECT(app), "configuration");
     if (config) {
         free_config(config);
@@ -0,0 +1,286 @@
+// Copyright 2025 webdevred
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "wpc/common.h"
+#include "wpc/library_index.h"
+
+#define LIBRARY_INDEX_DIR "wpc/library"
+#define LIBRARY_INDEX_SUFFIX ".index"
+#define LIBRARY_TREE_INDEX_SUFFIX ".tree.index"
+#define LIBRARY_INDEX_MAGIC "WPCLIBIX"
+#define LIBRARY_INDEX_VERSION 1
+
+/*
+ * The file is this header, count records and the string table. The
+ * string table starts with the directory, followed by the NUL terminated
+ * file names the records point at.
+ */
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 count;
+    gint64 dir_mtime_sec;
+    guint32 dir_mtime_nsec;
+    guint32 dir_length;
+    guint64 strings_offset;
+    guint64 strings_size;
+} LibraryIndexHeader;
+
+struct LibraryIndexWriter {
+    gchar *directory;
+    gboolean recursive;
+    LibraryIndexHeader header;
+    GArray *records;
+    GString *strings;
+};
+
+/* a recursive index also lists the subdirectories, so it is kept apart */
+static gchar *get_index_path(const gchar *directory, gboolean recursive) {
+    gchar *digest, *path;
+    digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, directory, -1);
+    path = g_strdup_printf(
+        "%s/%s/%s%s", g_get_user_cache_dir(), LIBRARY_INDEX_DIR, digest,
+        recursive ? LIBRARY_TREE_INDEX_SUFFIX : LIBRARY_INDEX_SUFFIX);
+    g_free(digest);
+    return path;
+}
+
+static gboolean valid_index(const LibraryIndexHeader *header, gsize size,
+                            const gchar *directory) {
+    const gchar *strings;
+    const LibraryRecord *records;
+    gsize dir_length = strlen(directory);
+    guint i;
+
+    if (memcmp(header->magic, LIBRARY_INDEX_MAGIC, sizeof(header->magic)) !=
+            0 ||
+        header->version != LIBRARY_INDEX_VERSION ||
+        header->strings_offset != sizeof(LibraryIndexHeader) +
+                                      (guint64)header->count *
+                                          sizeof(LibraryRecord) ||
+        header->strings_offset + header->strings_size != size ||
+        header->dir_length != dir_length ||
+        header->strings_size <= dir_length) {
+        return FALSE;
+    }
+
+    strings = (const gchar *)header + header->strings_offset;
+    if (memcmp(strings, directory, dir_length) != 0 ||
+        strings[header->strings_size - 1] != '\0') {
+        return FALSE;
+    }
+
+    /* every name has to end within the string table */
+    records = (const LibraryRecord *)(header + 1);
+    for (i = 0; i < header->count; i++) {
+        if ((guint64)records[i].name_offset + records[i].name_length >=
+            header->strings_size) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Function: library_index_load
+ * ----------------------------
+ * Maps the index of directory into memory with a single mmap, nothing is
+ * copied or parsed besides a bounds check of the records. A recursive
+ * index names the files by their path relative to directory.
+ *
+ * Returns:
+ *   TRUE if a valid index was found. library_index_release must be called
+ *   on it.
+ */
+extern gboolean library_index_load(const gchar *directory,
+                                   gboolean recursive, LibraryIndex *index) {
+    gchar *path;
+    int fd;
+    struct stat index_stat;
+    LibraryIndexHeader *header;
+    void *mapping;
+
+    path = get_index_path(directory, recursive);
+    fd = open(path, O_RDONLY);
+    g_free(path);
+    if (fd == -1) return FALSE;
+
+    if (fstat(fd, &index_stat) == -1 ||
+        (gsize)index_stat.st_size < sizeof(LibraryIndexHeader)) {
+        close(fd);
+        return FALSE;
+    }
+
+    mapping =
+        mmap(NULL, (gsize)index_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return FALSE;
+
+    header = mapping;
+    if (!valid_index(header, (gsize)index_stat.st_size, directory)) {
+        munmap(mapping, (gsize)index_stat.st_size);
+        return FALSE;
+    }
+
+    index->records = (const LibraryRecord *)(header + 1);
+    index->strings = (const gchar *)mapping + header->strings_offset;
+    index->count = header->count;
+    index->dir_mtime_sec = header->dir_mtime_sec;
+    index->dir_mtime_nsec = header->dir_mtime_nsec;
+    index->mapping = mapping;
+    index->mapping_size = (gsize)index_stat.st_size;
+    return TRUE;
+}
+
+extern void library_index_release(LibraryIndex *index) {
+    if (index->mapping) munmap(index->mapping, index->mapping_size);
+    index->mapping = NULL;
+    index->records = NULL;
+    index->count = 0;
+}
+
+/* no file was added, removed or renamed since the index was written */
+extern gboolean library_index_is_current(const LibraryIndex *index,
+                                         const struct stat *dir_stat) {
+    return index->dir_mtime_sec == (gint64)dir_stat->st_mtim.tv_sec &&
+           index->dir_mtime_nsec == (guint32)dir_stat->st_mtim.tv_nsec;
+}
+
+extern const gchar *library_record_name(const LibraryIndex *index,
+                                        const LibraryRecord *record) {
+    return index->strings + record->name_offset;
+}
+
+/* the file was not changed or replaced since it was checked */
+extern gboolean library_record_is_current(const LibraryRecord *record,
+                                          const struct stat *file_stat) {
+    return record->size == (guint64)file_stat->st_size &&
+           record->inode == (guint64)file_stat->st_ino &&
+           record->mtime_sec == (gint64)file_stat->st_mtim.tv_sec &&
+           record->mtime_nsec == (guint32)file_stat->st_mtim.tv_nsec;
+}
+
+/*
+ * Function: library_index_writer_new
+ * ----------------------------------
+ * Starts a new index of directory as it is described by dir_stat. Files
+ * are added with library_index_writer_add, in the order they are listed.
+ */
+extern LibraryIndexWriter *
+library_index_writer_new(const gchar *directory, gboolean recursive,
+                         const struct stat *dir_stat) {
+    LibraryIndexWriter *writer = g_new0(LibraryIndexWriter, 1);
+
+    writer->directory = g_strdup(directory);
+    writer->recursive = recursive;
+    memcpy(writer->header.magic, LIBRARY_INDEX_MAGIC,
+           sizeof(writer->header.magic));
+    writer->header.version = LIBRARY_INDEX_VERSION;
+    writer->header.dir_mtime_sec = (gint64)dir_stat->st_mtim.tv_sec;
+    writer->header.dir_mtime_nsec = (guint32)dir_stat->st_mtim.tv_nsec;
+    writer->header.dir_length = (guint32)strlen(directory);
+    writer->records = g_array_new(FALSE, TRUE, sizeof(LibraryRecord));
+    writer->strings = g_string_new(NULL);
+    g_string_append_len(writer->strings, directory,
+                        (gssize)writer->header.dir_length + 1);
+    return writer;
+}
+
+extern void library_index_writer_add(LibraryIndexWriter *writer,
+                                     const gchar *name,
+                                     const struct stat *file_stat,
+                                     ImageFormat format, guint width,
+                                     guint height) {
+    LibraryRecord record = {
+        .size = (guint64)file_stat->st_size,
+        .inode = (guint64)file_stat->st_ino,
+        .mtime_sec = (gint64)file_stat->st_mtim.tv_sec,
+        .mtime_nsec = (guint32)file_stat->st_mtim.tv_nsec,
+        .format = format,
+        .width = width,
+        .height = height,
+        .name_offset = (guint32)writer->strings->len,
+        .name_length = (guint32)strlen(name),
+    };
+
+    g_string_append_len(writer->strings, name,
+                        (gssize)record.name_length + 1);
+    g_array_append_val(writer->records, record);
+}
+
+/*
+ * Function: library_index_writer_mark_incomplete
+ * ----------------------------------------------
+ * Notes that a file of the directory was left out, so the index is never
+ * taken as current and the directory is read again on the next scan.
+ */
+extern void library_index_writer_mark_incomplete(LibraryIndexWriter *writer) {
+    /* tv_nsec is always below a second, this never matches a directory */
+    writer->header.dir_mtime_nsec = G_MAXUINT32;
+}
+
+/*
+ * Function: library_index_writer_commit
+ * -------------------------------------
+ * Writes the index and frees the writer. The index is written to a
+ * temporary file first so a reader never maps a partial index.
+ */
+extern void library_index_writer_commit(LibraryIndexWriter *writer) {
+    gchar *path, *tmp_path;
+    FILE *file;
+    gboolean written;
+
+    writer->header.count = writer->records->len;
+    writer->header.strings_offset =
+        sizeof(LibraryIndexHeader) +
+        (guint64)writer->records->len * sizeof(LibraryRecord);
+    writer->header.strings_size = writer->strings->len;
+
+    path = get_index_path(writer->directory, writer->recursive);
+    tmp_path = g_strdup_printf("%s.%d.tmp", path, getpid());
+    create_parent_dirs(path, 0700);
+
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        g_warning("failed to create library index %s", tmp_path);
+        goto cleanup;
+    }
+    written =
+        fwrite(&writer->header, sizeof(LibraryIndexHeader), 1, file) == 1 &&
+        fwrite(writer->records->data, sizeof(LibraryRecord),
+               writer->records->len, file) == writer->records->len &&
+        fwrite(writer->strings->str, 1, writer->strings->len, file) ==
+            writer->strings->len;
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(tmp_path, path) == -1) {
+        g_warning("failed to write library index %s", path);
+        unlink(tmp_path);
+        goto cleanup;
+    }
+    g_info("wrote library index of %s with %u files", writer->directory,
+           writer->header.count);
+
+cleanup:
+    g_free(tmp_path);
+    g_free(path);
+    library_index_writer_free(writer);
+}
+
+extern void library_index_writer_free(LibraryIndexWriter *writer) {
+    g_array_free(writer->records, TRUE);
+    g_string_free(writer->strings, TRUE);
+    g_free(writer->directory);
+    g_free(writer);
+}
@@ -54,16 +54,50 @@ static void format_dst_filename(gchar **dst_filename) {
     }
 }
 
+typedef struct {
+    Monitor *monitor;
+    BgMode bg_mode;
+} DecodeTarget;
+
+static void target_decode_size(guint full_width, guint full_height,
+                               guint *min_width, guint *min_height,
+                               gpointer data) {
+    DecodeTarget *target = data;
+    gulong width = 0, height = 0;
+
+    grow_decode_size(full_width, full_height, target->monitor,
+                     target->bg_mode, &width, &height);
+    *min_width = (guint)width;
+    *min_height = (guint)height;
+}
+
 static int scale_image(Wallpaper *src_image, char *dst_image_path,
                        Monitor monitor, BgMode bg_mode) {
     MagickWand *wand = NULL;
+    DecodedImage *image;
+    DecodeTarget target = {&monitor, bg_mode};
+    gulong width = 0, height = 0;
+
+    image = decode_image(src_image->path, target_decode_size, &target);
+    if (image) {
+        wand = new_wand_from_decoded_image(image);
+        decoded_image_unref(image);
+    }
 
-    wand = NewMagickWand();
-    MagickReadImage(wand, src_image->path);
+    if (!wand) {
+        wand = NewMagickWand();
+        if (MagickPingImage(wand, src_image->path) == MagickTrue) {
+            grow_decode_size(MagickGetImageWidth(wand),
+                             MagickGetImageHeight(wand), &monitor, bg_mode,
+                             &width, &height);
+        }
+        read_wallpaper(wand, src_image->path, width, height);
+    }
 
     if (bg_mode != BG_MODE_TILE ||
         !transform_wallpaper_tiled(&wand, &monitor)) {
-        transform_wallpaper(&wand, &monitor, bg_mode, NULL);
+        transform_wallpaper(&wand, &monitor, bg_mode, NULL, RESAMPLER_NATIVE,
+                            QUALITY_BEST);
     }
     MagickWriteImages(wand, dst_image_path, MagickTrue);
 
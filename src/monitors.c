@@ -17,6 +17,34 @@ int rendering_depth;
 Colormap rendering_colormap;
 Screen *rendering_screen;
 
+static gboolean x_error_trapped = FALSE;
+static XErrorHandler previous_error_handler = NULL;
+
+static int handle_trapped_x_error(Display *display, XErrorEvent *event) {
+    (void)display, (void)event;
+    x_error_trapped = TRUE;
+    return 0;
+}
+
+/*
+ * Function: trap_x_errors
+ * -----------------------
+ * Makes X errors caused by the following requests on display non-fatal.
+ * untrap_x_errors restores the previous error handler and reports whether
+ * any of the requests failed.
+ */
+extern void trap_x_errors(Display *display) {
+    XSync(display, False);
+    x_error_trapped = FALSE;
+    previous_error_handler = XSetErrorHandler(handle_trapped_x_error);
+}
+
+extern gboolean untrap_x_errors(Display *display) {
+    XSync(display, False);
+    XSetErrorHandler(previous_error_handler);
+    return x_error_trapped;
+}
+
 static XRRScreenResources *get_screen_resources(void) {
     XRRScreenResources *screen_resources =
         XRRGetScreenResources(querying_display, querying_root);
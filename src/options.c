@@ -1,14 +1,63 @@
 // Copyright 2025 webdevred
 
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "wpc/options.h"
 
+#define SET_USAGE "usage: wpc set <monitor> <path> [--mode MODE]\n"
+
+static BgMode parse_bg_mode(const char *mode) {
+    if (g_ascii_strcasecmp(mode, "center") == 0) return BG_MODE_CENTER;
+    if (g_ascii_strcasecmp(mode, "fill") == 0) return BG_MODE_FILL;
+    if (g_ascii_strcasecmp(mode, "max") == 0) return BG_MODE_MAX;
+    if (g_ascii_strcasecmp(mode, "scale") == 0) return BG_MODE_SCALE;
+    if (g_ascii_strcasecmp(mode, "tile") == 0) return BG_MODE_TILE;
+
+    fprintf(stderr, "unknown mode %s, expected center, fill, max, scale or "
+                    "tile\n",
+            mode);
+    exit(1);
+}
+
+static void parse_set_options(char **argv, Options *options) {
+    options->action = SET_MONITOR_BACKGROUND;
+    if (!argv[0] || !argv[1]) {
+        fprintf(stderr, SET_USAGE);
+        exit(1);
+    }
+    options->monitor_name = argv[0];
+    options->image_path = argv[1];
+    argv += 2;
+
+    while (*argv) {
+        if (strcmp(*argv, "--mode") == 0 && argv[1]) {
+            options->bg_mode = parse_bg_mode(argv[1]);
+            argv += 2;
+        } else if (strncmp(*argv, "--mode=", 7) == 0) {
+            options->bg_mode = parse_bg_mode(*argv + 7);
+            argv++;
+        } else {
+            fprintf(stderr, SET_USAGE);
+            exit(1);
+        }
+    }
+}
+
 void parse_options(char **argv, Options *options) {
     argv++;
-    *options = (Options){.action = START_GUI};
+    *options = (Options){.action = START_GUI, .bg_mode = BG_MODE_NOT_SET};
     if (!*argv) {
         return;
     }
 
+    if (strcmp(*argv, "set") == 0) {
+        parse_set_options(argv + 1, options);
+        return;
+    }
+
     while (**argv) {
         switch (**argv) {
         case 'b':
@@ -0,0 +1,325 @@
+// Copyright 2025 webdevred
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define WPC_PIXEL_FORMAT_X86 1
+#endif
+
+#include "wpc/pixel_format.h"
+
+static guint32 scale_channel(guint32 value, guint bits) {
+    /* widen by repeating the top bits, so 255 becomes all ones */
+    if (bits >= 8) return (value << (bits - 8)) | (value >> (16 - bits));
+    return value >> (8 - bits);
+}
+
+static void convert_row_scalar(const PixelFormat *format, const guchar *src,
+                               guchar *dst, guint width) {
+    guint x, i, bytes;
+    guint32 pixel;
+
+    bytes = MAX(format->bits_per_pixel / 8, 1);
+    for (x = 0; x < width; x++) {
+        pixel = (scale_channel(src[0], format->bits[0]) << format->shifts[0]) |
+                (scale_channel(src[1], format->bits[1]) << format->shifts[1]) |
+                (scale_channel(src[2], format->bits[2]) << format->shifts[2]);
+        for (i = 0; i < bytes; i++) {
+            dst[i] = (guchar)(pixel >> (8 * (format->msb_first
+                                                 ? bytes - 1 - i
+                                                 : i)));
+        }
+        src += 4;
+        dst += bytes;
+    }
+}
+
+static void swizzle_row_scalar(const PixelFormat *format, const guchar *src,
+                               guchar *dst, guint width) {
+    guint x, k;
+    guchar pixel[4];
+    for (x = 0; x < width; x++) {
+        /* src and dst may be the same row */
+        memcpy(pixel, src, sizeof(pixel));
+        for (k = 0; k < 4; k++) {
+            dst[k] = format->shuffle[k] < 0 ? 0 : pixel[format->shuffle[k]];
+        }
+        src += 4;
+        dst += 4;
+    }
+}
+
+#ifdef WPC_PIXEL_FORMAT_X86
+static void build_shuffle_mask(const PixelFormat *format, gchar *mask,
+                               guint size) {
+    guint i;
+    for (i = 0; i < size; i++) {
+        mask[i] = format->shuffle[i % 4] < 0
+                      ? (gchar)-1
+                      : (gchar)((gint)(i - i % 4) + format->shuffle[i % 4]);
+    }
+}
+
+__attribute__((target("ssse3"))) static void
+swizzle_row_ssse3(const PixelFormat *format, const guchar *src, guchar *dst,
+                  guint width) {
+    gchar mask_bytes[16];
+    __m128i mask;
+    guint x;
+
+    build_shuffle_mask(format, mask_bytes, sizeof(mask_bytes));
+    mask = _mm_loadu_si128((const __m128i *)mask_bytes);
+    for (x = 0; x + 4 <= width; x += 4) {
+        _mm_storeu_si128(
+            (__m128i *)(dst + x * 4),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x * 4)),
+                             mask));
+    }
+    swizzle_row_scalar(format, src + x * 4, dst + x * 4, width - x);
+}
+
+__attribute__((target("avx2"))) static void
+swizzle_row_avx2(const PixelFormat *format, const guchar *src, guchar *dst,
+                 guint width) {
+    gchar mask_bytes[32];
+    __m256i mask;
+    guint x;
+
+    /* pshufb works within 128 bit lanes, the mask repeats every 16 bytes */
+    build_shuffle_mask(format, mask_bytes, 16);
+    memcpy(mask_bytes + 16, mask_bytes, 16);
+    mask = _mm256_loadu_si256((const __m256i *)mask_bytes);
+    for (x = 0; x + 8 <= width; x += 8) {
+        _mm256_storeu_si256(
+            (__m256i *)(dst + x * 4),
+            _mm256_shuffle_epi8(
+                _mm256_loadu_si256((const __m256i *)(src + x * 4)), mask));
+    }
+    swizzle_row_scalar(format, src + x * 4, dst + x * 4, width - x);
+}
+
+__attribute__((target("sse4.1"))) static __m128i
+channel_sse4(__m128i pixels, guint channel) {
+    return _mm_and_si128(
+        _mm_srl_epi32(pixels, _mm_cvtsi32_si128((int)channel * 8)),
+        _mm_set1_epi32(0xff));
+}
+
+__attribute__((target("sse4.1"))) static __m128i
+pack_wide_sse4(const PixelFormat *format, __m128i pixels) {
+    __m128i packed, value;
+    guint c;
+
+    packed = _mm_setzero_si128();
+    for (c = 0; c < 3; c++) {
+        value = channel_sse4(pixels, c);
+        value = _mm_or_si128(
+            _mm_sll_epi32(value, _mm_cvtsi32_si128((int)format->bits[c] - 8)),
+            _mm_srl_epi32(value, _mm_cvtsi32_si128(16 - (int)format->bits[c])));
+        packed = _mm_or_si128(
+            packed,
+            _mm_sll_epi32(value, _mm_cvtsi32_si128((int)format->shifts[c])));
+    }
+    return packed;
+}
+
+/* 32 bit pixels with channels of 8 bits or more, e.g. 30 bit depth */
+__attribute__((target("sse4.1"))) static void
+convert_wide_row_sse4(const PixelFormat *format, const guchar *src,
+                      guchar *dst, guint width) {
+    guint x;
+    for (x = 0; x + 4 <= width; x += 4) {
+        _mm_storeu_si128(
+            (__m128i *)(dst + x * 4),
+            pack_wide_sse4(format,
+                           _mm_loadu_si128((const __m128i *)(src + x * 4))));
+    }
+    convert_row_scalar(format, src + x * 4, dst + x * 4, width - x);
+}
+
+__attribute__((target("sse4.1"))) static __m128i
+pack_narrow_sse4(const PixelFormat *format, __m128i pixels) {
+    __m128i packed, value;
+    guint c;
+
+    packed = _mm_setzero_si128();
+    for (c = 0; c < 3; c++) {
+        value = _mm_srl_epi32(channel_sse4(pixels, c),
+                              _mm_cvtsi32_si128(8 - (int)format->bits[c]));
+        packed = _mm_or_si128(
+            packed,
+            _mm_sll_epi32(value, _mm_cvtsi32_si128((int)format->shifts[c])));
+    }
+    return packed;
+}
+
+/* 16 bit pixels with channels of 8 bits or less, e.g. RGB565 */
+__attribute__((target("sse4.1"))) static void
+convert_narrow_row_sse4(const PixelFormat *format, const guchar *src,
+                        guchar *dst, guint width) {
+    guint x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        _mm_storeu_si128(
+            (__m128i *)(dst + x * 2),
+            _mm_packus_epi32(
+                pack_narrow_sse4(
+                    format, _mm_loadu_si128((const __m128i *)(src + x * 4))),
+                pack_narrow_sse4(format, _mm_loadu_si128((const __m128i *)(
+                                             src + x * 4 + 16)))));
+    }
+    convert_row_scalar(format, src + x * 4, dst + x * 2, width - x);
+}
+#endif
+
+static const gchar *select_converter(PixelFormat *format) {
+    gboolean eight_bit, wide, narrow, native_order;
+    guint c;
+
+    eight_bit = TRUE;
+    wide = TRUE;
+    narrow = TRUE;
+    for (c = 0; c < 3; c++) {
+        eight_bit = eight_bit && format->bits[c] == 8 &&
+                    format->shifts[c] % 8 == 0;
+        wide = wide && format->bits[c] >= 8 && format->bits[c] <= 16;
+        narrow = narrow && format->bits[c] <= 8;
+    }
+    native_order = format->msb_first == (G_BYTE_ORDER == G_BIG_ENDIAN);
+
+    format->convert_row = convert_row_scalar;
+    format->swizzle = format->bits_per_pixel == 32 && eight_bit;
+
+    /* plain byte swizzles work for either byte order */
+    if (format->swizzle) {
+        memset(format->shuffle, -1, sizeof(format->shuffle));
+        for (c = 0; c < 3; c++) {
+            format->shuffle[format->msb_first ? 3 - format->shifts[c] / 8
+                                              : format->shifts[c] / 8] =
+                (gint8)c;
+        }
+        format->convert_row = swizzle_row_scalar;
+#ifdef WPC_PIXEL_FORMAT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            format->convert_row = swizzle_row_avx2;
+            return "avx2 swizzle";
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            format->convert_row = swizzle_row_ssse3;
+            return "ssse3 swizzle";
+        }
+#endif
+        return "scalar swizzle";
+    }
+
+#ifdef WPC_PIXEL_FORMAT_X86
+    __builtin_cpu_init();
+    if (native_order && __builtin_cpu_supports("sse4.1")) {
+        if (format->bits_per_pixel == 32 && wide) {
+            format->convert_row = convert_wide_row_sse4;
+            return "sse4.1";
+        }
+        if (format->bits_per_pixel == 16 && narrow) {
+            format->convert_row = convert_narrow_row_sse4;
+            return "sse4.1";
+        }
+    }
+#else
+    (void)wide, (void)narrow, (void)native_order;
+#endif
+    return "scalar";
+}
+
+/*
+ * Function: init_pixel_format
+ * ---------------------------
+ * Describes how the X server wants the pixels of visual at depth laid out
+ * and picks the fastest converter from 8 bit RGBA to that layout. The bits
+ * per pixel and byte order are those Xlib uses for images of that depth,
+ * the channel positions come from the visual's masks.
+ */
+extern void init_pixel_format(PixelFormat *format, Display *display,
+                              Visual *visual, int depth) {
+    XImage *probe;
+    gulong masks[3];
+    guint c;
+    const gchar *converter;
+
+    probe = XCreateImage(display, visual, (guint)depth, ZPixmap, 0, NULL, 1,
+                         1, 32, 0);
+    format->bits_per_pixel = (guint)probe->bits_per_pixel;
+    format->msb_first = probe->byte_order == MSBFirst;
+    XDestroyImage(probe);
+
+    if (visual->class != TrueColor && visual->class != DirectColor) {
+        g_warning("visual is not TrueColor, wallpapers will look wrong");
+    }
+
+    masks[0] = visual->red_mask;
+    masks[1] = visual->green_mask;
+    masks[2] = visual->blue_mask;
+    for (c = 0; c < 3; c++) {
+        format->shifts[c] = masks[c] ? (guint)__builtin_ctzl(masks[c]) : 0;
+        format->bits[c] = MIN((guint)__builtin_popcountl(masks[c]), 16);
+    }
+
+    snprintf(format->name, sizeof(format->name), "%u%c-%u.%u-%u.%u-%u.%u",
+             format->bits_per_pixel, format->msb_first ? 'm' : 'l',
+             format->bits[0], format->shifts[0], format->bits[1],
+             format->shifts[1], format->bits[2], format->shifts[2]);
+
+    converter = select_converter(format);
+    g_info("converting pixels for depth %d visual (%s) with %s converter",
+           depth, format->name, converter);
+}
+
+/*
+ * Function: pixel_format_stride
+ * -----------------------------
+ * Returns the bytes per line of a width pixels wide image in this format,
+ * padded to 32 bits the way XCreateImage pads them.
+ */
+extern gsize pixel_format_stride(const PixelFormat *format, guint width) {
+    return ((gsize)width * format->bits_per_pixel + 31) / 32 * 4;
+}
+
+/*
+ * Function: pixel_format_value
+ * ----------------------------
+ * Returns the pixel value of an 8 bit RGBA color, e.g. for the foreground
+ * of a GC. Alpha is ignored like it is for converted pixels.
+ */
+extern gulong pixel_format_value(const PixelFormat *format,
+                                 const guchar *rgba) {
+    gulong pixel = 0;
+    guint c;
+
+    for (c = 0; c < 3; c++) {
+        pixel |= (gulong)scale_channel(rgba[c], format->bits[c])
+                 << format->shifts[c];
+    }
+    return pixel;
+}
+
+/*
+ * Function: convert_rgba_pixels
+ * -----------------------------
+ * Converts width x height tightly packed 8 bit RGBA pixels into the X
+ * server's layout. dst_stride is the bytes per line of dst, which may be
+ * larger than a row of converted pixels. Byte swizzles may convert a row
+ * in place, src being the same row as dst.
+ */
+extern void convert_rgba_pixels(const PixelFormat *format, const guchar *src,
+                                guint width, guint height, guchar *dst,
+                                gsize dst_stride) {
+    guint y;
+    for (y = 0; y < height; y++) {
+        format->convert_row(format, src + (gsize)y * width * 4,
+                            dst + y * dst_stride, width);
+    }
+}
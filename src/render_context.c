@@ -0,0 +1,37 @@
+// Copyright 2025 webdevred
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+#include "wpc/monitors.h"
+#include "wpc/pixel_format.h"
+#include "wpc/render_context.h"
+
+static RenderContext render_context = {0};
+
+/*
+ * Function: get_render_context
+ * ----------------------------
+ * Returns the X state wallpapers are painted with. Only the thread that
+ * applies the wallpapers may use the context; render workers get everything
+ * they need through their job and never talk to the X server.
+ *
+ * The context is rebuilt when rendering_display has been reopened, since
+ * the root pixmap of the old connection is no longer ours to paint into.
+ */
+extern RenderContext *get_render_context(void) {
+    if (render_context.display != rendering_display) {
+        render_context = (RenderContext){
+            .display = rendering_display,
+            .root = rendering_root,
+            .visual = rendering_visual,
+            .depth = rendering_depth,
+            .screen = rendering_screen,
+            .pmap = None,
+            .retired_pmap = None,
+        };
+        init_pixel_format(&render_context.format, rendering_display,
+                          rendering_visual, rendering_depth);
+    }
+    return &render_context;
+}
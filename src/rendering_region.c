@@ -4,36 +4,40 @@
 #include "wpc/wpc_imagemagick.h"
 
 /*
- * Function: create_rendering_region
- * ---------------------------------
- * Computes and returns a RenderingRegion based on the given image (wand),
- * monitor configuration, and background mode. The rendering region determines
- * how the image is displayed on the monitor.
+ * Function: create_rendering_region_for_size
+ * ------------------------------------------
+ * Computes and returns a RenderingRegion for an image of img_w x img_h
+ * pixels, monitor configuration, and background mode. The rendering region
+ * determines how the image is displayed on the monitor.
  *
  * Parameters:
- *   - wand: Pointer to the MagickWand containing the image.
+ *   - img_w, img_h: The size of the image.
  *   - monitor: Pointer to the Monitor struct with monitor dimensions.
  *   - bg_mode: Specifies how the image should be rendered. Please see
  * BG_MODES.org for explanation for information.
  *
  * Returns:
- *   A RenderingRegion with computed source offsets and dimensions.
+ *   A RenderingRegion with computed source offsets and dimensions. The
+ * source window (src_x, src_y, src_width, src_height) is given in image
+ * coordinates and is scaled to width x height, which is then placed at
+ * monitor_x, monitor_y.
  */
-extern RenderingRegion
-create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
+extern RenderingRegion create_rendering_region_for_size(gulong img_w,
+                                                       gulong img_h,
+                                                       Monitor *monitor,
+                                                       BgMode bg_mode) {
     RenderingRegion rr;
 
-    size_t img_w, img_h;
-
     gulong mon_w = monitor->width;
     gulong mon_h = monitor->height;
 
     bool border_x, cut_x;
-    gulong scaled_w, scaled_h;
     ssize_t margin_x, margin_y;
 
-    img_w = MagickGetImageWidth(wand);
-    img_h = MagickGetImageHeight(wand);
+    rr.src_x = 0;
+    rr.src_y = 0;
+    rr.src_width = img_w;
+    rr.src_height = img_h;
 
     /* For BG_MODE_CENTER, if the image is larger than the monitor,
        switch to BG_MODE_MAX to scale the image proportionally.*/
@@ -47,8 +51,6 @@ create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
     switch (bg_mode) {
     case BG_MODE_SCALE:
         // BG_MODE_SCALE: Stretch the image to completely fill the monitor.
-        rr.src_x = 0;
-        rr.src_y = 0;
         rr.monitor_x = 0;
         rr.monitor_y = 0;
         rr.width = mon_w;
@@ -57,8 +59,6 @@ create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
     case BG_MODE_CENTER:
         /* BG_MODE_CENTER: Place the image at its original size, centered on the
            monitor. */
-        rr.src_x = 0;
-        rr.src_y = 0;
         rr.monitor_x = (glong)(mon_w - img_w) / 2;
         rr.monitor_y = (glong)(mon_h - img_h) / 2;
         rr.width = img_w;
@@ -68,8 +68,6 @@ create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
         /* BG_MODE_MAX: Scale the image proportionally so that it fills the
            monitor. Determine if the image is limited by width (border_x true)
            or height. */
-        rr.src_x = 0;
-        rr.src_y = 0;
         border_x = img_w * mon_h < img_h * mon_w;
         // If border_x is true, scale based on height; otherwise, use full
         // monitor width.
@@ -85,21 +83,38 @@ create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
     default:
         /* Default mode (Cropping):
            Scale the image so that one dimension exactly fits the monitor.
-           The other dimension will exceed the monitor size, so it is cropped.
+           The other dimension would exceed the monitor size, so the part of
+           the source that falls outside the monitor is cropped away before
+           scaling and only the visible window is resampled.
          */
         rr.monitor_x = 0;
         rr.monitor_y = 0;
+        rr.width = mon_w;
+        rr.height = mon_h;
         // Determine if we need to cut (crop) along the horizontal axis.
         cut_x = img_w * mon_h > img_h * mon_w;
-        // Compute the scaled dimensions for both axes.
-        scaled_w = (mon_h * img_w) / img_h;
-        scaled_h = (mon_w * img_h) / img_w;
-        // Set the final width and height of the rendering region.
-        rr.width = cut_x ? scaled_w : mon_w;
-        rr.height = cut_x ? mon_h : scaled_h;
-        // Calculate the source offsets to center the crop.
-        rr.src_x = cut_x ? ((glong)(scaled_w - mon_w) / 2) : 0;
-        rr.src_y = !cut_x ? ((glong)(scaled_h - mon_h) / 2) : 0;
+        if (cut_x) {
+            // Source columns that map onto the monitor width.
+            rr.src_width = MAX((mon_w * img_h) / mon_h, 1);
+            rr.src_x = (glong)(img_w - rr.src_width) / 2;
+        } else {
+            // Source rows that map onto the monitor height.
+            rr.src_height = MAX((mon_h * img_w) / mon_w, 1);
+            rr.src_y = (glong)(img_h - rr.src_height) / 2;
+        }
     }
     return rr;
 }
+
+/*
+ * Function: create_rendering_region
+ * ---------------------------------
+ * Computes the RenderingRegion of the image in wand, see
+ * create_rendering_region_for_size.
+ */
+extern RenderingRegion
+create_rendering_region(MagickWand *wand, Monitor *monitor, BgMode bg_mode) {
+    return create_rendering_region_for_size(MagickGetImageWidth(wand),
+                                            MagickGetImageHeight(wand),
+                                            monitor, bg_mode);
+}
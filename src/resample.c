@@ -0,0 +1,1001 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define WPC_RESAMPLE_X86 1
+#endif
+
+#include "wpc/resample.h"
+
+#define LANCZOS_LOBES 3.0
+/* weights must fit in 16 bits for the SIMD multiply-add of sample pairs */
+#define PRECISION_BITS 14
+#define ROUNDING (1 << (PRECISION_BITS - 1))
+/* box sums are accumulated in 16 bits, so at most 257 samples per pixel */
+#define MAX_BOX_AREA (G_MAXUINT16 / 255)
+/* the reciprocal of the box area, sums times it stay below 2^31 */
+#define BOX_BITS 22
+
+/*
+ * A kernel holds the weights of one pass. Every output sample reads taps
+ * consecutive source samples starting at offsets[i]; samples outside the
+ * filter window get a zero weight, so all inner loops have the same length.
+ * Each output's weights are padded to an even count, so the SIMD passes can
+ * always load them in pairs.
+ */
+typedef struct {
+    guint *offsets;
+    gint16 *weights;
+    guint taps;
+    guint stride;
+} ResampleKernel;
+
+typedef void (*HorizontalPass)(const guchar *src, gsize src_stride,
+                               guchar *dst, guint dst_width, guint rows,
+                               const ResampleKernel *kernel);
+
+typedef void (*VerticalPass)(const guchar *src, gsize stride, guchar *dst,
+                             guint dst_height, const ResampleKernel *kernel);
+
+static double box(double x) { return x >= -0.5 && x < 0.5 ? 1.0 : 0.0; }
+
+static double triangle(double x) {
+    if (x < 0.0) x = -x;
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static double lanczos(double x) {
+    double pix;
+    if (x == 0.0) return 1.0;
+    if (x <= -LANCZOS_LOBES || x >= LANCZOS_LOBES) return 0.0;
+    pix = G_PI * x;
+    return LANCZOS_LOBES * sin(pix) * sin(pix / LANCZOS_LOBES) / (pix * pix);
+}
+
+static gboolean build_kernel(ResampleKernel *kernel, guint src_size,
+                             guint dst_size, ResampleFilter filter) {
+    double scale, filter_scale, support, center, sum;
+    double (*weigh)(double);
+    double *window;
+    glong first, last;
+    guint i, j, offset;
+    gint16 *weights;
+
+    scale = (double)src_size / (double)dst_size;
+    filter_scale = scale > 1.0 ? scale : 1.0;
+    switch (filter) {
+    case RESAMPLE_FILTER_BOX:
+        weigh = box;
+        support = 0.5 * filter_scale;
+        break;
+    case RESAMPLE_FILTER_TRIANGLE:
+        weigh = triangle;
+        support = filter_scale;
+        break;
+    default:
+        weigh = lanczos;
+        support = LANCZOS_LOBES * filter_scale;
+    }
+
+    kernel->taps = MIN((guint)ceil(support) * 2 + 1, src_size);
+    kernel->stride = (kernel->taps + 1) & ~1u;
+    kernel->offsets = malloc(dst_size * sizeof(guint));
+    kernel->weights = calloc((gsize)dst_size * kernel->stride, sizeof(gint16));
+    window = malloc(kernel->taps * sizeof(double));
+    if (!kernel->offsets || !kernel->weights || !window) {
+        free(kernel->offsets);
+        free(kernel->weights);
+        free(window);
+        return FALSE;
+    }
+
+    for (i = 0; i < dst_size; i++) {
+        center = ((double)i + 0.5) * scale;
+        first = MAX((glong)(center - support + 0.5), 0);
+        last = MIN((glong)(center + support + 0.5), (glong)src_size);
+        if (last - first > (glong)kernel->taps) last = first + kernel->taps;
+
+        sum = 0.0;
+        for (j = 0; j < (guint)(last - first); j++) {
+            window[j] =
+                weigh(((double)first + j - center + 0.5) / filter_scale);
+            sum += window[j];
+        }
+
+        /* keep the window inside the source, the extra taps weigh zero */
+        offset = MIN((guint)first, src_size - kernel->taps);
+        kernel->offsets[i] = offset;
+        weights = kernel->weights + (gsize)i * kernel->stride;
+        for (j = 0; j < (guint)(last - first); j++) {
+            weights[(guint)first - offset + j] = (gint16)lround(
+                window[j] / (sum != 0.0 ? sum : 1.0) * (1 << PRECISION_BITS));
+        }
+    }
+
+    free(window);
+    return TRUE;
+}
+
+static void free_kernel(ResampleKernel *kernel) {
+    free(kernel->offsets);
+    free(kernel->weights);
+}
+
+static guchar clamp_sample(gint32 value) {
+    value >>= PRECISION_BITS;
+    return (guchar)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static void horizontal_scalar(const guchar *src, gsize src_stride,
+                              guchar *dst, guint dst_width, guint rows,
+                              const ResampleKernel *kernel) {
+    const guchar *row, *pixel;
+    const gint16 *weights;
+    gint32 r, g, b, a;
+    guint y, x, t;
+
+    for (y = 0; y < rows; y++) {
+        row = src + y * src_stride;
+        for (x = 0; x < dst_width; x++) {
+            pixel = row + (gsize)kernel->offsets[x] * 4;
+            weights = kernel->weights + (gsize)x * kernel->stride;
+            r = g = b = a = ROUNDING;
+            for (t = 0; t < kernel->taps; t++) {
+                r += pixel[t * 4] * weights[t];
+                g += pixel[t * 4 + 1] * weights[t];
+                b += pixel[t * 4 + 2] * weights[t];
+                a += pixel[t * 4 + 3] * weights[t];
+            }
+            dst[0] = clamp_sample(r);
+            dst[1] = clamp_sample(g);
+            dst[2] = clamp_sample(b);
+            dst[3] = clamp_sample(a);
+            dst += 4;
+        }
+    }
+}
+
+static void vertical_scalar(const guchar *src, gsize stride, guchar *dst,
+                            guint dst_height, const ResampleKernel *kernel) {
+    const guchar *column;
+    const gint16 *weights;
+    gint32 sum;
+    gsize x;
+    guint y, t;
+
+    for (y = 0; y < dst_height; y++) {
+        column = src + (gsize)kernel->offsets[y] * stride;
+        weights = kernel->weights + (gsize)y * kernel->stride;
+        for (x = 0; x < stride; x++) {
+            sum = ROUNDING;
+            for (t = 0; t < kernel->taps; t++) {
+                sum += column[t * stride + x] * weights[t];
+            }
+            *dst++ = clamp_sample(sum);
+        }
+    }
+}
+
+#ifdef WPC_RESAMPLE_X86
+/*
+ * The SIMD passes interleave two neighbouring samples with their pair of
+ * weights and multiply-add them in one instruction, so every step consumes
+ * two taps.
+ */
+static gint32 weight_pair(const gint16 *weights) {
+    gint32 pair;
+    memcpy(&pair, weights, sizeof(pair));
+    return pair;
+}
+
+__attribute__((target("sse4.1"))) static __m128i
+horizontal_pair_sse4(__m128i pixels, __m128i shuffle, const gint16 *weights) {
+    return _mm_madd_epi16(_mm_shuffle_epi8(pixels, shuffle),
+                          _mm_set1_epi32(weight_pair(weights)));
+}
+
+__attribute__((target("sse4.1"))) static void
+store_pixel_sse4(guchar *dst, __m128i sum) {
+    gint32 value;
+    sum = _mm_srai_epi32(sum, PRECISION_BITS);
+    sum = _mm_packs_epi32(sum, sum);
+    value = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+    memcpy(dst, &value, sizeof(value));
+}
+
+__attribute__((target("sse4.1"))) static void
+horizontal_sse4(const guchar *src, gsize src_stride, guchar *dst,
+                guint dst_width, guint rows, const ResampleKernel *kernel) {
+    const guchar *row, *pixel;
+    const gint16 *weights;
+    __m128i sum, first_pair, second_pair;
+    gint32 value;
+    guint y, x, t;
+
+    /* RGBA RGBA -> R R G G B B A A, widened to 16 bits */
+    first_pair =
+        _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+    second_pair = _mm_setr_epi8(8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1,
+                                11, -1, 15, -1);
+
+    for (y = 0; y < rows; y++) {
+        row = src + y * src_stride;
+        for (x = 0; x < dst_width; x++) {
+            pixel = row + (gsize)kernel->offsets[x] * 4;
+            weights = kernel->weights + (gsize)x * kernel->stride;
+            sum = _mm_set1_epi32(ROUNDING);
+            for (t = 0; t + 4 <= kernel->taps; t += 4) {
+                __m128i pixels =
+                    _mm_loadu_si128((const __m128i *)(pixel + t * 4));
+                sum = _mm_add_epi32(
+                    sum, horizontal_pair_sse4(pixels, first_pair, weights + t));
+                sum = _mm_add_epi32(sum,
+                                    horizontal_pair_sse4(pixels, second_pair,
+                                                         weights + t + 2));
+            }
+            if (t + 2 <= kernel->taps) {
+                sum = _mm_add_epi32(
+                    sum,
+                    horizontal_pair_sse4(
+                        _mm_loadl_epi64((const __m128i *)(pixel + t * 4)),
+                        first_pair, weights + t));
+                t += 2;
+            }
+            if (t < kernel->taps) {
+                /* the second sample of the pair is zero, as is its weight */
+                memcpy(&value, pixel + t * 4, sizeof(value));
+                sum = _mm_add_epi32(
+                    sum, horizontal_pair_sse4(_mm_cvtsi32_si128(value),
+                                              first_pair, weights + t));
+            }
+            store_pixel_sse4(dst, sum);
+            dst += 4;
+        }
+    }
+}
+
+__attribute__((target("sse4.1"))) static void
+vertical_sse4(const guchar *src, gsize stride, guchar *dst, guint dst_height,
+              const ResampleKernel *kernel) {
+    const guchar *column;
+    const gint16 *weights;
+    __m128i s0, s1, s2, s3, a, b, w, low, high, zero;
+    gsize x;
+    guint y, t;
+    gint32 sum;
+
+    zero = _mm_setzero_si128();
+    for (y = 0; y < dst_height; y++) {
+        column = src + (gsize)kernel->offsets[y] * stride;
+        weights = kernel->weights + (gsize)y * kernel->stride;
+        for (x = 0; x + 16 <= stride; x += 16) {
+            s0 = s1 = s2 = s3 = _mm_set1_epi32(ROUNDING);
+            for (t = 0; t < kernel->taps; t += 2) {
+                a = _mm_loadu_si128((const __m128i *)(column + t * stride + x));
+                b = t + 1 < kernel->taps
+                        ? _mm_loadu_si128(
+                              (const __m128i *)(column + (t + 1) * stride + x))
+                        : zero;
+                w = _mm_set1_epi32(weight_pair(weights + t));
+                low = _mm_unpacklo_epi8(a, b);
+                high = _mm_unpackhi_epi8(a, b);
+                s0 = _mm_add_epi32(
+                    s0, _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), w));
+                s1 = _mm_add_epi32(
+                    s1, _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), w));
+                s2 = _mm_add_epi32(
+                    s2, _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), w));
+                s3 = _mm_add_epi32(
+                    s3, _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), w));
+            }
+            low = _mm_packs_epi32(_mm_srai_epi32(s0, PRECISION_BITS),
+                                  _mm_srai_epi32(s1, PRECISION_BITS));
+            high = _mm_packs_epi32(_mm_srai_epi32(s2, PRECISION_BITS),
+                                   _mm_srai_epi32(s3, PRECISION_BITS));
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(low, high));
+        }
+        for (; x < stride; x++) {
+            sum = ROUNDING;
+            for (t = 0; t < kernel->taps; t++) {
+                sum += column[t * stride + x] * weights[t];
+            }
+            dst[x] = clamp_sample(sum);
+        }
+        dst += stride;
+    }
+}
+
+__attribute__((target("avx2"))) static __m256i
+horizontal_pair_avx2(__m256i pixels, __m256i shuffle, const gint16 *low,
+                     const gint16 *high) {
+    return _mm256_madd_epi16(
+        _mm256_shuffle_epi8(pixels, shuffle),
+        _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_set1_epi32(weight_pair(low))),
+            _mm_set1_epi32(weight_pair(high)), 1));
+}
+
+__attribute__((target("avx2"))) static void
+horizontal_avx2(const guchar *src, gsize src_stride, guchar *dst,
+                guint dst_width, guint rows, const ResampleKernel *kernel) {
+    const guchar *row, *pixel;
+    const gint16 *weights;
+    __m256i wide, first_pair, second_pair;
+    __m128i sum;
+    gint32 value;
+    guint y, x, t;
+
+    /* same shuffle as horizontal_sse4, applied to both 128 bit lanes */
+    first_pair = _mm256_setr_epi8(
+        0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1, 0, -1, 4, -1, 1,
+        -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+    second_pair = _mm256_setr_epi8(8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14,
+                                   -1, 11, -1, 15, -1, 8, -1, 12, -1, 9, -1,
+                                   13, -1, 10, -1, 14, -1, 11, -1, 15, -1);
+
+    for (y = 0; y < rows; y++) {
+        row = src + y * src_stride;
+        for (x = 0; x < dst_width; x++) {
+            pixel = row + (gsize)kernel->offsets[x] * 4;
+            weights = kernel->weights + (gsize)x * kernel->stride;
+            wide = _mm256_setzero_si256();
+            /* eight source pixels per step, four in each 128 bit lane */
+            for (t = 0; t + 8 <= kernel->taps; t += 8) {
+                __m256i pixels =
+                    _mm256_loadu_si256((const __m256i *)(pixel + t * 4));
+                wide = _mm256_add_epi32(
+                    wide, horizontal_pair_avx2(pixels, first_pair, weights + t,
+                                               weights + t + 4));
+                wide = _mm256_add_epi32(
+                    wide, horizontal_pair_avx2(pixels, second_pair,
+                                               weights + t + 2,
+                                               weights + t + 6));
+            }
+            sum = _mm_add_epi32(_mm256_castsi256_si128(wide),
+                                _mm256_extracti128_si256(wide, 1));
+            sum = _mm_add_epi32(sum, _mm_set1_epi32(ROUNDING));
+            for (; t + 2 <= kernel->taps; t += 2) {
+                sum = _mm_add_epi32(
+                    sum,
+                    horizontal_pair_sse4(
+                        _mm_loadl_epi64((const __m128i *)(pixel + t * 4)),
+                        _mm256_castsi256_si128(first_pair), weights + t));
+            }
+            if (t < kernel->taps) {
+                memcpy(&value, pixel + t * 4, sizeof(value));
+                sum = _mm_add_epi32(
+                    sum, horizontal_pair_sse4(
+                             _mm_cvtsi32_si128(value),
+                             _mm256_castsi256_si128(first_pair), weights + t));
+            }
+            store_pixel_sse4(dst, sum);
+            dst += 4;
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void
+vertical_avx2(const guchar *src, gsize stride, guchar *dst, guint dst_height,
+              const ResampleKernel *kernel) {
+    const guchar *column;
+    const gint16 *weights;
+    __m256i s0, s1, s2, s3, a, b, w, low, high, zero;
+    gsize x;
+    guint y, t;
+    gint32 sum;
+
+    zero = _mm256_setzero_si256();
+    for (y = 0; y < dst_height; y++) {
+        column = src + (gsize)kernel->offsets[y] * stride;
+        weights = kernel->weights + (gsize)y * kernel->stride;
+        for (x = 0; x + 32 <= stride; x += 32) {
+            s0 = s1 = s2 = s3 = _mm256_set1_epi32(ROUNDING);
+            for (t = 0; t < kernel->taps; t += 2) {
+                a = _mm256_loadu_si256(
+                    (const __m256i *)(column + t * stride + x));
+                b = t + 1 < kernel->taps
+                        ? _mm256_loadu_si256(
+                              (const __m256i *)(column + (t + 1) * stride + x))
+                        : zero;
+                w = _mm256_set1_epi32(weight_pair(weights + t));
+                low = _mm256_unpacklo_epi8(a, b);
+                high = _mm256_unpackhi_epi8(a, b);
+                s0 = _mm256_add_epi32(
+                    s0, _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), w));
+                s1 = _mm256_add_epi32(
+                    s1, _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), w));
+                s2 = _mm256_add_epi32(
+                    s2, _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), w));
+                s3 = _mm256_add_epi32(
+                    s3, _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), w));
+            }
+            /* the unpacks and packs both work per lane, so the bytes come
+               out in their original order */
+            low = _mm256_packs_epi32(_mm256_srai_epi32(s0, PRECISION_BITS),
+                                     _mm256_srai_epi32(s1, PRECISION_BITS));
+            high = _mm256_packs_epi32(_mm256_srai_epi32(s2, PRECISION_BITS),
+                                      _mm256_srai_epi32(s3, PRECISION_BITS));
+            _mm256_storeu_si256((__m256i *)(dst + x),
+                                _mm256_packus_epi16(low, high));
+        }
+        for (; x < stride; x++) {
+            sum = ROUNDING;
+            for (t = 0; t < kernel->taps; t++) {
+                sum += column[t * stride + x] * weights[t];
+            }
+            dst[x] = clamp_sample(sum);
+        }
+        dst += stride;
+    }
+}
+#endif
+
+typedef enum { ISA_SCALAR, ISA_SSE4, ISA_AVX2 } ResampleIsa;
+
+static const gchar *isa_names[] = {"scalar", "sse4.1", "avx2"};
+
+/* set by resample_set_isa, otherwise the best one is used */
+static gint forced_isa = -1;
+
+static ResampleIsa best_isa(void) {
+#ifdef WPC_RESAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return ISA_SSE4;
+#endif
+    return ISA_SCALAR;
+}
+
+static ResampleIsa current_isa(void) {
+    return forced_isa >= 0 ? (ResampleIsa)forced_isa : best_isa();
+}
+
+/*
+ * Function: resample_isa_name
+ * ---------------------------
+ * Returns the name of the instruction set resample_rgba runs on. The best
+ * path is picked at runtime, so one binary runs on any x86 CPU.
+ */
+extern const gchar *resample_isa_name(void) { return isa_names[current_isa()]; }
+
+/*
+ * Function: resample_set_isa
+ * --------------------------
+ * Makes resampling run on the instruction set named like
+ * resample_isa_name returns it, instead of the best one, so tests can
+ * compare the paths. NULL goes back to the best one. Not thread safe, it
+ * must not be called while anything is resampled.
+ *
+ * Returns:
+ *   FALSE if the name is unknown or the CPU can not run it.
+ */
+extern gboolean resample_set_isa(const gchar *name) {
+    guint i;
+
+    if (!name) {
+        forced_isa = -1;
+        return TRUE;
+    }
+    for (i = 0; i <= (guint)best_isa(); i++) {
+        if (g_strcmp0(name, isa_names[i]) == 0) {
+            forced_isa = (gint)i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Function: plan_resample
+ * -----------------------
+ * Classifies a resize. Equal sizes are a plain copy. Sizes that divide the
+ * source evenly are an integer box downscale, every output pixel is the
+ * average of a block of whole source pixels, which needs no filter weights
+ * and does not ring. Everything else goes through the separable filter.
+ */
+extern ResamplePlan plan_resample(guint src_width, guint src_height,
+                                  guint dst_width, guint dst_height) {
+    guint factor_x, factor_y;
+
+    if (src_width == dst_width && src_height == dst_height) {
+        return RESAMPLE_PLAN_COPY;
+    }
+    if (dst_width == 0 || dst_height == 0 || src_width % dst_width != 0 ||
+        src_height % dst_height != 0) {
+        return RESAMPLE_PLAN_GENERAL;
+    }
+
+    factor_x = src_width / dst_width;
+    factor_y = src_height / dst_height;
+    if ((guint64)factor_x * factor_y > MAX_BOX_AREA) {
+        return RESAMPLE_PLAN_GENERAL;
+    }
+    return RESAMPLE_PLAN_INTEGER_BOX;
+}
+
+extern const gchar *resample_plan_name(ResamplePlan plan) {
+    switch (plan) {
+    case RESAMPLE_PLAN_COPY:
+        return "copy";
+    case RESAMPLE_PLAN_INTEGER_BOX:
+        return "integer box";
+    default:
+        return "filter";
+    }
+}
+
+typedef void (*AccumulateRow)(const guchar *src, guint16 *sums, gsize count);
+
+typedef void (*ReduceRow)(const guint16 *sums, guchar *dst, guint dst_width,
+                          guint factor, guint32 reciprocal);
+
+static void accumulate_scalar(const guchar *src, guint16 *sums, gsize count) {
+    gsize i;
+    for (i = 0; i < count; i++) {
+        sums[i] = (guint16)(sums[i] + src[i]);
+    }
+}
+
+static void reduce_scalar(const guint16 *sums, guchar *dst, guint dst_width,
+                          guint factor, guint32 reciprocal) {
+    guint32 sum[4];
+    guint x, i, c;
+
+    for (x = 0; x < dst_width; x++) {
+        sum[0] = sum[1] = sum[2] = sum[3] = 0;
+        for (i = 0; i < factor; i++) {
+            for (c = 0; c < 4; c++) {
+                sum[c] += sums[i * 4 + c];
+            }
+        }
+        for (c = 0; c < 4; c++) {
+            dst[c] = (guchar)((sum[c] * reciprocal + (1u << (BOX_BITS - 1))) >>
+                              BOX_BITS);
+        }
+        sums += factor * 4;
+        dst += 4;
+    }
+}
+
+#ifdef WPC_RESAMPLE_X86
+__attribute__((target("sse4.1"))) static void
+accumulate_sse4(const guchar *src, guint16 *sums, gsize count) {
+    __m128i bytes, zero;
+    gsize i;
+
+    zero = _mm_setzero_si128();
+    for (i = 0; i + 16 <= count; i += 16) {
+        bytes = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128(
+            (__m128i *)(sums + i),
+            _mm_add_epi16(_mm_loadu_si128((const __m128i *)(sums + i)),
+                          _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(
+            (__m128i *)(sums + i + 8),
+            _mm_add_epi16(_mm_loadu_si128((const __m128i *)(sums + i + 8)),
+                          _mm_unpackhi_epi8(bytes, zero)));
+    }
+    accumulate_scalar(src + i, sums + i, count - i);
+}
+
+__attribute__((target("avx2"))) static void
+accumulate_avx2(const guchar *src, guint16 *sums, gsize count) {
+    __m256i widened;
+    gsize i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        widened = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128((const __m128i *)(src + i)));
+        _mm256_storeu_si256(
+            (__m256i *)(sums + i),
+            _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(sums + i)),
+                             widened));
+    }
+    accumulate_scalar(src + i, sums + i, count - i);
+}
+
+/* one output pixel per step, its four channels in the 16 bit lanes */
+__attribute__((target("sse4.1"))) static void
+reduce_sse4(const guint16 *sums, guchar *dst, guint dst_width, guint factor,
+            guint32 reciprocal) {
+    __m128i sum, scale, rounding;
+    gint32 value;
+    guint x, i;
+
+    scale = _mm_set1_epi32((gint32)reciprocal);
+    rounding = _mm_set1_epi32(1 << (BOX_BITS - 1));
+    for (x = 0; x < dst_width; x++) {
+        sum = _mm_setzero_si128();
+        for (i = 0; i < factor; i++) {
+            sum = _mm_add_epi16(
+                sum, _mm_loadl_epi64((const __m128i *)(sums + i * 4)));
+        }
+        sum = _mm_srli_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu16_epi32(sum), scale),
+                          rounding),
+            BOX_BITS);
+        sum = _mm_packus_epi32(sum, sum);
+        value = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        memcpy(dst, &value, sizeof(value));
+        sums += factor * 4;
+        dst += 4;
+    }
+}
+#endif
+
+/*
+ * A stream resamples rows as they are produced, so neither the source nor
+ * the result has to be in memory as a whole. Integer box downscales sum
+ * the source rows of one output row at a time. The separable filter keeps
+ * a window of horizontally filtered source rows, just enough for
+ * max_rows output rows, and slides it down the image.
+ */
+struct ResampleStream {
+    ResamplePlan plan;
+    guint src_width, dst_width, dst_height;
+    ResampleSource source;
+    gpointer data;
+    guint next_src_row, next_dst_row;
+    guint max_rows;
+
+    AccumulateRow accumulate;
+    ReduceRow reduce;
+    guint factor_x, factor_y;
+    guint32 reciprocal;
+    guint16 *sums;
+
+    HorizontalPass horizontal;
+    VerticalPass vertical;
+    ResampleKernel horizontal_kernel, vertical_kernel;
+    guchar *window;
+    guint window_first, window_rows, window_capacity;
+    guint *window_offsets;
+};
+
+static void select_passes(HorizontalPass *horizontal, VerticalPass *vertical) {
+    *horizontal = horizontal_scalar;
+    *vertical = vertical_scalar;
+#ifdef WPC_RESAMPLE_X86
+    if (current_isa() == ISA_AVX2) {
+        *horizontal = horizontal_avx2;
+        *vertical = vertical_avx2;
+    } else if (current_isa() == ISA_SSE4) {
+        *horizontal = horizontal_sse4;
+        *vertical = vertical_sse4;
+    }
+#endif
+}
+
+static gboolean init_box(ResampleStream *stream, guint src_height) {
+    stream->factor_x = stream->src_width / stream->dst_width;
+    stream->factor_y = src_height / stream->dst_height;
+    stream->reciprocal =
+        (guint32)(((1u << BOX_BITS) + stream->factor_x * stream->factor_y / 2) /
+                  (stream->factor_x * stream->factor_y));
+    stream->sums = malloc((gsize)stream->src_width * 4 * sizeof(guint16));
+    if (!stream->sums) return FALSE;
+
+    stream->accumulate = accumulate_scalar;
+    stream->reduce = reduce_scalar;
+#ifdef WPC_RESAMPLE_X86
+    if (current_isa() >= ISA_SSE4) {
+        stream->accumulate = accumulate_sse4;
+        stream->reduce = reduce_sse4;
+    }
+    if (current_isa() == ISA_AVX2) stream->accumulate = accumulate_avx2;
+#endif
+    return TRUE;
+}
+
+static gboolean init_filter(ResampleStream *stream, guint src_height,
+                            ResampleFilter filter) {
+    const guint *offsets;
+    guint y, last;
+
+    if (!build_kernel(&stream->horizontal_kernel, stream->src_width,
+                      stream->dst_width, filter)) {
+        return FALSE;
+    }
+    if (!build_kernel(&stream->vertical_kernel, src_height,
+                      stream->dst_height, filter)) {
+        free_kernel(&stream->horizontal_kernel);
+        return FALSE;
+    }
+    select_passes(&stream->horizontal, &stream->vertical);
+
+    /* the offsets never decrease, so the widest window any max_rows
+       consecutive output rows need bounds the buffer */
+    offsets = stream->vertical_kernel.offsets;
+    for (y = 0; y < stream->dst_height; y++) {
+        last = MIN(y + stream->max_rows, stream->dst_height) - 1;
+        stream->window_capacity =
+            MAX(stream->window_capacity,
+                offsets[last] + stream->vertical_kernel.taps - offsets[y]);
+    }
+
+    stream->window = malloc((gsize)stream->dst_width * 4 *
+                            stream->window_capacity);
+    stream->window_offsets = malloc(stream->max_rows * sizeof(guint));
+    return stream->window && stream->window_offsets;
+}
+
+/*
+ * Function: resample_stream_new
+ * -----------------------------
+ * Sets up a resize of src_width x src_height RGBA pixels that are pulled
+ * row by row from source, see resample_rgba for the filters and plans.
+ *
+ * Parameters:
+ *   - max_rows: The most output rows a single resample_stream_read asks
+ * for, the filter window is sized for it.
+ *   - source: Returns the next source row, src_width RGBA pixels, or NULL
+ * if it could not be produced. The row only has to stay valid until the
+ * next call. Rows the resize does not need are still pulled, but rows
+ * below the last one it needs are not.
+ *
+ * Returns:
+ *   The stream, or NULL if the sizes are empty or the buffers could not be
+ *   allocated.
+ */
+extern ResampleStream *resample_stream_new(guint src_width, guint src_height,
+                                           guint dst_width, guint dst_height,
+                                           ResampleFilter filter,
+                                           guint max_rows,
+                                           ResampleSource source,
+                                           gpointer data) {
+    ResampleStream *stream;
+    gboolean ok = TRUE;
+
+    if (src_width == 0 || src_height == 0 || dst_width == 0 ||
+        dst_height == 0) {
+        return NULL;
+    }
+
+    stream = g_new0(ResampleStream, 1);
+    stream->plan = plan_resample(src_width, src_height, dst_width, dst_height);
+    stream->src_width = src_width;
+    stream->dst_width = dst_width;
+    stream->dst_height = dst_height;
+    stream->source = source;
+    stream->data = data;
+    stream->max_rows = CLAMP(max_rows, 1, dst_height);
+
+    if (stream->plan == RESAMPLE_PLAN_INTEGER_BOX) {
+        ok = init_box(stream, src_height);
+    } else if (stream->plan == RESAMPLE_PLAN_GENERAL) {
+        ok = init_filter(stream, src_height, filter);
+    }
+    if (!ok) {
+        resample_stream_free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+/* skips source rows up to row and returns it */
+static const guchar *pull_source_row(ResampleStream *stream, guint row) {
+    const guchar *pixels;
+    do {
+        pixels = stream->source(stream->data);
+        if (!pixels) return NULL;
+    } while (stream->next_src_row++ < row);
+    return pixels;
+}
+
+static gboolean read_box_rows(ResampleStream *stream, guchar *dst,
+                              guint rows) {
+    const guchar *row;
+    gsize row_size = (gsize)stream->src_width * 4;
+    guint y, i;
+
+    for (y = stream->next_dst_row; y < stream->next_dst_row + rows; y++) {
+        memset(stream->sums, 0, row_size * sizeof(guint16));
+        for (i = 0; i < stream->factor_y; i++) {
+            row = pull_source_row(stream, y * stream->factor_y + i);
+            if (!row) return FALSE;
+            stream->accumulate(row, stream->sums, row_size);
+        }
+        stream->reduce(stream->sums, dst, stream->dst_width,
+                       stream->factor_x, stream->reciprocal);
+        dst += (gsize)stream->dst_width * 4;
+    }
+    return TRUE;
+}
+
+/*
+ * Function: read_filter_rows
+ * --------------------------
+ * Slides the window down to the source rows the next rows output rows
+ * read, filters the new ones horizontally and runs the vertical pass over
+ * the window with its offsets made relative to it.
+ */
+static gboolean read_filter_rows(ResampleStream *stream, guchar *dst,
+                                 guint rows) {
+    const ResampleKernel *vertical = &stream->vertical_kernel;
+    ResampleKernel view;
+    const guchar *row;
+    gsize row_size = (gsize)stream->dst_width * 4;
+    guint y0 = stream->next_dst_row, first, last, drop, i;
+
+    first = vertical->offsets[y0];
+    last = vertical->offsets[y0 + rows - 1] + vertical->taps;
+
+    if (first >= stream->window_first + stream->window_rows) {
+        stream->window_first = first;
+        stream->window_rows = 0;
+    } else if (first > stream->window_first) {
+        drop = first - stream->window_first;
+        memmove(stream->window, stream->window + drop * row_size,
+                (stream->window_rows - drop) * row_size);
+        stream->window_first = first;
+        stream->window_rows -= drop;
+    }
+
+    while (stream->window_first + stream->window_rows < last) {
+        row = pull_source_row(stream,
+                              stream->window_first + stream->window_rows);
+        if (!row) return FALSE;
+        stream->horizontal(row, 0,
+                           stream->window + stream->window_rows * row_size,
+                           stream->dst_width, 1, &stream->horizontal_kernel);
+        stream->window_rows++;
+    }
+
+    for (i = 0; i < rows; i++) {
+        stream->window_offsets[i] =
+            vertical->offsets[y0 + i] - stream->window_first;
+    }
+    view.offsets = stream->window_offsets;
+    view.weights = vertical->weights + (gsize)y0 * vertical->stride;
+    view.taps = vertical->taps;
+    view.stride = vertical->stride;
+    stream->vertical(stream->window, row_size, dst, rows, &view);
+    return TRUE;
+}
+
+/*
+ * Function: resample_stream_read
+ * -------------------------------
+ * Produces the next rows output rows into dst, dst_width RGBA pixels per
+ * row, tightly packed.
+ *
+ * Returns:
+ *   FALSE if the source failed or fewer rows are left.
+ */
+extern gboolean resample_stream_read(ResampleStream *stream, guchar *dst,
+                                     guint rows) {
+    const guchar *row;
+    gsize row_size = (gsize)stream->dst_width * 4;
+    guint chunk;
+    gboolean ok = TRUE;
+
+    if (rows > stream->dst_height - stream->next_dst_row) return FALSE;
+
+    while (ok && rows > 0) {
+        chunk = MIN(rows, stream->max_rows);
+        switch (stream->plan) {
+        case RESAMPLE_PLAN_COPY:
+            for (guint i = 0; ok && i < chunk; i++) {
+                row = pull_source_row(stream, stream->next_dst_row + i);
+                if (row) memcpy(dst + i * row_size, row, row_size);
+                ok = row != NULL;
+            }
+            break;
+        case RESAMPLE_PLAN_INTEGER_BOX:
+            ok = read_box_rows(stream, dst, chunk);
+            break;
+        default:
+            ok = read_filter_rows(stream, dst, chunk);
+        }
+        stream->next_dst_row += chunk;
+        dst += chunk * row_size;
+        rows -= chunk;
+    }
+    return ok;
+}
+
+/*
+ * Function: resample_stream_size
+ * ------------------------------
+ * Returns how many bytes the stream's buffers take.
+ */
+extern gsize resample_stream_size(const ResampleStream *stream) {
+    gsize size = 0;
+
+    if (stream->plan == RESAMPLE_PLAN_INTEGER_BOX) {
+        size += (gsize)stream->src_width * 4 * sizeof(guint16);
+    } else if (stream->plan == RESAMPLE_PLAN_GENERAL) {
+        size += (gsize)stream->dst_width * 4 * stream->window_capacity;
+        size += ((gsize)stream->dst_width * stream->horizontal_kernel.stride +
+                 (gsize)stream->dst_height * stream->vertical_kernel.stride) *
+                sizeof(gint16);
+    }
+    return size;
+}
+
+extern void resample_stream_free(ResampleStream *stream) {
+    if (!stream) return;
+    if (stream->plan == RESAMPLE_PLAN_GENERAL) {
+        free_kernel(&stream->horizontal_kernel);
+        free_kernel(&stream->vertical_kernel);
+    }
+    free(stream->sums);
+    free(stream->window);
+    free(stream->window_offsets);
+    g_free(stream);
+}
+
+typedef struct {
+    const guchar *pixels;
+    gsize stride;
+} MemorySource;
+
+static const guchar *next_memory_row(gpointer data) {
+    MemorySource *source = data;
+    const guchar *row = source->pixels;
+    source->pixels += source->stride;
+    return row;
+}
+
+/*
+ * Function: resample_rgba
+ * -----------------------
+ * Resizes 8 bit RGBA pixels with a separable filter, first along the rows
+ * and then along the columns. Weights are fixed point, so every sample is
+ * filtered with integer arithmetic only. Box and triangle filters need far
+ * fewer taps than Lanczos, especially when downscaling.
+ *
+ * Resizes that plan_resample classifies as a copy or an integer box
+ * downscale skip the filter, whatever filter was asked for. An integer box
+ * downscale first sums the source rows of an output row into 16 bit
+ * channels, then sums factor_x neighbouring pixels of those and divides by
+ * the block area with a fixed point reciprocal.
+ *
+ * Parameters:
+ *   - src: src_width * src_height RGBA pixels, rows src_stride bytes
+ * apart.
+ *   - dst: Room for dst_width * dst_height RGBA pixels.
+ *
+ * Returns:
+ *   FALSE if the filter weights or the intermediate image could not be
+ *   allocated.
+ *
+ * Notes:
+ *   Channels are filtered independently, alpha is not premultiplied.
+ */
+extern gboolean resample_rgba(const guchar *src, gsize src_stride,
+                              guint src_width, guint src_height, guchar *dst,
+                              guint dst_width, guint dst_height,
+                              ResampleFilter filter) {
+    ResampleStream *stream;
+    MemorySource source;
+    gboolean ok;
+    gint64 start = g_get_monotonic_time();
+
+    source.pixels = src;
+    source.stride = src_stride;
+    stream = resample_stream_new(src_width, src_height, dst_width, dst_height,
+                                 filter, dst_height, next_memory_row, &source);
+    if (!stream) return FALSE;
+
+    ok = resample_stream_read(stream, dst, dst_height);
+    if (ok && stream->plan == RESAMPLE_PLAN_INTEGER_BOX) {
+        g_info("resampled %ux%u to %ux%u as %s on %s in %.2f ms", src_width,
+               src_height, dst_width, dst_height,
+               resample_plan_name(stream->plan), resample_isa_name(),
+               (double)(g_get_monotonic_time() - start) / 1000.0);
+    } else if (ok && stream->plan == RESAMPLE_PLAN_GENERAL) {
+        g_info("resampled %ux%u to %ux%u with %u taps on %s in %.2f ms",
+               src_width, src_height, dst_width, dst_height,
+               stream->horizontal_kernel.taps, resample_isa_name(),
+               (double)(g_get_monotonic_time() - start) / 1000.0);
+    }
+
+    resample_stream_free(stream);
+    return ok;
+}
@@ -0,0 +1,257 @@
+// Copyright 2025 webdevred
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "wpc/monitors.h"
+#include "wpc/upload.h"
+
+static Display *shm_checked_display = NULL;
+static gboolean shm_usable = FALSE;
+
+static gboolean is_local_display(Display *display) {
+    const char *name = DisplayString(display);
+    return name[0] == ':' || strncmp(name, "unix:", 5) == 0;
+}
+
+/*
+ * Function: shm_upload_available
+ * ------------------------------
+ * Checks whether images can be uploaded through the MIT-SHM extension.
+ * Shared memory only works when the X server runs on the same machine, so
+ * remote displays always use the plain XPutImage path.
+ */
+extern gboolean shm_upload_available(Display *display) {
+    if (display != shm_checked_display) {
+        shm_checked_display = display;
+        shm_usable = is_local_display(display) && XShmQueryExtension(display);
+        g_info("MIT-SHM uploads %s", shm_usable ? "enabled" : "disabled");
+    }
+    return shm_usable;
+}
+
+static gboolean attach_shm_image(Display *display, UploadImage *image) {
+    gboolean failed;
+    XImage *ximage = image->ximage;
+    gsize size = (gsize)ximage->bytes_per_line * (gsize)ximage->height;
+
+    image->shminfo.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (image->shminfo.shmid == -1) return FALSE;
+
+    image->shminfo.shmaddr = shmat(image->shminfo.shmid, NULL, 0);
+    if (image->shminfo.shmaddr == (char *)-1) {
+        shmctl(image->shminfo.shmid, IPC_RMID, NULL);
+        return FALSE;
+    }
+    image->shminfo.readOnly = True;
+    ximage->data = image->shminfo.shmaddr;
+
+    trap_x_errors(display);
+    XShmAttach(display, &image->shminfo);
+    failed = untrap_x_errors(display);
+
+    /* the segment is freed once both we and the server have detached */
+    shmctl(image->shminfo.shmid, IPC_RMID, NULL);
+
+    if (failed) {
+        shmdt(image->shminfo.shmaddr);
+        ximage->data = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static UploadImage *create_shm_image(Display *display, Visual *visual,
+                                     int depth, guint width, guint height) {
+    UploadImage *image = calloc(1, sizeof(UploadImage));
+    if (!image) return NULL;
+
+    image->ximage = XShmCreateImage(display, visual, (guint)depth, ZPixmap,
+                                    NULL, &image->shminfo, width, height);
+    if (!image->ximage) {
+        free(image);
+        return NULL;
+    }
+
+    if (!attach_shm_image(display, image)) {
+        g_warning("failed to attach shared memory segment, disabling MIT-SHM");
+        shm_usable = FALSE;
+        XDestroyImage(image->ximage);
+        free(image);
+        return NULL;
+    }
+
+    image->shared = TRUE;
+    image->width = width;
+    image->height = height;
+    image->pixels = (guchar *)image->ximage->data;
+    return image;
+}
+
+/*
+ * Function: create_upload_image
+ * -----------------------------
+ * Creates a width x height image that pixels can be written into directly
+ * before it is uploaded with put_upload_image. The image is backed by a
+ * shared memory segment when MIT-SHM is usable and by ordinary memory
+ * otherwise.
+ *
+ * Returns:
+ *   The new image or NULL if it could not be created.
+ */
+extern UploadImage *create_upload_image(Display *display, Visual *visual,
+                                        int depth, guint width, guint height) {
+    UploadImage *image;
+    char *pixels;
+
+    if (shm_upload_available(display)) {
+        image = create_shm_image(display, visual, depth, width, height);
+        if (image) return image;
+    }
+
+    image = calloc(1, sizeof(UploadImage));
+    if (!image) return NULL;
+
+    image->ximage = XCreateImage(display, visual, (guint)depth, ZPixmap, 0,
+                                 NULL, width, height, 32, 0);
+    if (!image->ximage) {
+        free(image);
+        return NULL;
+    }
+    pixels = malloc((gsize)image->ximage->bytes_per_line * height);
+    if (!pixels) {
+        XDestroyImage(image->ximage);
+        free(image);
+        return NULL;
+    }
+    image->ximage->data = pixels;
+    image->shared = FALSE;
+    image->width = width;
+    image->height = height;
+    image->pixels = (guchar *)pixels;
+    return image;
+}
+
+/*
+ * Function: put_upload_area
+ * -------------------------
+ * Uploads the top left width x rows pixels of the image to drawable at
+ * x, y without waiting for the server. Only that area is sent or read by
+ * the server. XPutImage copies the pixels into the request, so they may be
+ * reused right away. The server reads a shared image while it processes
+ * the request, so it must not be changed before wait_upload_image returns;
+ * destroy_upload_image waits by itself.
+ */
+extern void put_upload_area(Display *display, Drawable drawable,
+                            UploadImage *image, guint width, guint rows,
+                            gint x, gint y) {
+    GC gc;
+    XGCValues gcval;
+    gint64 start;
+
+    width = MIN(width, image->width);
+    rows = MIN(rows, image->height);
+    gcval.foreground = None;
+    gc = XCreateGC(display, drawable, GCForeground, &gcval);
+
+    start = g_get_monotonic_time();
+    if (image->shared) {
+        wait_upload_image(display, image);
+        XShmPutImage(display, drawable, gc, image->ximage, 0, 0, x, y, width,
+                     rows, True);
+        image->pending = TRUE;
+    } else {
+        XPutImage(display, drawable, gc, image->ximage, 0, 0, x, y, width,
+                  rows);
+    }
+    XFreeGC(display, gc);
+    XFlush(display);
+    g_info("queued %ux%u upload through %s in %.2f ms", width, rows,
+           image->shared ? "MIT-SHM" : "XPutImage",
+           (double)(g_get_monotonic_time() - start) / 1000.0);
+}
+
+extern void put_upload_rows(Display *display, Drawable drawable,
+                            UploadImage *image, guint rows, gint x, gint y) {
+    put_upload_area(display, drawable, image, image->width, rows, x, y);
+}
+
+static Bool is_shm_completion(Display *display, XEvent *event, XPointer arg) {
+    UploadImage *image = (UploadImage *)arg;
+    return event->type == XShmGetEventBase(display) + ShmCompletion &&
+           ((XShmCompletionEvent *)event)->shmseg == image->shminfo.shmseg;
+}
+
+/*
+ * Function: wait_upload_image
+ * ---------------------------
+ * Waits until the server has read the last put of a shared image. Usually
+ * the completion event has long arrived by the time the image is needed
+ * again, so this does not cost a round trip like XSync does. Otherwise one
+ * XSync brings in every event the put caused, a put the server failed
+ * never completes and must not be waited for forever.
+ */
+extern void wait_upload_image(Display *display, UploadImage *image) {
+    XEvent event;
+
+    if (!image->pending) return;
+    image->pending = FALSE;
+    if (XCheckIfEvent(display, &event, is_shm_completion, (XPointer)image)) {
+        return;
+    }
+    XSync(display, False);
+    if (!XCheckIfEvent(display, &event, is_shm_completion, (XPointer)image)) {
+        g_warning("MIT-SHM upload of %ux%u image did not complete",
+                  image->width, image->height);
+    }
+}
+
+extern void put_upload_image(Display *display, Drawable drawable,
+                             UploadImage *image, gint x, gint y) {
+    put_upload_rows(display, drawable, image, image->height, x, y);
+}
+
+extern void destroy_upload_image(Display *display, UploadImage *image) {
+    if (!image) return;
+
+    if (image->shared) {
+        /* the server keeps its own mapping until it processes the detach */
+        wait_upload_image(display, image);
+        XShmDetach(display, &image->shminfo);
+        XDestroyImage(image->ximage);
+        shmdt(image->shminfo.shmaddr);
+    } else {
+        XDestroyImage(image->ximage);
+    }
+    free(image);
+}
+
+/*
+ * Function: put_pixels
+ * --------------------
+ * Uploads pixels owned by the caller, e.g. a memory mapped cached frame,
+ * with XPutImage without copying them first.
+ */
+extern void put_pixels(Display *display, Drawable drawable, Visual *visual,
+                       int depth, guchar *pixels, guint width, guint height,
+                       gint x, gint y) {
+    UploadImage image;
+
+    image.ximage = XCreateImage(display, visual, (guint)depth, ZPixmap, 0,
+                                (char *)pixels, width, height, 32, 0);
+    image.shared = FALSE;
+    image.width = width;
+    image.height = height;
+    image.pixels = pixels;
+
+    put_upload_image(display, drawable, &image, x, y);
+
+    image.ximage->data = NULL;
+    XDestroyImage(image.ximage);
+}
@@ -4,69 +4,1637 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <glib.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "wpc/decoder.h"
 #include "wpc/filesystem.h"
+#include "wpc/frame_cache.h"
 #include "wpc/monitors.h"
+#include "wpc/pixel_format.h"
+#include "wpc/render_context.h"
+#include "wpc/rendering_region.h"
+#include "wpc/upload.h"
 #include "wpc/wallpaper.h"
 #include "wpc/wallpaper_transformation.h"
+#include "wpc/xrender.h"
 
 #include "wpc/wpc_imagemagick.h"
 __attribute__((used)) static void _mark_magick_used(void) {
     _wpc_magick_include_marker();
 }
 
+/* stripes in flight per job, one is filled while the other is uploaded */
+#define STRIPE_BUFFERS 2
+#define MIN_STRIPE_ROWS 16
+
+/* bytes per pixel of an image decoded by ImageMagick, four 16 bit channels
+   or, in the HDRI builds ImageMagick 7 defaults to, four floats */
 #ifdef WPC_IMAGEMAGICK_7
-const static char *pixel_format = "BGRA";
+#define MAGICK_PIXEL_SIZE 16
 #else
-const static char *pixel_format = "RGBA";
+#define MAGICK_PIXEL_SIZE 8
 #endif
 
-static void set_bg_for_monitor(const gchar *wallpaper_path,
-                               gchar *conf_bg_fb_color, BgMode bg_mode,
-                               Monitor *monitor, Pixmap pmap) {
-    unsigned char *pixels;
-    XImage *ximage;
+/*
+ * What the workers hand to the uploading thread. A stripe without an
+ * upload image marks its job as done.
+ */
+typedef struct RenderStripe {
+    struct RenderJob *job;
+    UploadImage *upload;
+    guint y, rows;
+} RenderStripe;
+
+typedef struct RenderJob {
+    Monitor *monitor;
+    const gchar *wallpaper_path;
+    const gchar *bg_fallback_color;
+    /* parsed once, margins are filled with it on the server */
+    guchar fallback_rgba[4];
+    gulong fallback_pixel;
+    BgMode bg_mode;
+    Resampler resampler;
+    Quality quality;
+    const PixelFormat *format;
+    guint64 cache_budget;
+    guint64 memory_budget;
+    /* the part of memory_budget this job has while others render */
+    guint64 memory_share;
+    gchar *cache_key;
+    CachedFrame frame;
+    gboolean cached;
+    /* the rendered frame was added to the cache */
+    gboolean stored;
+    gboolean queued;
+    UploadImage *upload;
+    /* the area of the monitor the rendered frame covers, from the top left
+       of upload */
+    guint frame_x, frame_y, frame_width, frame_height;
+    guchar *tile_pixels;
+    guint tile_width, tile_height;
+    gboolean rendered;
+    gboolean painted;
+    /* an earlier job with the same output, copied on the server */
+    struct RenderJob *copy_of;
+    /* later jobs of the same image, they get a copy of this job's decode */
+    struct RenderJob *next_sibling;
+    gboolean decoder;
+    DecodedImage *image;
+    MagickWand *decoded;
+    /* rendered stripe_rows rows at a time, streamed from reader */
+    ImageReader *reader;
+    guint stripe_rows;
+    RenderStripe stripes[STRIPE_BUFFERS];
+    GAsyncQueue *free_stripes;
+    /* the last stripe put, handed back once the server has read it */
+    RenderStripe *uploading;
+    RenderStripe done;
+    /* when the last render of the job started and how long it took */
+    gint64 render_start, render_time;
+    /* the premultiplied source the server scales for this job and its
+       siblings */
+    guchar *server_pixels;
+    guint server_width, server_height;
+    gboolean server_alpha;
+    /* the source is too large for the server and tiled, which needs it at
+       its own size, so the jobs are rendered on the client instead */
+    gboolean server_unfit;
+} RenderJob;
+
+/* frames that may be rendered ahead of the uploads, per worker */
+#define PIPELINE_DEPTH 2
+
+typedef struct {
+    GAsyncQueue *rendered;
+    GThreadPool *pool;
+    /* only touched by the uploading thread */
+    guint next_job, in_flight, depth;
+    UploadImage *retired;
+} RenderQueue;
+
+/*
+ * Function: retire_upload
+ * -----------------------
+ * Frees the image put before upload and keeps upload until the next one
+ * is put. The server has usually read a shared image by then, so freeing
+ * it does not wait for a round trip.
+ */
+static void retire_upload(RenderContext *ctx, RenderQueue *queue,
+                          UploadImage *upload) {
+    destroy_upload_image(ctx->display, queue->retired);
+    queue->retired = upload;
+}
+
+/*
+ * Function: fill_margins
+ * ----------------------
+ * Paints the parts of the monitor the frame of job does not cover in the
+ * fallback color, so only the frame itself has to be uploaded.
+ */
+static void fill_margins(RenderContext *ctx, Pixmap pmap, RenderJob *job) {
+    Monitor *monitor = job->monitor;
+    XRectangle margins[4];
+    XGCValues gcval;
+    GC gc;
+    gint left, top, bottom, right;
+    gint count = 0;
+
+    left = monitor->left_x;
+    top = monitor->top_y;
+    bottom = (gint)(job->frame_y + job->frame_height);
+    right = (gint)(job->frame_x + job->frame_width);
+    if (job->frame_y > 0) {
+        margins[count++] = (XRectangle){(gshort)left, (gshort)top,
+                                        (gushort)monitor->width,
+                                        (gushort)job->frame_y};
+    }
+    if ((guint)bottom < monitor->height) {
+        margins[count++] = (XRectangle){(gshort)left, (gshort)(top + bottom),
+                                        (gushort)monitor->width,
+                                        (gushort)(monitor->height -
+                                                  (guint)bottom)};
+    }
+    if (job->frame_x > 0) {
+        margins[count++] =
+            (XRectangle){(gshort)left, (gshort)(top + (gint)job->frame_y),
+                         (gushort)job->frame_x, (gushort)job->frame_height};
+    }
+    if ((guint)right < monitor->width) {
+        margins[count++] = (XRectangle){
+            (gshort)(left + right), (gshort)(top + (gint)job->frame_y),
+            (gushort)(monitor->width - (guint)right),
+            (gushort)job->frame_height};
+    }
+    if (count == 0) return;
+
+    gcval.foreground = job->fallback_pixel;
+    gc = XCreateGC(ctx->display, pmap, GCForeground, &gcval);
+    XFillRectangles(ctx->display, pmap, gc, margins, count);
+    XFreeGC(ctx->display, gc);
+}
+
+static void put_cached_frame(RenderContext *ctx, RenderQueue *queue,
+                             RenderJob *job, Pixmap pmap) {
+    CachedFrame *frame = &job->frame;
+    Monitor *monitor = job->monitor;
+    UploadImage *upload = NULL;
+
+    /* copying into a shared segment beats pushing the mapping through the
+       X socket */
+    if (shm_upload_available(ctx->display)) {
+        upload = create_upload_image(ctx->display, ctx->visual, ctx->depth,
+                                     frame->width, frame->height);
+    }
+
+    if (upload && upload->shared) {
+        memcpy(upload->pixels, frame->pixels,
+               (gsize)frame->width * frame->height * 4);
+        put_upload_image(ctx->display, pmap, upload,
+                         monitor->left_x + (gint)frame->x,
+                         monitor->top_y + (gint)frame->y);
+    } else {
+        put_pixels(ctx->display, pmap, ctx->visual, ctx->depth, frame->pixels,
+                   frame->width, frame->height,
+                   monitor->left_x + (gint)frame->x,
+                   monitor->top_y + (gint)frame->y);
+    }
+
+    job->frame_x = frame->x;
+    job->frame_y = frame->y;
+    job->frame_width = frame->width;
+    job->frame_height = frame->height;
+    fill_margins(ctx, pmap, job);
+    retire_upload(ctx, queue, upload);
+}
+
+/*
+ * Function: put_tiled_frame
+ * -------------------------
+ * Uploads the tile of a job once and lets the server repeat it over the
+ * monitor, so neither the client nor the connection ever sees a full
+ * monitor sized frame.
+ */
+static void put_tiled_frame(RenderContext *ctx, Pixmap pmap, RenderJob *job) {
+    Pixmap tile;
     GC gc;
     XGCValues gcval;
+    Monitor *monitor = job->monitor;
+
+    tile = XCreatePixmap(ctx->display, ctx->root, job->tile_width,
+                         job->tile_height, (guint)ctx->depth);
+    put_pixels(ctx->display, tile, ctx->visual, ctx->depth, job->tile_pixels,
+               job->tile_width, job->tile_height, 0, 0);
+
+    /* tiles start in the top left corner of the monitor */
+    gcval.fill_style = FillTiled;
+    gcval.tile = tile;
+    gcval.ts_x_origin = monitor->left_x;
+    gcval.ts_y_origin = monitor->top_y;
+    gc = XCreateGC(ctx->display, pmap,
+                   GCFillStyle | GCTile | GCTileStipXOrigin | GCTileStipYOrigin,
+                   &gcval);
+    XFillRectangle(ctx->display, pmap, gc, monitor->left_x, monitor->top_y,
+                   monitor->width, monitor->height);
+
+    XFreeGC(ctx->display, gc);
+    XFreePixmap(ctx->display, tile);
+}
+
+/* rows exported at a time when the pixels have to be converted */
+#define EXPORT_BAND_ROWS 64
+
+/*
+ * Function: swizzle_channel_map
+ * -----------------------------
+ * Writes the ImageMagick channel map that exports pixels straight into
+ * format, e.g. "BGRP" for the usual 32 bit little endian visuals. P pads
+ * the unused byte with zero.
+ *
+ * Returns:
+ *   FALSE if format is not a plain byte swizzle of RGBA.
+ */
+static gboolean swizzle_channel_map(const PixelFormat *format, gchar *map) {
+    guint k;
+
+    if (!format->swizzle) return FALSE;
+    for (k = 0; k < 4; k++) {
+        map[k] = format->shuffle[k] < 0 ? 'P' : "RGB"[format->shuffle[k]];
+    }
+    map[4] = '\0';
+    return TRUE;
+}
+
+/*
+ * Function: export_pixels
+ * -----------------------
+ * Exports width x height pixels of the image into the X server's layout at
+ * dst. Byte swizzles are exported by ImageMagick directly, every other
+ * layout is exported as 8 bit RGBA and converted in bands of
+ * EXPORT_BAND_ROWS rows, so no RGBA copy of the whole frame is made.
+ */
+static gboolean export_pixels(MagickWand *wand, const PixelFormat *format,
+                              guint width, guint height, guchar *dst,
+                              gsize dst_stride) {
+    gchar map[5];
+    guchar *rgba;
+    guint y, rows;
+    gboolean exported = TRUE;
+
+    if (swizzle_channel_map(format, map)) {
+        if (dst_stride == (gsize)width * 4) {
+            return MagickExportImagePixels(wand, 0, 0, width, height, map,
+                                           CharPixel, dst) == MagickTrue;
+        }
+        /* a frame narrower than its upload image, row by row */
+        for (y = 0; exported && y < height; y++) {
+            exported = MagickExportImagePixels(wand, 0, y, width, 1, map,
+                                               CharPixel,
+                                               dst + y * dst_stride) ==
+                       MagickTrue;
+        }
+        return exported;
+    }
+
+    rgba = malloc((gsize)width * EXPORT_BAND_ROWS * 4);
+    if (!rgba) return FALSE;
+    for (y = 0; exported && y < height; y += rows) {
+        rows = MIN(EXPORT_BAND_ROWS, height - y);
+        exported = MagickExportImagePixels(wand, 0, y, width, rows, "RGBA",
+                                           CharPixel, rgba) == MagickTrue;
+        if (exported) {
+            convert_rgba_pixels(format, rgba, width, rows,
+                                dst + y * dst_stride, dst_stride);
+        }
+    }
+
+    free(rgba);
+    return exported;
+}
+
+/*
+ * Function: render_tile
+ * ---------------------
+ * Exports the decoded image as is, put_tiled_frame repeats it on the
+ * server. Tiles of any size are supported, larger ones are simply cut off
+ * at the monitor edges.
+ */
+static gboolean render_tile(RenderJob *job, MagickWand *wand) {
+    gsize stride;
+
+    job->tile_width = (guint)MagickGetImageWidth(wand);
+    job->tile_height = (guint)MagickGetImageHeight(wand);
+    stride = pixel_format_stride(job->format, job->tile_width);
+    job->tile_pixels = malloc(stride * job->tile_height);
+    if (!job->tile_pixels ||
+        !export_pixels(wand, job->format, job->tile_width, job->tile_height,
+                       job->tile_pixels, stride)) {
+        g_warning("Failed to export tile for monitor %s", job->monitor->name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void render_worker(gpointer data, gpointer user_data);
+
+static void queue_render_job(RenderQueue *queue, RenderJob *job) {
+    if (queue->pool) {
+        g_thread_pool_push(queue->pool, job, NULL);
+    } else {
+        render_worker(job, queue);
+    }
+}
+
+/*
+ * Function: share_decoded_image
+ * -----------------------------
+ * Hands every sibling of job the decoded image and queues it, so an image
+ * shown on several monitors is only read once. Natively decoded pixels are
+ * shared read only, wands are cloned, and clones share the pixels until
+ * they are modified. If the image could not be decoded the siblings are
+ * reported as failed right away.
+ */
+static void share_decoded_image(RenderJob *job, DecodedImage *image,
+                                MagickWand *wand, RenderQueue *queue) {
+    RenderJob *sibling, *next;
+
+    for (sibling = job->next_sibling; sibling; sibling = next) {
+        next = sibling->next_sibling;
+        sibling->next_sibling = NULL;
+        if (image) {
+            sibling->image = decoded_image_ref(image);
+        } else if (wand) {
+            sibling->decoded = CloneMagickWand(wand);
+        } else {
+            g_async_queue_push(queue->rendered, &sibling->done);
+            continue;
+        }
+        queue_render_job(queue, sibling);
+    }
+    job->next_sibling = NULL;
+}
+
+/* the smallest size that still serves a job and all of its siblings */
+static void job_decode_size(guint full_width, guint full_height,
+                            guint *min_width, guint *min_height,
+                            gpointer data) {
+    RenderJob *sibling;
+    gulong width = 0, height = 0;
+
+    for (sibling = data; sibling; sibling = sibling->next_sibling) {
+        grow_decode_size(full_width, full_height, sibling->monitor,
+                         sibling->bg_mode, &width, &height);
+    }
+    *min_width = (guint)width;
+    *min_height = (guint)height;
+}
+
+/*
+ * Function: warn_over_budget
+ * --------------------------
+ * Logs that job needs about needed bytes to render, more than its share
+ * of the memory budget. For sources that can not be bounded by it, they
+ * are rendered anyway.
+ */
+static void warn_over_budget(const RenderJob *job, guint64 needed) {
+    if (job->memory_share == 0 || needed <= job->memory_share) return;
+    g_warning("rendering %s for monitor %s needs about %.1f MiB, over the "
+              "memory budget of %.1f MiB",
+              job->wallpaper_path, job->monitor->name,
+              (double)needed / (1024.0 * 1024.0),
+              (double)job->memory_share / (1024.0 * 1024.0));
+}
+
+/*
+ * Function: magick_decode_size
+ * ----------------------------
+ * Estimates the memory ImageMagick holds for the pinged image once
+ * read_wallpaper decoded it at a size of at least width x height. JPEG
+ * comes out at the smallest 1/2, 1/4 or 1/8 scale still that large, other
+ * formats at full size.
+ */
+static guint64 magick_decode_size(MagickWand *wand, gulong width,
+                                  gulong height) {
+    gulong img_w = MagickGetImageWidth(wand);
+    gulong img_h = MagickGetImageHeight(wand);
+    gchar *format = MagickGetImageFormat(wand);
+    gulong denom = 1;
+
+    if (format && g_strcmp0(format, "JPEG") == 0 && width < img_w &&
+        height < img_h) {
+        while (denom < 8 && (img_w + denom * 2 - 1) / (denom * 2) >= width &&
+               (img_h + denom * 2 - 1) / (denom * 2) >= height) {
+            denom *= 2;
+        }
+    }
+    MagickRelinquishMemory(format);
+    return (guint64)((img_w + denom - 1) / denom) *
+           ((img_h + denom - 1) / denom) * MAGICK_PIXEL_SIZE;
+}
+
+/*
+ * Function: read_job_image
+ * ------------------------
+ * Pings the image of job and decodes it with ImageMagick at the smallest
+ * size that still serves job and all of its siblings. ImageMagick decodes
+ * whole, so a decode and frame larger than the job's share of the memory
+ * budget are only logged.
+ */
+static gboolean read_job_image(RenderJob *job, MagickWand *wand) {
+    RenderJob *sibling;
+    gulong width = 0, height = 0;
+    gint64 start = g_get_monotonic_time();
+
+    if (MagickPingImage(wand, job->wallpaper_path) == MagickFalse) {
+        return FALSE;
+    }
+    for (sibling = job; sibling; sibling = sibling->next_sibling) {
+        grow_decode_size(MagickGetImageWidth(wand), MagickGetImageHeight(wand),
+                         sibling->monitor, sibling->bg_mode, &width, &height);
+    }
+    warn_over_budget(job, magick_decode_size(wand, width, height) +
+                              (guint64)job->monitor->width *
+                                  job->monitor->height * MAGICK_PIXEL_SIZE);
+    if (!read_wallpaper(wand, job->wallpaper_path, width, height)) {
+        return FALSE;
+    }
+
+    g_info("decoded %s with ImageMagick in %.2f ms", job->wallpaper_path,
+           (double)(g_get_monotonic_time() - start) / 1000.0);
+    return TRUE;
+}
+
+/* only the area the image covers is uploaded, see fill_margins */
+static void set_frame_region(RenderJob *job, const RenderingRegion *rr) {
+    job->frame_x = (guint)rr->monitor_x;
+    job->frame_y = (guint)rr->monitor_y;
+    job->frame_width = (guint)rr->width;
+    job->frame_height = (guint)rr->height;
+}
+
+/* converts a band of the frame into the job's upload image */
+static void convert_band(const guchar *rgba, guint y, guint rows,
+                         gpointer data) {
+    RenderJob *job = data;
+    gsize stride = (gsize)job->upload->ximage->bytes_per_line;
+
+    convert_rgba_pixels(job->format, rgba, job->frame_width, rows,
+                        job->upload->pixels + y * stride, stride);
+}
+
+/*
+ * Function: render_decoded
+ * ------------------------
+ * Renders natively decoded pixels into the job's upload image, or its tile,
+ * without going through ImageMagick. Byte swizzles are resampled straight
+ * into the upload image, tightly packed, and every row is then moved to
+ * its place and swizzled there, last row first so no row is overwritten
+ * before it moved. Other layouts are resampled and converted in bands of
+ * EXPORT_BAND_ROWS rows, so no RGBA copy of the whole frame is made.
+ */
+static gboolean render_decoded(RenderJob *job, DecodedImage *image) {
+    Monitor *monitor = job->monitor;
+    RenderingRegion rr;
+    guchar *pixels, *row;
+    gsize stride, row_size;
+    guint y;
+
+    if (job->bg_mode == BG_MODE_TILE) {
+        job->tile_width = image->width;
+        job->tile_height = image->height;
+        stride = pixel_format_stride(job->format, job->tile_width);
+        job->tile_pixels = malloc(stride * job->tile_height);
+        if (!job->tile_pixels) return FALSE;
+        convert_rgba_pixels(job->format, image->pixels, image->width,
+                            image->height, job->tile_pixels, stride);
+        return TRUE;
+    }
+
+    rr = create_rendering_region_for_size(image->width, image->height,
+                                          monitor, job->bg_mode);
+    if (!frame_region_fits(&rr, monitor)) return FALSE;
+    set_frame_region(job, &rr);
+
+    if (!job->format->swizzle) {
+        return transform_wallpaper_bands(image, &rr, job->fallback_rgba,
+                                         job->quality, EXPORT_BAND_ROWS,
+                                         convert_band, job);
+    }
+
+    pixels = job->upload->pixels;
+    stride = (gsize)job->upload->ximage->bytes_per_line;
+    row_size = rr.width * 4;
+    if (!transform_wallpaper_pixels(image, &rr, job->fallback_rgba,
+                                    job->quality, pixels)) {
+        return FALSE;
+    }
+    for (y = (guint)rr.height; y-- > 0;) {
+        row = pixels + y * stride;
+        if (stride != row_size) memmove(row, pixels + y * row_size, row_size);
+        convert_rgba_pixels(job->format, row, (guint)rr.width, 1, row,
+                            stride);
+    }
+    return TRUE;
+}
+
+/*
+ * Function: render_wand
+ * ---------------------
+ * Renders an image decoded by, or imported into, ImageMagick. Takes
+ * ownership of wand.
+ */
+static gboolean render_wand(RenderJob *job, MagickWand *wand) {
+    Monitor *monitor = job->monitor;
+    RenderingRegion rr;
+    gboolean rendered;
+
+    if (job->bg_mode == BG_MODE_TILE) {
+        rendered = render_tile(job, wand);
+        DestroyMagickWand(wand);
+        return rendered;
+    }
+
+    rr = scale_wallpaper(&wand, monitor, job->bg_mode, job->bg_fallback_color,
+                         job->resampler, job->quality);
+
+    rendered = frame_region_fits(&rr, monitor) &&
+               export_pixels(wand, job->format, (guint)rr.width,
+                             (guint)rr.height, job->upload->pixels,
+                             (gsize)job->upload->ximage->bytes_per_line);
+    if (rendered) set_frame_region(job, &rr);
+    DestroyMagickWand(wand);
+    if (!rendered) {
+        g_warning("Failed to export image for monitor %s", monitor->name);
+    }
+    return rendered;
+}
+
+/* converts rows of RGBA at y into a free stripe and queues its upload */
+static void queue_stripe(RenderJob *job, RenderQueue *queue,
+                         const guchar *rgba, guint y, guint rows) {
+    RenderStripe *stripe = g_async_queue_pop(job->free_stripes);
+
+    convert_rgba_pixels(job->format, rgba, job->monitor->width, rows,
+                        stripe->upload->pixels,
+                        (gsize)stripe->upload->ximage->bytes_per_line);
+    stripe->y = y;
+    stripe->rows = rows;
+    g_async_queue_push(queue->rendered, stripe);
+}
+
+/*
+ * Function: render_stripes
+ * ------------------------
+ * Renders a striped job. Every stripe is converted into a free upload
+ * image and handed to the uploading thread, which gives it back once the
+ * server has read it, so decoding the next stripe overlaps the upload of
+ * the previous one.
+ */
+static gboolean render_stripes(RenderJob *job, RenderQueue *queue) {
+    WallpaperStripes *stripes;
+    Monitor *monitor = job->monitor;
+    guchar *rgba;
+    guint y, rows;
+    gboolean rendered = TRUE;
+
+    stripes = new_wallpaper_stripes(job->reader, monitor, job->bg_mode,
+                                    job->bg_fallback_color, job->quality,
+                                    job->stripe_rows);
+    rgba = malloc((gsize)monitor->width * job->stripe_rows * 4);
+    if (!stripes || !rgba) {
+        free_wallpaper_stripes(stripes);
+        free(rgba);
+        return FALSE;
+    }
+    g_info("rendering %s for %s in stripes of %u rows with %.1f MiB of "
+           "buffers",
+           job->wallpaper_path, monitor->name, job->stripe_rows,
+           (double)(wallpaper_stripes_size(stripes) +
+                    (gsize)monitor->width * job->stripe_rows * 4 *
+                        (1 + STRIPE_BUFFERS)) /
+               (1024.0 * 1024.0));
+
+    for (y = 0; rendered && y < monitor->height; y += rows) {
+        rows = MIN(job->stripe_rows, monitor->height - y);
+        rendered = read_wallpaper_stripe(stripes, rgba, rows);
+        if (rendered) queue_stripe(job, queue, rgba, y, rows);
+    }
+
+    free_wallpaper_stripes(stripes);
+    free(rgba);
+    return rendered;
+}
+
+/*
+ * Function: render_magick_stripes
+ * -------------------------------
+ * Renders a striped job whose image could not be streamed natively with
+ * ImageMagick instead, from the top of the monitor, so the stripes already
+ * uploaded are painted over. The whole image is decoded at once, so this
+ * can exceed the memory budget, read_job_image logs by how much.
+ */
+static gboolean render_magick_stripes(RenderJob *job, RenderQueue *queue) {
     MagickWand *wand;
+    Monitor *monitor = job->monitor;
+    guchar *rgba;
+    guint y, rows;
+    gboolean rendered;
 
     wand = NewMagickWand();
+    rgba = malloc((gsize)monitor->width * job->stripe_rows * 4);
+    rendered = rgba && read_job_image(job, wand);
+    if (rendered) {
+        transform_wallpaper(&wand, monitor, job->bg_mode,
+                            job->bg_fallback_color, job->resampler,
+                            job->quality);
+    }
+
+    for (y = 0; rendered && y < monitor->height; y += rows) {
+        rows = MIN(job->stripe_rows, monitor->height - y);
+        rendered = MagickExportImagePixels(wand, 0, y, monitor->width, rows,
+                                           "RGBA", CharPixel,
+                                           rgba) == MagickTrue;
+        if (rendered) queue_stripe(job, queue, rgba, y, rows);
+    }
+
+    DestroyMagickWand(wand);
+    free(rgba);
+    return rendered;
+}
+
+/*
+ * Function: fit_server_source
+ * ---------------------------
+ * Decides the size a width x height source of a server scaled job is
+ * uploaded at. A source the server could not hold, larger than
+ * SERVER_IMAGE_MAX_SIZE on a side or than the job's share of the memory
+ * budget, is scaled down on the client first, the server scales the rest
+ * of the way.
+ *
+ * Returns:
+ *   FALSE if the source has to be scaled down to fit_width x fit_height.
+ */
+static gboolean fit_server_source(const RenderJob *job, guint width,
+                                  guint height, guint *fit_width,
+                                  guint *fit_height) {
+    guint64 size = (guint64)width * height * 4;
+    gdouble scale;
+
+    scale = MIN((gdouble)SERVER_IMAGE_MAX_SIZE / width,
+                (gdouble)SERVER_IMAGE_MAX_SIZE / height);
+    if (job->memory_share > 0 && size > job->memory_share) {
+        scale = MIN(scale, sqrt((gdouble)job->memory_share / (gdouble)size));
+    }
+    *fit_width = width;
+    *fit_height = height;
+    if (scale >= 1.0) return TRUE;
+    *fit_width = MAX((guint)(width * scale), 1);
+    *fit_height = MAX((guint)(height * scale), 1);
+    return FALSE;
+}
+
+/* tiles repeat the image at its own size, a scaled down source would
+   change it */
+static gboolean source_is_tiled(const RenderJob *job) {
+    const RenderJob *sibling;
+
+    for (sibling = job; sibling; sibling = sibling->next_sibling) {
+        if (sibling->bg_mode == BG_MODE_TILE) return TRUE;
+    }
+    return FALSE;
+}
+
+typedef struct {
+    ImageReader *reader;
+    guchar *row;
+} ReaderRows;
+
+static const guchar *next_reader_row(gpointer data) {
+    ReaderRows *rows = data;
+    return read_image_rows(rows->reader, rows->row, 1) ? rows->row : NULL;
+}
+
+/*
+ * Function: read_server_source
+ * ----------------------------
+ * Decodes the source of a server scaled job from reader at the size
+ * fit_server_source allows. A source that has to be scaled down is
+ * resampled while it is decoded, EXPORT_BAND_ROWS rows at a time, so it is
+ * never held at full size unless the decoder holds it whole itself.
+ *
+ * Returns:
+ *   FALSE if the image could not be decoded.
+ */
+static gboolean read_server_source(RenderJob *job, ImageReader *reader) {
+    ReaderRows rows = {reader, NULL};
+    ResampleStream *stream = NULL;
+    guint width, height, y, band;
+    gboolean read;
+
+    if (!fit_server_source(job, reader->width, reader->height, &width,
+                           &height)) {
+        if (source_is_tiled(job)) {
+            job->server_unfit = TRUE;
+            return TRUE;
+        }
+        reduce_image_reader(reader, width, height);
+    }
+    job->server_width = width;
+    job->server_height = height;
+    job->server_alpha = reader->has_alpha;
+    job->server_pixels = malloc((gsize)width * height * 4);
+    if (!job->server_pixels) return FALSE;
+
+    if (reader->width == width && reader->height == height) {
+        read = read_image_rows(reader, job->server_pixels, height);
+    } else {
+        rows.row = malloc((gsize)reader->width * 4);
+        if (rows.row) {
+            stream = resample_stream_new(
+                reader->width, reader->height, width, height,
+                native_filter(job->quality), EXPORT_BAND_ROWS,
+                next_reader_row, &rows);
+        }
+        read = stream != NULL;
+        for (y = 0; read && y < height; y += band) {
+            band = MIN(EXPORT_BAND_ROWS, height - y);
+            read = resample_stream_read(
+                stream, job->server_pixels + (gsize)y * width * 4, band);
+        }
+        resample_stream_free(stream);
+        free(rows.row);
+        if (read) {
+            g_info("scaled the %ux%u source of %s to %ux%u while decoding, "
+                   "the server could not hold it",
+                   reader->width, reader->height, job->wallpaper_path, width,
+                   height);
+        }
+    }
+    if (!read) {
+        free(job->server_pixels);
+        job->server_pixels = NULL;
+        return FALSE;
+    }
+    premultiply_rgba(job->server_pixels, width, height, job->server_pixels);
+    return TRUE;
+}
+
+/*
+ * Function: decode_server_source
+ * ------------------------------
+ * Decodes the image of a job that the server scales, at the smallest size
+ * that serves the job and its siblings, and premultiplies it for RENDER.
+ * The siblings stay linked to job, they are all painted from the one
+ * upload of its pixels.
+ *
+ * Notes:
+ *   ImageMagick decodes JPEG at a reduced size already, see read_job_image,
+ * and what is still too large is scaled down by ImageMagick before it is
+ * exported, so no RGBA copy is made at full size. A source that is too
+ * large and tiled is not decoded by the native decoders at all,
+ * job->server_unfit is set instead.
+ */
+static gboolean decode_server_source(RenderJob *job) {
+    ImageReader *reader;
+    MagickWand *wand;
+    guint width, height;
+    gboolean decoded;
 
-    if (MagickReadImage(wand, wallpaper_path) == MagickFalse) {
+    reader = open_image_reader(job->wallpaper_path, job_decode_size, job);
+    if (reader) {
+        decoded = read_server_source(job, reader);
+        close_image_reader(reader);
+        return decoded;
+    }
+
+    wand = NewMagickWand();
+    if (!read_job_image(job, wand)) {
         DestroyMagickWand(wand);
-        g_warning("Failed to read image: %s\n", wallpaper_path);
+        return FALSE;
+    }
+    if (!fit_server_source(job, (guint)MagickGetImageWidth(wand),
+                           (guint)MagickGetImageHeight(wand), &width,
+                           &height)) {
+        if (source_is_tiled(job)) {
+            job->server_unfit = TRUE;
+            DestroyMagickWand(wand);
+            return TRUE;
+        }
+        g_info("scaled the %lux%lu source of %s to %ux%u with ImageMagick, "
+               "the server could not hold it",
+               (gulong)MagickGetImageWidth(wand),
+               (gulong)MagickGetImageHeight(wand), job->wallpaper_path, width,
+               height);
+        resize_magick(wand, width, height, job->quality);
+    }
+    job->server_width = width;
+    job->server_height = height;
+    job->server_alpha = MagickGetImageAlphaChannel(wand) == MagickTrue;
+    job->server_pixels = malloc((gsize)width * height * 4);
+    decoded = job->server_pixels &&
+              MagickExportImagePixels(wand, 0, 0, width, height, "RGBA",
+                                      CharPixel,
+                                      job->server_pixels) == MagickTrue;
+    DestroyMagickWand(wand);
+    if (!decoded) {
+        free(job->server_pixels);
+        job->server_pixels = NULL;
+        return FALSE;
+    }
+    premultiply_rgba(job->server_pixels, width, height, job->server_pixels);
+    return TRUE;
+}
+
+/*
+ * Function: render_monitor
+ * ------------------------
+ * Decodes and transforms the wallpaper of a job and exports the result into
+ * the job's upload image. Runs on a render worker, so it must not touch the
+ * X connection or any global state.
+ *
+ * Notes:
+ *   Formats with a native decoder are rendered without ImageMagick unless
+ * the ImageMagick resampler is configured. Everything else, and anything
+ * the native path fails on, goes through ImageMagick. Striped jobs are
+ * uploaded while they render and never cached, if streaming fails midway
+ * they are rendered again from the top with ImageMagick. With the XRender
+ * resampler the image is only decoded, the server scales it.
+ */
+static void render_monitor(RenderJob *job, RenderQueue *queue) {
+    DecodedImage *image;
+    MagickWand *wand;
+    CachedFrame frame;
+    Monitor *monitor = job->monitor;
+    gint64 start = g_get_monotonic_time();
+
+    if (job->resampler == RESAMPLER_XRENDER) {
+        job->rendered = decode_server_source(job);
+        if (!job->rendered) {
+            g_warning("Failed to read image: %s\n", job->wallpaper_path);
+        }
+        return;
+    }
+
+    if (job->stripe_rows) {
+        job->rendered = render_stripes(job, queue);
+        close_image_reader(job->reader);
+        job->reader = NULL;
+        if (!job->rendered) {
+            g_warning("Failed to stream %s for monitor %s, rendering it "
+                      "with ImageMagick",
+                      job->wallpaper_path, monitor->name);
+            job->rendered = render_magick_stripes(job, queue);
+        }
+        if (!job->rendered) {
+            g_warning("Failed to read image: %s\n", job->wallpaper_path);
+            return;
+        }
+        g_info("rendered %s for %s in %.2f ms", job->wallpaper_path,
+               monitor->name,
+               (double)(g_get_monotonic_time() - start) / 1000.0);
+        return;
+    }
+
+    image = job->image;
+    wand = job->decoded;
+    job->image = NULL;
+    job->decoded = NULL;
+    if (!image && !wand) {
+        image = decode_image(job->wallpaper_path, job_decode_size, job);
+        if (!image) {
+            wand = NewMagickWand();
+            if (!read_job_image(job, wand)) {
+                DestroyMagickWand(wand);
+                g_warning("Failed to read image: %s\n", job->wallpaper_path);
+                share_decoded_image(job, NULL, NULL, queue);
+                return;
+            }
+        }
+        share_decoded_image(job, image, wand, queue);
+    }
+
+    /* the image could not be allocated, it was only decoded for siblings */
+    if (job->bg_mode != BG_MODE_TILE && !job->upload) {
+        decoded_image_unref(image);
+        if (wand) DestroyMagickWand(wand);
         return;
     }
 
-    if (bg_mode != BG_MODE_TILE || !transform_wallpaper_tiled(&wand, monitor)) {
-        transform_wallpaper(&wand, monitor, bg_mode, conf_bg_fb_color);
+    if (image && job->resampler == RESAMPLER_NATIVE) {
+        job->rendered = render_decoded(job, image);
     }
+    if (image && !job->rendered) wand = new_wand_from_decoded_image(image);
+    decoded_image_unref(image);
+    if (wand) job->rendered = render_wand(job, wand);
+    if (!job->rendered) return;
 
-    pixels = (unsigned char *)malloc(monitor->width * monitor->height * 4);
+    if (job->cache_key) {
+        frame = (CachedFrame){
+            .x = job->frame_x,
+            .y = job->frame_y,
+            .width = job->frame_width,
+            .height = job->frame_height,
+            .pixels = job->upload->pixels,
+        };
+        job->stored = frame_cache_store(
+            job->cache_key, monitor, &frame,
+            (gsize)job->upload->ximage->bytes_per_line, job->cache_budget);
+    }
 
-    MagickExportImagePixels(wand, 0, 0, monitor->width, monitor->height,
-                            pixel_format, CharPixel, pixels);
-    ximage = XCreateImage(querying_display, rendering_visual,
-                          (guint)querying_depth, ZPixmap, 0, (char *)pixels,
-                          (guint)monitor->width, (guint)monitor->height, 32, 0);
+    g_info("rendered %s for %s in %.2f ms", job->wallpaper_path,
+           monitor->name, (double)(g_get_monotonic_time() - start) / 1000.0);
+}
 
-    gcval.foreground = None;
-    gc = XCreateGC(querying_display, querying_root, GCForeground, &gcval);
+static void render_worker(gpointer data, gpointer user_data) {
+    RenderJob *job = data;
+    RenderQueue *queue = user_data;
+    job->render_start = g_get_monotonic_time();
+    render_monitor(job, queue);
+    job->render_time = g_get_monotonic_time() - job->render_start;
+    g_async_queue_push(queue->rendered, &job->done);
+}
 
-    XPutImage(querying_display, pmap, gc, ximage, 0, 0, (gint)monitor->left_x,
-              (gint)monitor->top_y, (guint)monitor->width,
-              (guint)monitor->height);
+static gboolean same_output(const RenderJob *a, const RenderJob *b) {
+    return g_strcmp0(a->wallpaper_path, b->wallpaper_path) == 0 &&
+           a->monitor->width == b->monitor->width &&
+           a->monitor->height == b->monitor->height &&
+           a->bg_mode == b->bg_mode && a->quality == b->quality &&
+           a->resampler == b->resampler &&
+           (a->bg_mode == BG_MODE_TILE ||
+            g_strcmp0(a->bg_fallback_color, b->bg_fallback_color) == 0);
+}
 
-    ximage->data = NULL;
-    XDestroyImage(ximage);
-    free(pixels);
-    pixels = NULL;
+/*
+ * Function: group_render_jobs
+ * ---------------------------
+ * Links jobs that show the same image. A job whose output is identical to
+ * an earlier one, same image, size, mode and fallback color, becomes a copy
+ * of it and is never rendered.
+ */
+static void group_render_jobs(RenderJob *jobs, guint njobs) {
+    guint i, j;
 
-    XFreeGC(querying_display, gc);
+    for (i = 0; i < njobs; i++) {
+        for (j = 0; j < i; j++) {
+            if (!jobs[j].copy_of && same_output(&jobs[i], &jobs[j])) {
+                jobs[i].copy_of = &jobs[j];
+                break;
+            }
+        }
+    }
+}
 
-    DestroyMagickWand(wand);
-    return;
+/*
+ * Function: link_siblings
+ * -----------------------
+ * Chains the queued jobs that read the same image behind the first of
+ * them, which decodes it for all of them. Returns the number of jobs that
+ * have to be pushed to the workers.
+ */
+static guint link_siblings(RenderJob *jobs, guint njobs) {
+    RenderJob *last;
+    guint i, j, heads;
+
+    heads = 0;
+    for (i = 0; i < njobs; i++) {
+        if (!jobs[i].queued) continue;
+        for (j = 0; j < i; j++) {
+            if (jobs[j].queued && jobs[j].decoder && !jobs[j].stripe_rows &&
+                g_strcmp0(jobs[i].wallpaper_path, jobs[j].wallpaper_path) ==
+                    0) {
+                break;
+            }
+        }
+        /* striped jobs stream their own decode */
+        if (j == i || jobs[i].stripe_rows) {
+            jobs[i].decoder = TRUE;
+            heads++;
+            continue;
+        }
+        last = &jobs[j];
+        while (last->next_sibling) last = last->next_sibling;
+        last->next_sibling = &jobs[i];
+    }
+    return heads;
+}
+
+/*
+ * Function: copy_duplicate_frames
+ * -------------------------------
+ * Paints the jobs that are copies of another job by copying that job's
+ * area of pmap, so identical frames are uploaded only once.
+ */
+static void copy_duplicate_frames(RenderContext *ctx, RenderJob *jobs,
+                                  guint njobs, Pixmap pmap) {
+    RenderJob *source;
+    GC gc = NULL;
+    guint i;
+
+    for (i = 0; i < njobs; i++) {
+        source = jobs[i].copy_of;
+        if (!source || !source->painted) continue;
+        if (!gc) gc = XCreateGC(ctx->display, pmap, 0, NULL);
+        XCopyArea(ctx->display, pmap, pmap, gc, source->monitor->left_x,
+                  source->monitor->top_y, source->monitor->width,
+                  source->monitor->height, jobs[i].monitor->left_x,
+                  jobs[i].monitor->top_y);
+        jobs[i].painted = TRUE;
+        g_info("copied the frame of %s to %s", source->monitor->name,
+               jobs[i].monitor->name);
+    }
+    if (gc) XFreeGC(ctx->display, gc);
+}
+
+/*
+ * Function: plan_stripes
+ * ----------------------
+ * Decides whether job is rendered in stripes. A frame rendered whole
+ * needs the decoded image, the scaled image, the RGBA frame and the upload
+ * image in memory at once. If that does not fit the job's share of the
+ * memory budget the image is streamed instead, in stripes sized so that
+ * their buffers fit it.
+ *
+ * Notes:
+ *   A reader that does not stream still holds its whole decode while the
+ * stripes are rendered. It is decoded at the smallest size that serves the
+ * job if its backend can, and whatever is left of the budget goes to the
+ * stripes. Jobs that are never striped, tiled, scaled by ImageMagick or by
+ * the server, and decodes that do not fit even with the smallest stripes
+ * are rendered anyway and only logged with warn_over_budget.
+ *
+ * Returns:
+ *   The number of rows per stripe, or 0 if the job is rendered whole. The
+ *   header of a striped job's image is already read into job->reader.
+ */
+static guint plan_stripes(RenderJob *job) {
+    ImageReader *reader;
+    RenderingRegion rr;
+    Monitor *monitor = job->monitor;
+    guint64 budget = job->memory_share;
+    guint64 frame_size, decode, whole, row_size;
+    guint width, height;
+
+    if (budget == 0) return 0;
+
+    /* ImageMagick decodes it, read_job_image estimates that */
+    reader = open_image_reader(job->wallpaper_path, job_decode_size, job);
+    if (!reader) return 0;
+
+    frame_size = (guint64)monitor->width * monitor->height * 4;
+    decode = (guint64)reader->width * reader->height * 4;
+    if (job->bg_mode == BG_MODE_TILE || job->resampler != RESAMPLER_NATIVE) {
+        /* the decode and the tile, the premultiplied source or the copy
+           ImageMagick scales, and its frame */
+        whole = decode * 2;
+        if (job->resampler == RESAMPLER_IMAGEMAGICK) {
+            whole = decode + (decode / 4 + (guint64)monitor->width *
+                                               monitor->height) *
+                                 MAGICK_PIXEL_SIZE +
+                    frame_size * 2;
+        }
+        close_image_reader(reader);
+        warn_over_budget(job, whole);
+        return 0;
+    }
+
+    rr = create_rendering_region_for_size(reader->width, reader->height,
+                                          monitor, job->bg_mode);
+    whole = decode + (guint64)rr.width * (rr.src_height + rr.height) * 4 +
+            frame_size * 2;
+    if (whole <= budget || rr.height == 0) {
+        close_image_reader(reader);
+        return 0;
+    }
+
+    decode = 0;
+    if (!reader->streams) {
+        job_decode_size(reader->full_width, reader->full_height, &width,
+                        &height, job);
+        if (reduce_image_reader(reader, width, height)) {
+            g_info("decoding %s at %ux%u to stay within the memory budget",
+                   job->wallpaper_path, width, height);
+            rr = create_rendering_region_for_size(
+                reader->width, reader->height, monitor, job->bg_mode);
+        }
+        decode = (guint64)reader->width * reader->height * 4;
+    }
+
+    /* every stripe row has an RGBA row, its upload rows, a scaled row and
+       the source rows the filter window reads for it */
+    row_size = (guint64)monitor->width * 4 * (1 + STRIPE_BUFFERS) +
+               (guint64)rr.width * 4 *
+                   (1 + (rr.src_height + rr.height - 1) / rr.height);
+    job->reader = reader;
+    g_info("rendering %s whole needs %.1f MiB, over the budget of %.1f MiB",
+           job->wallpaper_path, (double)whole / (1024.0 * 1024.0),
+           (double)budget / (1024.0 * 1024.0));
+    warn_over_budget(job, decode + row_size * MIN_STRIPE_ROWS);
+    return (guint)CLAMP((budget - MIN(decode, budget)) / row_size,
+                        MIN_STRIPE_ROWS, monitor->height);
+}
+
+/*
+ * Function: create_stripes
+ * ------------------------
+ * Allocates the upload images a striped job cycles through.
+ */
+static gboolean create_stripes(RenderContext *ctx, RenderJob *job) {
+    guint i;
+
+    job->free_stripes = g_async_queue_new();
+    for (i = 0; i < STRIPE_BUFFERS; i++) {
+        job->stripes[i].job = job;
+        job->stripes[i].upload =
+            create_upload_image(ctx->display, ctx->visual, ctx->depth,
+                                job->monitor->width, job->stripe_rows);
+        if (!job->stripes[i].upload) return FALSE;
+        g_async_queue_push(job->free_stripes, &job->stripes[i]);
+    }
+    return TRUE;
+}
+
+static void destroy_stripes(RenderContext *ctx, RenderJob *job) {
+    guint i;
+
+    for (i = 0; i < STRIPE_BUFFERS; i++) {
+        destroy_upload_image(ctx->display, job->stripes[i].upload);
+        job->stripes[i].upload = NULL;
+    }
+    if (job->free_stripes) g_async_queue_unref(job->free_stripes);
+    job->free_stripes = NULL;
+    job->uploading = NULL;
+    close_image_reader(job->reader);
+    job->reader = NULL;
+    job->stripe_rows = 0;
+}
+
+/* the frame a job renders into, allocated on the uploading thread */
+static void create_job_upload(RenderContext *ctx, RenderJob *job) {
+    /* tiles are uploaded at their own size once they are decoded, the
+       server scales straight into pmap */
+    if (job->bg_mode == BG_MODE_TILE || job->stripe_rows ||
+        job->resampler == RESAMPLER_XRENDER) {
+        return;
+    }
+    job->upload = create_upload_image(ctx->display, ctx->visual, ctx->depth,
+                                      job->monitor->width,
+                                      job->monitor->height);
+    if (!job->upload) {
+        g_warning("Failed to allocate image for monitor %s",
+                  job->monitor->name);
+    }
+}
+
+/*
+ * Function: dispatch_jobs
+ * -----------------------
+ * Pushes decoder jobs, together with their siblings, to the workers until
+ * the pipeline is full. Frames are only allocated here, so no more than
+ * queue->depth of them wait for an upload at any time, however many
+ * monitors there are.
+ */
+static void dispatch_jobs(RenderContext *ctx, RenderQueue *queue,
+                          RenderJob *jobs, guint njobs) {
+    RenderJob *job, *sibling;
+
+    while (queue->next_job < njobs && queue->in_flight < queue->depth) {
+        job = &jobs[queue->next_job++];
+        if (!job->decoder) continue;
+
+        for (sibling = job; sibling; sibling = sibling->next_sibling) {
+            queue->in_flight++;
+            create_job_upload(ctx, sibling);
+        }
+        queue_render_job(queue, job);
+    }
+}
+
+/*
+ * Function: put_stripe
+ * --------------------
+ * Uploads a stripe and hands the job's previous stripe back to its
+ * worker, the server has read that one by the time this one is queued.
+ */
+static void put_stripe(RenderContext *ctx, Pixmap pmap, RenderStripe *stripe) {
+    RenderJob *job = stripe->job;
+
+    put_upload_rows(ctx->display, pmap, stripe->upload, stripe->rows,
+                    job->monitor->left_x,
+                    job->monitor->top_y + (gint)stripe->y);
+    if (job->uploading) {
+        wait_upload_image(ctx->display, job->uploading->upload);
+        g_async_queue_push(job->free_stripes, job->uploading);
+    }
+    job->uploading = stripe;
+}
+
+/*
+ * Function: render_on_client
+ * --------------------------
+ * Queues a server scaled job and its siblings again for the native
+ * resampler, once the server could not take their source.
+ *
+ * Notes:
+ *   The stripes are planned again like render_jobs plans them, so a large
+ *   image stays within the memory budget on the client too. Striped jobs
+ *   stream their own decode, they are taken out of the chain and queued on
+ *   their own, the rest keep sharing one decode.
+ */
+static void render_on_client(RenderContext *ctx, RenderQueue *queue,
+                             RenderJob *job) {
+    RenderJob *sibling, *next, *head = NULL, *last = NULL;
+
+    free(job->server_pixels);
+    job->server_pixels = NULL;
+
+    for (sibling = job; sibling; sibling = next) {
+        next = sibling->next_sibling;
+        sibling->next_sibling = NULL;
+        sibling->rendered = FALSE;
+        sibling->resampler = RESAMPLER_NATIVE;
+        sibling->stripe_rows = plan_stripes(sibling);
+        /* striped jobs wait for this thread to upload their stripes, they
+           can not render on it */
+        if (sibling->stripe_rows && !queue->pool) {
+            queue->pool =
+                g_thread_pool_new(render_worker, queue, 1, TRUE, NULL);
+        }
+        if (!queue->pool) sibling->stripe_rows = 0;
+        if (sibling->stripe_rows && !create_stripes(ctx, sibling)) {
+            g_warning("Failed to allocate stripes for monitor %s, rendering "
+                      "it whole",
+                      sibling->monitor->name);
+            destroy_stripes(ctx, sibling);
+        }
+        if (sibling->stripe_rows) {
+            sibling->decoder = TRUE;
+            queue_render_job(queue, sibling);
+            continue;
+        }
+
+        create_job_upload(ctx, sibling);
+        if (last) {
+            last->next_sibling = sibling;
+        } else {
+            head = sibling;
+            head->decoder = TRUE;
+        }
+        last = sibling;
+    }
+    if (head) queue_render_job(queue, head);
+}
+
+/*
+ * Function: paint_server_scaled
+ * -----------------------------
+ * Uploads the decoded source of job once and lets the server scale it onto
+ * the monitors of job and all of its siblings.
+ *
+ * Returns:
+ *   The number of jobs that are done, job and its siblings, or 0 if they
+ *   were queued again to be scaled on the client.
+ */
+static guint paint_server_scaled(RenderContext *ctx, RenderQueue *queue,
+                                 Pixmap pmap, RenderJob *job) {
+    ServerImage *image = NULL;
+    RenderJob *sibling, *next;
+    guchar color[4];
+    guint done = 0;
+    gint64 start = g_get_monotonic_time(), uploaded;
+
+    if (job->rendered && job->server_unfit) {
+        g_info("rendering %s on the client, its source is too large for "
+               "the server and tiled",
+               job->wallpaper_path);
+        render_on_client(ctx, queue, job);
+        return 0;
+    }
+    if (job->rendered) {
+        image = upload_server_image(ctx->display, ctx->root, ctx->visual,
+                                    job->server_pixels, job->server_width,
+                                    job->server_height, job->server_alpha);
+        if (!image) {
+            g_warning("Failed to upload the source of %s, scaling it on "
+                      "the client",
+                      job->wallpaper_path);
+            render_on_client(ctx, queue, job);
+            return 0;
+        }
+    }
+    uploaded = g_get_monotonic_time();
+
+    for (sibling = job; sibling; sibling = next) {
+        next = sibling->next_sibling;
+        sibling->next_sibling = NULL;
+        done++;
+        if (!image) continue;
+        parse_fallback_color(sibling->bg_fallback_color, color);
+        paint_server_image(ctx->display, image, pmap, ctx->visual,
+                           sibling->monitor, sibling->bg_mode, color,
+                           sibling->quality);
+        sibling->painted = TRUE;
+    }
+
+    destroy_server_image(ctx->display, image);
+    free(job->server_pixels);
+    job->server_pixels = NULL;
+    if (image) {
+        g_info("uploaded %ux%u source of %s in %.2f ms, queued %u server "
+               "scaled monitors in %.2f ms",
+               job->server_width, job->server_height, job->wallpaper_path,
+               (double)(uploaded - start) / 1000.0, done,
+               (double)(g_get_monotonic_time() - uploaded) / 1000.0);
+    }
+    return done;
+}
+
+typedef struct {
+    gint64 start, end;
+} TimeSpan;
+
+static gint compare_time_spans(gconstpointer a, gconstpointer b) {
+    const TimeSpan *span_a = a, *span_b = b;
+    return (span_a->start > span_b->start) - (span_a->start < span_b->start);
+}
+
+/* appends the span from start until now and returns its length */
+static gint64 record_time_span(GArray *spans, gint64 start) {
+    TimeSpan span = {start, g_get_monotonic_time()};
+    g_array_append_val(spans, span);
+    return span.end - span.start;
+}
+
+/*
+ * Function: overlapped_time
+ * -------------------------
+ * Returns the wall time during which at least one job was rendering and
+ * the uploading thread was busy at the same time. Renders on several
+ * workers overlap each other, so they are merged before being intersected
+ * with the uploads, which never overlap.
+ */
+static gint64 overlapped_time(const RenderJob *jobs, guint njobs,
+                              const GArray *uploads) {
+    GArray *renders;
+    TimeSpan span, *last, *upload;
+    gint64 overlap = 0;
+    guint i, j;
+
+    renders = g_array_new(FALSE, FALSE, sizeof(TimeSpan));
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].render_time == 0) continue;
+        span.start = jobs[i].render_start;
+        span.end = jobs[i].render_start + jobs[i].render_time;
+        g_array_append_val(renders, span);
+    }
+    g_array_sort(renders, compare_time_spans);
+
+    /* merge in place, j is the last merged span */
+    for (i = 1, j = 0; i < renders->len; i++) {
+        last = &g_array_index(renders, TimeSpan, j);
+        span = g_array_index(renders, TimeSpan, i);
+        if (span.start <= last->end) {
+            last->end = MAX(last->end, span.end);
+        } else {
+            g_array_index(renders, TimeSpan, ++j) = span;
+        }
+    }
+    if (renders->len > 0) g_array_set_size(renders, j + 1);
+
+    for (i = 0; i < uploads->len; i++) {
+        upload = &g_array_index(uploads, TimeSpan, i);
+        for (j = 0; j < renders->len; j++) {
+            last = &g_array_index(renders, TimeSpan, j);
+            overlap += MAX(MIN(upload->end, last->end) -
+                               MAX(upload->start, last->start),
+                           0);
+        }
+    }
+
+    g_array_free(renders, TRUE);
+    return overlap;
+}
+
+/*
+ * Function: render_jobs
+ * ---------------------
+ * Paints every job into pmap. Cached frames are uploaded right away, all
+ * other jobs are rendered concurrently on a pool of workers while the
+ * calling thread uploads the finished frames one at a time, since Xlib
+ * calls on rendering_display must not be made from several threads.
+ *
+ * The stages form a bounded pipeline: the next frames are decoded and
+ * scaled while the server reads the previous one, uploads are not waited
+ * for one by one, and a single XSync at the end makes sure the server
+ * has everything.
+ *
+ * Every image is decoded once no matter how many monitors show it, and
+ * monitors with identical frames get a server side copy of the first one.
+ * Images too large to render whole within the memory budget are rendered
+ * and uploaded in stripes instead. With the XRender resampler only the
+ * decoded image is uploaded and the server does the scaling.
+ *
+ * Notes:
+ *   ImageMagick runs its own OpenMP threads inside every operation, so the
+ *   thread resource is divided between the workers while the pool is busy
+ *   instead of oversubscribing the CPU.
+ */
+static void render_jobs(RenderContext *ctx, RenderJob *jobs, guint njobs,
+                        Pixmap pmap) {
+    RenderQueue queue = {0};
+    RenderJob *job;
+    RenderStripe *stripe;
+    MagickSizeType magick_threads = 0;
+    guint i, pending, heads, workers, processors, renders, striped, done;
+    GArray *uploads;
+    gint64 start = g_get_monotonic_time(), stage;
+    gint64 render_time = 0, upload_time = 0, wait_time = 0, sync_time;
+
+    group_render_jobs(jobs, njobs);
+
+    /* the jobs that may render at the same time share the memory budget */
+    processors = g_get_num_processors();
+    renders = 0;
+    for (i = 0; i < njobs; i++) {
+        if (!jobs[i].copy_of) renders++;
+    }
+    renders = MAX(MIN(renders, processors), 1);
+
+    pending = 0;
+    striped = 0;
+    for (i = 0; i < njobs; i++) {
+        job = &jobs[i];
+        if (job->copy_of) continue;
+        if (job->cache_key &&
+            frame_cache_lookup(job->cache_key, job->monitor, &job->frame)) {
+            job->cached = TRUE;
+            continue;
+        }
+
+        job->memory_share = job->memory_budget / renders;
+        job->stripe_rows = plan_stripes(job);
+        if (job->stripe_rows && !create_stripes(ctx, job)) {
+            g_warning("Failed to allocate stripes for monitor %s, rendering "
+                      "it whole",
+                      job->monitor->name);
+            destroy_stripes(ctx, job);
+        }
+        if (job->stripe_rows) striped++;
+        job->queued = TRUE;
+        pending++;
+    }
+
+    heads = link_siblings(jobs, njobs);
+    queue.rendered = g_async_queue_new();
+    workers = MIN(pending, processors);
+
+    if (workers > 1) {
+        magick_threads = MagickGetResourceLimit(ThreadResource);
+        MagickSetResourceLimit(ThreadResource, MAX(processors / workers, 1));
+    }
+    /* a worker renders the next frame while this thread uploads, striped
+       jobs even wait for it */
+    if (pending > 1 || striped > 0) {
+        queue.pool = g_thread_pool_new(render_worker, &queue,
+                                       (gint)MAX(workers, 1), TRUE, NULL);
+    }
+    queue.depth = MAX(workers, 1) * PIPELINE_DEPTH;
+
+    /* siblings are queued by their decoder once the image is decoded */
+    dispatch_jobs(ctx, &queue, jobs, njobs);
+
+    /* the workers are busy decoding, meanwhile upload what was cached */
+    uploads = g_array_new(FALSE, FALSE, sizeof(TimeSpan));
+    stage = g_get_monotonic_time();
+    for (i = 0; i < njobs; i++) {
+        job = &jobs[i];
+        if (!job->cached) continue;
+        g_info("using cached frame for %s on %s", job->wallpaper_path,
+               job->monitor->name);
+        put_cached_frame(ctx, &queue, job, pmap);
+        frame_cache_release(&job->frame);
+        job->painted = TRUE;
+    }
+    upload_time += record_time_span(uploads, stage);
+
+    for (i = 0; i < pending;) {
+        stage = g_get_monotonic_time();
+        stripe = g_async_queue_pop(queue.rendered);
+        wait_time += g_get_monotonic_time() - stage;
+
+        stage = g_get_monotonic_time();
+        job = stripe->job;
+        if (stripe->upload) {
+            put_stripe(ctx, pmap, stripe);
+            upload_time += record_time_span(uploads, stage);
+            continue;
+        }
+
+        render_time += job->render_time;
+        if (job->resampler == RESAMPLER_XRENDER) {
+            done = paint_server_scaled(ctx, &queue, pmap, job);
+            i += done;
+            queue.in_flight -= done;
+            upload_time += record_time_span(uploads, stage);
+            dispatch_jobs(ctx, &queue, jobs, njobs);
+            continue;
+        }
+
+        i++;
+        queue.in_flight--;
+        if (job->rendered && job->bg_mode == BG_MODE_TILE) {
+            put_tiled_frame(ctx, pmap, job);
+        } else if (job->rendered && !job->stripe_rows) {
+            put_upload_area(ctx->display, pmap, job->upload,
+                            job->frame_width, job->frame_height,
+                            job->monitor->left_x + (gint)job->frame_x,
+                            job->monitor->top_y + (gint)job->frame_y);
+            fill_margins(ctx, pmap, job);
+        }
+        job->painted = job->rendered;
+        retire_upload(ctx, &queue, job->upload);
+        job->upload = NULL;
+        free(job->tile_pixels);
+        job->tile_pixels = NULL;
+        destroy_stripes(ctx, job);
+        upload_time += record_time_span(uploads, stage);
+
+        dispatch_jobs(ctx, &queue, jobs, njobs);
+    }
+
+    if (queue.pool) g_thread_pool_free(queue.pool, FALSE, TRUE);
+    if (workers > 1) {
+        MagickSetResourceLimit(ThreadResource, magick_threads);
+    }
+    g_async_queue_unref(queue.rendered);
+
+    copy_duplicate_frames(ctx, jobs, njobs, pmap);
+
+    stage = g_get_monotonic_time();
+    XSync(ctx->display, False);
+    sync_time = g_get_monotonic_time() - stage;
+    retire_upload(ctx, &queue, NULL);
+
+    /* the frames are on the server, trimming the cache can not delay them */
+    for (i = 0; i < njobs; i++) {
+        if (!jobs[i].stored) continue;
+        frame_cache_evict(jobs[i].cache_budget);
+        break;
+    }
+
+    g_info("painted %u monitors from %u decodes with %u render workers in "
+           "%.2f ms",
+           njobs, heads, MAX(workers, 1),
+           (double)(g_get_monotonic_time() - start) / 1000.0);
+    g_info("pipeline: %.2f ms rendering, %.2f ms queueing uploads, %.2f ms "
+           "waiting for renders, %.2f ms in the final XSync, %.2f ms with "
+           "renders and uploads in progress at once",
+           (double)render_time / 1000.0, (double)upload_time / 1000.0,
+           (double)wait_time / 1000.0, (double)sync_time / 1000.0,
+           (double)overlapped_time(jobs, njobs, uploads) / 1000.0);
+    g_array_free(uploads, TRUE);
+}
+
+static void init_render_job(RenderJob *job, RenderContext *ctx,
+                            Config *config, Monitor *monitor,
+                            const gchar *wallpaper_path,
+                            const gchar *bg_fallback_color, BgMode bg_mode,
+                            Quality quality) {
+    guint64 cache_budget = (guint64)config->frame_cache_budget * 1024 * 1024;
+
+    *job = (RenderJob){
+        .monitor = monitor,
+        .wallpaper_path = wallpaper_path,
+        .bg_fallback_color = bg_fallback_color,
+        .bg_mode = bg_mode,
+        .resampler = config->resampler,
+        .quality = quality,
+        .format = &ctx->format,
+        .cache_budget = cache_budget,
+        .memory_budget = (guint64)config->render_memory_budget * 1024 * 1024,
+    };
+    job->done.job = job;
+    job->frame_width = monitor->width;
+    job->frame_height = monitor->height;
+    parse_fallback_color(bg_fallback_color, job->fallback_rgba);
+    job->fallback_pixel = pixel_format_value(&ctx->format, job->fallback_rgba);
+
+    if (job->resampler == RESAMPLER_XRENDER &&
+        !xrender_available(ctx->display, ctx->visual)) {
+        g_info("scaling on the client, the server cannot scale with XRender");
+        job->resampler = RESAMPLER_NATIVE;
+    }
+
+    /* tiles are repeated by the server so there is no frame to cache,
+       neither are frames the server scales, and cached frames are always 4
+       bytes per pixel */
+    if (cache_budget > 0 && bg_mode != BG_MODE_TILE &&
+        job->resampler != RESAMPLER_XRENDER &&
+        ctx->format.bits_per_pixel == 32) {
+        job->cache_key = frame_cache_key(wallpaper_path, monitor, bg_mode,
+                                         bg_fallback_color, job->resampler,
+                                         quality, ctx->format.name);
+    }
 }
 
 static Atom get_atom(Display *display, char *atom_name, Bool only_if_exists) {
@@ -77,47 +1645,255 @@ static Atom get_atom(Display *display, char *atom_name, Bool only_if_exists) {
     return atom;
 }
 
+/*
+ * Function: get_root_pixmap
+ * -------------------------
+ * Returns the pixmap the wallpapers are painted into. The pixmap lives on
+ * ctx->display for as long as the process runs and is painted in place
+ * on every apply. It is only reallocated when the screen size changes.
+ */
+static Pixmap get_root_pixmap(RenderContext *ctx) {
+    Window root;
+    gint x, y;
+    guint width, height, border_width, depth;
+    GC gc;
+    XGCValues gcval;
+
+    XGetGeometry(ctx->display, ctx->root, &root, &x, &y, &width,
+                 &height, &border_width, &depth);
+
+    if (ctx->pmap != None && width == ctx->pmap_width &&
+        height == ctx->pmap_height) {
+        return ctx->pmap;
+    }
+
+    if (ctx->pmap != None) {
+        g_info("screen resized to %ux%u, reallocating root pixmap", width,
+               height);
+        /* still published, freed once the new pixmap replaced it */
+        ctx->retired_pmap = ctx->pmap;
+    }
+
+    ctx->pmap = XCreatePixmap(ctx->display, ctx->root, width, height,
+                              (guint)ctx->depth);
+    ctx->pmap_width = width;
+    ctx->pmap_height = height;
+
+    /* monitors without a wallpaper show black instead of garbage */
+    gcval.foreground = BlackPixelOfScreen(ctx->screen);
+    gc = XCreateGC(ctx->display, ctx->pmap, GCForeground, &gcval);
+    XFillRectangle(ctx->display, ctx->pmap, gc, 0, 0, width, height);
+    XFreeGC(ctx->display, gc);
+
+    return ctx->pmap;
+}
+
+static Pixmap get_pixmap_property(RenderContext *ctx, Atom prop) {
+    Atom type;
+    gint format;
+    gulong length, bytes_after;
+    guchar *data = NULL;
+    Pixmap pixmap = None;
+
+    if (XGetWindowProperty(ctx->display, ctx->root, prop, 0, 1,
+                           False, AnyPropertyType, &type, &format, &length,
+                           &bytes_after, &data) == Success &&
+        type == XA_PIXMAP && format == 32 && length == 1) {
+        pixmap = *(Pixmap *)data;
+    }
+
+    if (data) XFree(data);
+    return pixmap;
+}
+
+/*
+ * Function: reclaim_stale_root_pixmap
+ * -----------------------------------
+ * Frees the root pixmap published by a previous root setter. Setters keep
+ * their pixmap alive by exiting with RetainPermanent, so the pixmap is only
+ * released by killing the retained client that owns it. Like other setters
+ * this is only done when both properties agree on the pixmap.
+ */
+static void reclaim_stale_root_pixmap(RenderContext *ctx, Atom prop_root,
+                                      Atom prop_esetroot, Pixmap pmap) {
+    Pixmap old_root, old_esetroot;
+
+    old_root = get_pixmap_property(ctx, prop_root);
+    old_esetroot = get_pixmap_property(ctx, prop_esetroot);
+
+    if (old_root == None || old_root != old_esetroot || old_root == pmap ||
+        old_root == ctx->retired_pmap) {
+        return;
+    }
+
+    trap_x_errors(ctx->display);
+    XKillClient(ctx->display, old_root);
+    if (untrap_x_errors(ctx->display)) {
+        g_info("root pixmap 0x%lx was already gone", old_root);
+        return;
+    }
+
+    ctx->reclaimed_pixmaps++;
+    g_info("reclaimed stale root pixmap 0x%lx (%u reclaimed so far)",
+           old_root, ctx->reclaimed_pixmaps);
+}
+
+static void publish_root_pixmap(RenderContext *ctx, Pixmap pmap) {
+    Atom prop_root, prop_esetroot;
+
+    prop_root = get_atom(ctx->display, "_XROOTPMAP_ID", False);
+    prop_esetroot = get_atom(ctx->display, "ESETROOT_PMAP_ID", False);
+
+    if (prop_root == None || prop_esetroot == None) {
+        g_critical("creation of pixmap property failed.");
+        return;
+    }
+
+    reclaim_stale_root_pixmap(ctx, prop_root, prop_esetroot, pmap);
+
+    XChangeProperty(ctx->display, ctx->root, prop_root, XA_PIXMAP, 32,
+                    PropModeReplace, (unsigned char *)&pmap, 1);
+    XChangeProperty(ctx->display, ctx->root, prop_esetroot, XA_PIXMAP,
+                    32, PropModeReplace, (unsigned char *)&pmap, 1);
+
+    XSetWindowBackgroundPixmap(ctx->display, ctx->root, pmap);
+    XClearWindow(ctx->display, ctx->root);
+
+    if (ctx->retired_pmap != None) {
+        XFreePixmap(ctx->display, ctx->retired_pmap);
+        ctx->retired_pmap = None;
+    }
+
+    XSetCloseDownMode(ctx->display, RetainPermanent);
+    XSync(ctx->display, False);
+}
+
+/*
+ * Function: find_reusable_root_pixmap
+ * -----------------------------------
+ * Returns a root pixmap that already holds the wallpapers of all monitors,
+ * so a single monitor can be repainted in place. That is either the pixmap
+ * painted earlier by this process or the pixmap currently published in
+ * _XROOTPMAP_ID, as long as it matches the size and depth of the screen.
+ *
+ * Returns:
+ *   The pixmap, or None if every monitor has to be painted.
+ */
+static Pixmap find_reusable_root_pixmap(RenderContext *ctx) {
+    Window root;
+    gint x, y;
+    guint width, height, pmap_width, pmap_height, border_width, depth;
+    Status status;
+    Atom prop_root;
+    Pixmap published;
+
+    XGetGeometry(ctx->display, ctx->root, &root, &x, &y, &width,
+                 &height, &border_width, &depth);
+
+    if (ctx->pmap != None) {
+        return width == ctx->pmap_width && height == ctx->pmap_height
+                   ? ctx->pmap
+                   : None;
+    }
+
+    prop_root = get_atom(ctx->display, "_XROOTPMAP_ID", False);
+    published = get_pixmap_property(ctx, prop_root);
+    if (published == None) return None;
+
+    trap_x_errors(ctx->display);
+    status = XGetGeometry(ctx->display, published, &root, &x, &y,
+                          &pmap_width, &pmap_height, &border_width, &depth);
+    if (untrap_x_errors(ctx->display) || !status) return None;
+
+    if (pmap_width != width || pmap_height != height ||
+        depth != (guint)ctx->depth) {
+        return None;
+    }
+
+    g_info("painting into published root pixmap 0x%lx", published);
+    ctx->pmap = published;
+    ctx->pmap_width = width;
+    ctx->pmap_height = height;
+    return ctx->pmap;
+}
+
+/*
+ * Function: set_wallpaper_for_monitor
+ * -----------------------------------
+ * Renders the configured wallpaper of a single monitor into the existing
+ * root pixmap and only refreshes that monitor's part of the root window.
+ * Falls back to set_wallpapers when there is no root pixmap to paint into.
+ */
+extern void set_wallpaper_for_monitor(Config *config,
+                                      MonitorArray *mon_arr_wrapper,
+                                      Monitor *monitor) {
+    ConfigMonitor *config_monitor;
+    RenderContext *ctx;
+    RenderJob job;
+    Pixmap pmap;
+
+    config_monitor = get_config_monitor(config, monitor->name);
+    if (!config_monitor) return;
+
+    ctx = get_render_context();
+    pmap = find_reusable_root_pixmap(ctx);
+    if (pmap == None) {
+        set_wallpapers(config, NULL, mon_arr_wrapper);
+        return;
+    }
+
+    g_info("set single bg: %s %s %d %d %d %d", monitor->name,
+           config_monitor->image_path, monitor->width, monitor->height,
+           monitor->left_x, monitor->top_y);
+
+    init_render_job(&job, ctx, config, monitor, config_monitor->image_path,
+                    config_monitor->valid_bg_fallback_color,
+                    config_monitor->bg_mode, config_monitor->quality);
+    render_jobs(ctx, &job, 1, pmap);
+    g_free(job.cache_key);
+
+    XClearArea(ctx->display, ctx->root, monitor->left_x, monitor->top_y,
+               monitor->width, monitor->height, False);
+    XSync(ctx->display, False);
+}
+
 extern void set_wallpapers(Config *config, WallpaperQueue *queue,
                            MonitorArray *mon_arr_wrapper) {
     Monitor *monitors;
-    ConfigMonitor *monitor_bgs;
+    ConfigMonitor *config_monitor;
+    RenderContext *ctx;
+    RenderJob *jobs;
+    guint njobs, j;
     gushort m;
-    Atom prop_root, prop_esetroot;
-    Pixmap pmap_d1, pmap_d2;
-    GC gc;
+    Pixmap pmap;
     BgMode bg_mode;
-    gushort w;
-    bool found;
+    Quality quality;
     Monitor *monitor;
-    XGCValues gcvalues;
 
     gchar *wallpaper_path, *bg_fallback_color;
 
-    pmap_d1 = XCreatePixmap(
-        querying_display, querying_root, (guint)rendering_screen->width,
-        (guint)rendering_screen->height, (guint)querying_depth);
+    ctx = get_render_context();
+    pmap = get_root_pixmap(ctx);
     monitors = (Monitor *)mon_arr_wrapper->data;
-    monitor_bgs = config->monitors_with_backgrounds;
     wallpaper_path = NULL;
     bg_fallback_color = NULL;
 
     bg_mode = BG_MODE_FILL;
+    quality = QUALITY_BEST;
+
+    jobs = g_new0(RenderJob, MAX(mon_arr_wrapper->amount_used, 1));
+    njobs = 0;
 
     for (m = 0; m < mon_arr_wrapper->amount_used; m++) {
         monitor = &monitors[m];
 
-        found = false;
-        for (w = 0; w < config->number_of_monitors; w++) {
-            if (strcmp(monitor->name, monitor_bgs[w].name) == 0) {
-                wallpaper_path = monitor_bgs[w].image_path;
-                bg_fallback_color = monitor_bgs[w].valid_bg_fallback_color;
-                bg_mode = monitor_bgs[w].bg_mode;
-                found = TRUE;
-                break;
-            }
-        }
-
-        if (!found) {
+        config_monitor = get_config_monitor(config, monitor->name);
+        if (config_monitor) {
+            wallpaper_path = config_monitor->image_path;
+            bg_fallback_color = config_monitor->valid_bg_fallback_color;
+            bg_mode = config_monitor->bg_mode;
+            quality = config_monitor->quality;
+        } else {
             if (queue != NULL) {
                 wallpaper_path = next_wallpaper_in_queue(queue);
                 if (wallpaper_path == NULL) continue;
@@ -132,47 +1908,16 @@ extern void set_wallpapers(Config *config, WallpaperQueue *queue,
                wallpaper_path, monitor->width, monitor->height, monitor->left_x,
                monitor->top_y);
 
-        set_bg_for_monitor(wallpaper_path, bg_fallback_color, bg_mode, monitor,
-                           pmap_d1);
+        init_render_job(&jobs[njobs++], ctx, config, monitor, wallpaper_path,
+                        bg_fallback_color, bg_mode, quality);
     }
 
-    /* create new display, copy pixmap to new display */
-    XSync(querying_display, False);
-    pmap_d2 = XCreatePixmap(
-        rendering_display, rendering_root, (guint)rendering_screen->width,
-        (guint)rendering_screen->height, (guint)rendering_depth);
-    gcvalues = (XGCValues){
-        .fill_style = FillTiled,
-        .tile = pmap_d1,
-    };
-    gc = XCreateGC(rendering_display, pmap_d2, GCFillStyle | GCTile, &gcvalues);
-    XFillRectangle(rendering_display, pmap_d2, gc, 0, 0,
-                   (guint)rendering_screen->width,
-                   (guint)rendering_screen->height);
-
-    prop_root = get_atom(rendering_display, "_XROOTPMAP_ID", False);
-    prop_esetroot = get_atom(rendering_display, "ESETROOT_PMAP_ID", False);
+    render_jobs(ctx, jobs, njobs, pmap);
 
-    if (prop_root == None || prop_esetroot == None) {
-        g_critical("creation of pixmap property failed.");
-        goto cleanup;
+    for (j = 0; j < njobs; j++) {
+        g_free(jobs[j].cache_key);
     }
+    g_free(jobs);
 
-    XChangeProperty(rendering_display, rendering_root, prop_root, XA_PIXMAP, 32,
-                    PropModeReplace, (unsigned char *)&pmap_d2, 1);
-    XChangeProperty(rendering_display, rendering_root, prop_esetroot, XA_PIXMAP,
-                    32, PropModeReplace, (unsigned char *)&pmap_d2, 1);
-
-    XSetWindowBackgroundPixmap(rendering_display, rendering_root, pmap_d2);
-    XClearWindow(rendering_display, rendering_root);
-    XFlush(rendering_display);
-    XSetCloseDownMode(rendering_display, RetainPermanent);
-
-cleanup:
-    XFreeGC(rendering_display, gc);
-    XSync(rendering_display, False);
-    XSync(querying_display, False);
-    XFreePixmap(querying_display, pmap_d1);
-
-    return;
+    publish_root_pixmap(ctx, pmap);
 }
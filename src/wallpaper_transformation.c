@@ -1,20 +1,240 @@
 // Copyright 2025 webdevred
 
 #include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "wpc/rendering_region.h"
+#include "wpc/resample.h"
 #include "wpc/wallpaper_transformation.h"
 #include "wpc/wpc_imagemagick.h"
 __attribute__((used)) static void _mark_magick_used(void) {
     _wpc_magick_include_marker();
 }
 
+#ifdef WPC_IMAGEMAGICK_7
+typedef FilterType MagickFilter;
+#else
+typedef FilterTypes MagickFilter;
+#endif
+
+/* the filter resample_rgba scales with at quality */
+extern ResampleFilter native_filter(Quality quality) {
+    switch (quality) {
+    case QUALITY_FAST:
+        return RESAMPLE_FILTER_BOX;
+    case QUALITY_BALANCED:
+        return RESAMPLE_FILTER_TRIANGLE;
+    default:
+        return RESAMPLE_FILTER_LANCZOS;
+    }
+}
+
+/* resizes the image in wand with the filter ImageMagick uses at quality */
+extern void resize_magick(MagickWand *wand, gulong width, gulong height,
+                          Quality quality) {
+    MagickFilter filter;
+
+    /* averaging whole source pixels is the cheapest way to downscale */
+    if (quality == QUALITY_FAST) {
+        MagickScaleImage(wand, width, height);
+        return;
+    }
+
+    filter = quality == QUALITY_BALANCED ? TriangleFilter : LanczosFilter;
+#ifdef WPC_IMAGEMAGICK_7
+    MagickResizeImage(wand, width, height, filter);
+#else
+    MagickResizeImage(wand, width, height, filter, 1.0);
+#endif
+}
+
+/*
+ * Function: resize_native
+ * -----------------------
+ * Resizes the image with the built-in resampler instead of
+ * MagickResizeImage. The pixels leave the wand as 8 bit RGBA, are resampled
+ * and imported into a new wand that replaces the old one.
+ *
+ * Returns:
+ *   FALSE if the pixels could not be resampled, the original wand is left
+ *   untouched in that case.
+ */
+static gboolean resize_native(MagickWand **wand_ptr, gulong width,
+                              gulong height, ResampleFilter filter) {
+    MagickWand *wand, *resized_wand;
+    gulong src_width, src_height;
+    guchar *src, *dst;
+    gboolean resized;
+
+    wand = *wand_ptr;
+    src_width = MagickGetImageWidth(wand);
+    src_height = MagickGetImageHeight(wand);
+
+    src = malloc(src_width * src_height * 4);
+    dst = malloc(width * height * 4);
+    resized = FALSE;
+    if (!src || !dst) goto cleanup;
+
+    if (MagickExportImagePixels(wand, 0, 0, src_width, src_height, "RGBA",
+                                CharPixel, src) == MagickFalse ||
+        !resample_rgba(src, src_width * 4, (guint)src_width,
+                       (guint)src_height, dst, (guint)width, (guint)height,
+                       filter)) {
+        goto cleanup;
+    }
+
+    /* opaque images stay opaque, so the canvas can still be skipped */
+    resized_wand = NewMagickWand();
+    if (MagickConstituteImage(
+            resized_wand, width, height,
+            MagickGetImageAlphaChannel(wand) == MagickFalse ? "RGBP" : "RGBA",
+            CharPixel, dst) == MagickFalse) {
+        DestroyMagickWand(resized_wand);
+        goto cleanup;
+    }
+
+    DestroyMagickWand(wand);
+    *wand_ptr = resized_wand;
+    resized = TRUE;
+
+cleanup:
+    free(src);
+    free(dst);
+    return resized;
+}
+
+/*
+ * Function: grow_decode_size
+ * --------------------------
+ * Grows width x height to the smallest size an image could be decoded at
+ * and still be rendered on monitor without upscaling. Tiles and images that
+ * are not downscaled need their full size.
+ *
+ * Parameters:
+ *   - img_w, img_h: The size stored in the image file.
+ *   - width, height: The size needed so far, 0 x 0 before the first call.
+ */
+extern void grow_decode_size(gulong img_w, gulong img_h, Monitor *monitor,
+                             BgMode bg_mode, gulong *width, gulong *height) {
+    RenderingRegion rr;
+    gulong needed_w, needed_h;
+
+    needed_w = img_w;
+    needed_h = img_h;
+
+    if (bg_mode != BG_MODE_TILE) {
+        rr = create_rendering_region_for_size(img_w, img_h, monitor, bg_mode);
+        if (rr.width < rr.src_width && rr.height < rr.src_height) {
+            needed_w = (img_w * rr.width + rr.src_width - 1) / rr.src_width;
+            needed_h =
+                (img_h * rr.height + rr.src_height - 1) / rr.src_height;
+        }
+    }
+
+    *width = MAX(*width, needed_w);
+    *height = MAX(*height, needed_h);
+}
+
+/*
+ * Function: read_wallpaper
+ * ------------------------
+ * Reads the pinged image, asking the decoder for a size of at least width
+ * x height. JPEG decoders then scale by 1/2, 1/4 or 1/8 while decoding,
+ * which saves most of the decoding time and memory of large photos. Other
+ * formats ignore the hint and are decoded at full size.
+ *
+ * Returns:
+ *   FALSE if the image could not be read.
+ */
+extern gboolean read_wallpaper(MagickWand *wand, const gchar *path,
+                               gulong width, gulong height) {
+    gulong img_w, img_h;
+    gchar size[64];
+
+    img_w = MagickGetImageWidth(wand);
+    img_h = MagickGetImageHeight(wand);
+    ClearMagickWand(wand);
+
+    if (width < img_w && height < img_h) {
+        snprintf(size, sizeof(size), "%lux%lu", width, height);
+        MagickSetOption(wand, "jpeg:size", size);
+    }
+
+    if (MagickReadImage(wand, path) == MagickFalse) return FALSE;
+
+    if (MagickGetImageWidth(wand) < img_w) {
+        g_info("decoded %s at %lux%lu instead of %lux%lu", path,
+               MagickGetImageWidth(wand), MagickGetImageHeight(wand), img_w,
+               img_h);
+    }
+    return TRUE;
+}
+
+/*
+ * Function: scale_wallpaper
+ * -------------------------
+ * Crops away the part of the source that will not be visible and resizes
+ * the remaining window to the part of the monitor it covers. Transparent
+ * images are flattened onto the fallback color, so the result is the
+ * final frame for that part of the monitor.
+ *
+ * Parameters:
+ *   See transform_wallpaper.
+ *
+ * Returns:
+ *   The rendering region, rr.width x rr.height is the size of the scaled
+ * image and rr.monitor_x, rr.monitor_y its position on the monitor.
+ */
+extern RenderingRegion scale_wallpaper(MagickWand **wand_ptr,
+                                       Monitor *monitor, BgMode bg_mode,
+                                       const gchar *bg_fallback_color,
+                                       Resampler resampler, Quality quality) {
+    RenderingRegion rr;
+    ResamplePlan plan;
+    MagickWand *wand;
+    PixelWand *color;
+    wand = *wand_ptr;
+
+    rr = create_rendering_region(wand, monitor, bg_mode);
+
+    if (rr.src_width != MagickGetImageWidth(wand) ||
+        rr.src_height != MagickGetImageHeight(wand)) {
+        MagickCropImage(wand, rr.src_width, rr.src_height, rr.src_x,
+                        rr.src_y);
+        MagickResetImagePage(wand, NULL);
+    }
+
+    plan = plan_resample((guint)rr.src_width, (guint)rr.src_height,
+                         (guint)rr.width, (guint)rr.height);
+    g_info("resize plan: %s", resample_plan_name(plan));
+
+    if (plan != RESAMPLE_PLAN_COPY) {
+        if (resampler != RESAMPLER_NATIVE ||
+            !resize_native(wand_ptr, rr.width, rr.height,
+                           native_filter(quality))) {
+            resize_magick(wand, rr.width, rr.height, quality);
+        }
+        wand = *wand_ptr;
+    }
+
+    if (MagickGetImageAlphaChannel(wand) == MagickTrue) {
+        color = NewPixelWand();
+        if (bg_fallback_color) PixelSetColor(color, bg_fallback_color);
+        MagickSetImageBackgroundColor(wand, color);
+        MagickSetImageAlphaChannel(wand, RemoveAlphaChannel);
+        DestroyPixelWand(color);
+    }
+    return rr;
+}
+
 /*
  * Function: transform_wallpaper
  * -----------------------------
  * Transforms a wallpaper image based on the selected background mode and
- * monitor properties. It resizes, crops, and composites the image onto a new
- * canvas to match the display configuration.
+ * monitor properties. It scales the image with scale_wallpaper and
+ * composites it onto a new canvas to match the display configuration.
  *
  * Parameters:
  *   - wand_ptr: Pointer to the MagickWand containing the image. The pointer
@@ -22,23 +242,39 @@ __attribute__((used)) static void _mark_magick_used(void) {
  *   - monitor: Pointer to the Monitor struct containing screen dimensions.
  *   - bg_mode: Specifies how the image should be rendered
  *   - bg_fallback_color: Fallback background color if none is specified.
+ *   - resampler: RESAMPLER_NATIVE scales with resample_rgba,
+ * RESAMPLER_IMAGEMAGICK with ImageMagick. The native resampler falls back to
+ * ImageMagick if it fails. Sizes plan_resample classifies as a copy are not
+ * resized.
+ *   - quality: Picks the filter. QUALITY_BEST uses Lanczos, QUALITY_BALANCED
+ * a triangle filter and QUALITY_FAST a box filter, which ImageMagick
+ * implements with MagickScaleImage.
  *
  * Returns:
  *   Void. The original image is replaced with the transformed image.
  *
  * Notes:
- *   - This function creates a new MagickWand and frees the old one.
+ *   - This function creates a new MagickWand and frees the old one, unless
+ * the resized image covers the whole monitor. In that case the resized
+ * image is used as is and no canvas is allocated.
  */
 
 extern void transform_wallpaper(MagickWand **wand_ptr, Monitor *monitor,
-                                BgMode bg_mode,
-                                const gchar *bg_fallback_color) {
+                                BgMode bg_mode, const gchar *bg_fallback_color,
+                                Resampler resampler, Quality quality) {
     RenderingRegion rr;
     MagickWand *wand, *scaled_wand;
     PixelWand *color;
+
+    rr = scale_wallpaper(wand_ptr, monitor, bg_mode, bg_fallback_color,
+                         resampler, quality);
     wand = *wand_ptr;
 
-    rr = create_rendering_region(wand, monitor, bg_mode);
+    /* the flattened image covering the whole monitor is the final frame */
+    if (rr.monitor_x == 0 && rr.monitor_y == 0 &&
+        rr.width == monitor->width && rr.height == monitor->height) {
+        return;
+    }
 
     color = NewPixelWand();
     PixelSetColor(color, bg_fallback_color);
@@ -46,14 +282,9 @@ extern void transform_wallpaper(MagickWand **wand_ptr, Monitor *monitor,
     scaled_wand = NewMagickWand();
     MagickNewImage(scaled_wand, monitor->width, monitor->height, color);
 #ifdef WPC_IMAGEMAGICK_7
-    MagickResizeImage(wand, rr.width, rr.height, LanczosFilter);
-    MagickCropImage(wand, rr.width, rr.height, rr.src_x, rr.src_y);
     MagickCompositeImage(scaled_wand, wand, OverCompositeOp, MagickTrue,
                          rr.monitor_x, rr.monitor_y);
 #else
-    MagickResizeImage(wand, rr.width, rr.height, LanczosFilter, 1.0);
-    MagickCropImage(wand, rr.width, rr.height, rr.src_x, rr.src_y);
-
     MagickCompositeImage(scaled_wand, wand, OverCompositeOp, rr.monitor_x,
                          rr.monitor_y);
 #endif
@@ -65,6 +296,22 @@ extern void transform_wallpaper(MagickWand **wand_ptr, Monitor *monitor,
     *wand_ptr = scaled_wand;
 }
 
+/*
+ * Function: fill_by_doubling
+ * --------------------------
+ * Repeats the first filled bytes of buffer until size bytes are filled.
+ * Every memcpy copies everything written so far, so a buffer is filled with
+ * a logarithmic number of calls no matter how small the pattern is.
+ */
+static void fill_by_doubling(guchar *buffer, gsize filled, gsize size) {
+    gsize amount;
+    while (filled < size) {
+        amount = MIN(filled, size - filled);
+        memcpy(buffer + filled, buffer, amount);
+        filled += amount;
+    }
+}
+
 /*
  * Function: transform_wallpaper_tiled
  * -----------------------------------
@@ -78,51 +325,393 @@ extern void transform_wallpaper(MagickWand **wand_ptr, Monitor *monitor,
  *
  * Returns:
  *   - true: If the image was successfully tiled and updated.
- *   - false: If the image is too large to be tiled properly.
+ *   - false: If the pixels could not be allocated or exported.
  *
  * Notes:
  *   - This function creates a new MagickWand and frees the old one.
- *   - The function assumes the original image is smaller than the monitor.
+ *   - The first tile row is built by doubling the tile's pixel rows across
+ * the monitor width, and the rest of the monitor by doubling that row of
+ * tiles downwards. Images larger than the monitor are cut off at the
+ * monitor edges.
  */
 extern bool transform_wallpaper_tiled(MagickWand **wand_ptr, Monitor *monitor) {
-    glong amount_x, amount_y;
-    gulong output_width, output_height, img_w, img_h;
+    gulong img_w, img_h, copy_w, copy_h, y;
+    gsize stride;
     MagickWand *wand, *tiled_wand;
-    PixelWand *color;
-    guint i, j;
+    guchar *pixels;
     wand = *wand_ptr;
     img_w = MagickGetImageWidth(wand);
     img_h = MagickGetImageHeight(wand);
+    copy_w = MIN(img_w, monitor->width);
+    copy_h = MIN(img_h, monitor->height);
+    stride = (gsize)monitor->width * 4;
 
-    if (img_w > monitor->width || img_h > monitor->height) return FALSE;
+    pixels = malloc(stride * monitor->height);
+    if (!pixels) return FALSE;
 
-    amount_x = (monitor->width + (glong)img_w - 1) / (glong)img_w;
-    amount_y = (monitor->height + (glong)img_h - 1) / (glong)img_h;
-
-    output_width = (gulong)amount_x * img_w;
-    output_height = (gulong)amount_y * img_h;
+    if (MagickExportImagePixels(wand, 0, 0, copy_w, copy_h, "RGBA", CharPixel,
+                                pixels) == MagickFalse) {
+        free(pixels);
+        return FALSE;
+    }
 
-    color = NewPixelWand();
-    PixelSetColor(color, "none");
+    /* spread the packed tile rows out to the monitor stride, bottom up so
+       no row is overwritten before it has been moved */
+    for (y = copy_h; y-- > 0;) {
+        memmove(pixels + y * stride, pixels + y * copy_w * 4, copy_w * 4);
+        fill_by_doubling(pixels + y * stride, copy_w * 4, stride);
+    }
+    fill_by_doubling(pixels, copy_h * stride, stride * monitor->height);
 
     tiled_wand = NewMagickWand();
-    MagickNewImage(tiled_wand, output_width, output_height, color);
-    for (i = 0; i < amount_x; i++) {
-        for (j = 0; j < amount_y; j++) {
-#ifdef WPC_IMAGEMAGICK_7
-            MagickCompositeImage(tiled_wand, wand, OverCompositeOp, MagickTrue,
-                                 (glong)img_w * i, (glong)img_h * j);
-#else
-            MagickCompositeImage(tiled_wand, wand, OverCompositeOp,
-                                 (glong)img_w * i, (glong)img_h * j);
-#endif
-        }
+    if (MagickConstituteImage(tiled_wand, monitor->width, monitor->height,
+                              "RGBA", CharPixel, pixels) == MagickFalse) {
+        DestroyMagickWand(tiled_wand);
+        free(pixels);
+        return FALSE;
     }
-    MagickCropImage(wand, monitor->width, monitor->height, 0, 0);
-    DestroyPixelWand(color);
+    free(pixels);
+
     wand = NULL;
     DestroyMagickWand(*wand_ptr);
 
     *wand_ptr = tiled_wand;
     return true;
 }
+
+/*
+ * Function: new_wand_from_decoded_image
+ * -------------------------------------
+ * Imports natively decoded pixels into a new wand, for the operations that
+ * still need ImageMagick. Returns NULL if the import fails.
+ */
+extern MagickWand *new_wand_from_decoded_image(const DecodedImage *image) {
+    MagickWand *wand = NewMagickWand();
+
+    /* opaque images stay opaque, so the canvas can still be skipped */
+    if (MagickConstituteImage(wand, image->width, image->height,
+                              image->has_alpha ? "RGBA" : "RGBP", CharPixel,
+                              image->pixels) == MagickFalse) {
+        DestroyMagickWand(wand);
+        return NULL;
+    }
+    return wand;
+}
+
+static guchar color_channel(double value) {
+    return (guchar)(value * 255.0 + 0.5);
+}
+
+/*
+ * Function: parse_fallback_color
+ * ------------------------------
+ * Parses a color name the way transform_wallpaper does, a color
+ * ImageMagick does not understand leaves the pixel wand's default of
+ * opaque black.
+ */
+extern void parse_fallback_color(const gchar *name, guchar *rgba) {
+    PixelWand *color = NewPixelWand();
+    if (name) PixelSetColor(color, name);
+    rgba[0] = color_channel(PixelGetRed(color));
+    rgba[1] = color_channel(PixelGetGreen(color));
+    rgba[2] = color_channel(PixelGetBlue(color));
+    rgba[3] = color_channel(PixelGetAlpha(color));
+    DestroyPixelWand(color);
+}
+
+/* composites src over dst, like OverCompositeOp */
+static void blend_row(guchar *dst, const guchar *src, gulong width) {
+    guint alpha, c;
+    gulong x;
+
+    for (x = 0; x < width; x++) {
+        alpha = src[3];
+        for (c = 0; c < 3; c++) {
+            dst[c] = (guchar)((src[c] * alpha + dst[c] * (255 - alpha) + 127) /
+                              255);
+        }
+        dst[3] = (guchar)(alpha + (dst[3] * (255 - alpha) + 127) / 255);
+        src += 4;
+        dst += 4;
+    }
+}
+
+/* composites a row over color in place */
+static void flatten_row(guchar *row, const guchar *color, gulong width) {
+    guint alpha, c;
+    gulong x;
+
+    for (x = 0; x < width; x++) {
+        alpha = row[3];
+        for (c = 0; c < 3; c++) {
+            row[c] = (guchar)((row[c] * alpha + color[c] * (255 - alpha) +
+                               127) /
+                              255);
+        }
+        row[3] = (guchar)(alpha + (color[3] * (255 - alpha) + 127) / 255);
+        row += 4;
+    }
+}
+
+/*
+ * Function: frame_region_fits
+ * ---------------------------
+ * Checks that the scaled image of a rendering region lies within the
+ * monitor.
+ */
+extern gboolean frame_region_fits(const RenderingRegion *rr,
+                                  const Monitor *monitor) {
+    return rr->monitor_x >= 0 && rr->monitor_y >= 0 &&
+           (gulong)rr->monitor_x + rr->width <= monitor->width &&
+           (gulong)rr->monitor_y + rr->height <= monitor->height;
+}
+
+/*
+ * Function: transform_wallpaper_pixels
+ * ------------------------------------
+ * Does what scale_wallpaper does on natively decoded pixels, without
+ * copying them into ImageMagick. The visible window of the image is
+ * resampled in place, straight into dst, and transparent pixels are
+ * flattened onto the fallback color. Only the part of the monitor the image
+ * covers is rendered, the margins are left to the caller.
+ *
+ * Parameters:
+ *   - rr: The rendering region of the image on the monitor, see
+ * create_rendering_region_for_size.
+ *   - bg_fallback_rgba: The fallback color, see parse_fallback_color.
+ *   - dst: Room for rr->width x rr->height RGBA pixels.
+ *
+ * Returns:
+ *   FALSE if the pixels could not be resampled.
+ */
+extern gboolean transform_wallpaper_pixels(const DecodedImage *image,
+                                           const RenderingRegion *rr,
+                                           const guchar *bg_fallback_rgba,
+                                           Quality quality, guchar *dst) {
+    const guchar *window;
+    gsize src_stride;
+    gulong y;
+
+    src_stride = (gsize)image->width * 4;
+    window =
+        image->pixels + (gsize)rr->src_y * src_stride + (gsize)rr->src_x * 4;
+
+    if (!resample_rgba(window, src_stride, (guint)rr->src_width,
+                       (guint)rr->src_height, dst, (guint)rr->width,
+                       (guint)rr->height, native_filter(quality))) {
+        return FALSE;
+    }
+    if (!image->has_alpha) return TRUE;
+
+    for (y = 0; y < rr->height; y++) {
+        flatten_row(dst + y * rr->width * 4, bg_fallback_rgba, rr->width);
+    }
+    return TRUE;
+}
+
+typedef struct {
+    const guchar *next;
+    gsize stride;
+} WindowRows;
+
+static const guchar *next_decoded_row(gpointer data) {
+    WindowRows *window = data;
+    const guchar *row = window->next;
+    window->next += window->stride;
+    return row;
+}
+
+/*
+ * Function: transform_wallpaper_bands
+ * -----------------------------------
+ * Renders the same pixels as transform_wallpaper_pixels, but hands them
+ * to band at most band_rows rows at a time, so only one band of RGBA is
+ * in memory instead of the whole frame.
+ *
+ * Returns:
+ *   FALSE if the pixels could not be resampled.
+ */
+extern gboolean transform_wallpaper_bands(const DecodedImage *image,
+                                          const RenderingRegion *rr,
+                                          const guchar *bg_fallback_rgba,
+                                          Quality quality, guint band_rows,
+                                          WallpaperBandFunc band,
+                                          gpointer data) {
+    WindowRows window;
+    ResampleStream *stream;
+    guchar *rgba;
+    guint y, rows, i;
+    gboolean transformed;
+
+    window.stride = (gsize)image->width * 4;
+    window.next = image->pixels + (gsize)rr->src_y * window.stride +
+                  (gsize)rr->src_x * 4;
+    stream = resample_stream_new((guint)rr->src_width, (guint)rr->src_height,
+                                 (guint)rr->width, (guint)rr->height,
+                                 native_filter(quality), band_rows,
+                                 next_decoded_row, &window);
+    rgba = malloc(rr->width * band_rows * 4);
+    transformed = stream && rgba;
+
+    for (y = 0; transformed && y < rr->height; y += rows) {
+        rows = MIN(band_rows, (guint)rr->height - y);
+        transformed = resample_stream_read(stream, rgba, rows);
+        if (!transformed) break;
+        for (i = 0; image->has_alpha && i < rows; i++) {
+            flatten_row(rgba + i * rr->width * 4, bg_fallback_rgba,
+                        rr->width);
+        }
+        band(rgba, y, rows, data);
+    }
+
+    resample_stream_free(stream);
+    free(rgba);
+    return transformed;
+}
+
+/*
+ * Renders a wallpaper from a streaming decoder a stripe of monitor rows at
+ * a time, see new_wallpaper_stripes.
+ */
+struct WallpaperStripes {
+    ImageReader *reader;
+    RenderingRegion rr;
+    guint monitor_width, monitor_height;
+    guint max_rows;
+    gboolean blend;
+    guchar color[4];
+    guchar *row;
+    guchar *scaled;
+    ResampleStream *stream;
+    guint next_row;
+};
+
+/* feeds the visible window of the image to the resampler, one row at a
+   time */
+static const guchar *next_window_row(gpointer data) {
+    WallpaperStripes *stripes = data;
+
+    while (stripes->reader->rows_read < (guint)stripes->rr.src_y) {
+        if (!read_image_rows(stripes->reader, stripes->row, 1)) return NULL;
+    }
+    if (!read_image_rows(stripes->reader, stripes->row, 1)) return NULL;
+    return stripes->row + (gsize)stripes->rr.src_x * 4;
+}
+
+/*
+ * Function: new_wallpaper_stripes
+ * -------------------------------
+ * Sets up rendering the image behind reader onto monitor in stripes of at
+ * most max_rows rows, the same frame transform_wallpaper renders at once.
+ * Only one decoded row, the resampler's window and max_rows
+ * scaled rows are in memory at any time.
+ *
+ * Returns:
+ *   NULL if the image does not fit the monitor or the buffers could not
+ *   be allocated. The reader stays owned by the caller.
+ */
+extern WallpaperStripes *new_wallpaper_stripes(ImageReader *reader,
+                                               Monitor *monitor,
+                                               BgMode bg_mode,
+                                               const gchar *bg_fallback_color,
+                                               Quality quality,
+                                               guint max_rows) {
+    WallpaperStripes *stripes;
+    RenderingRegion rr;
+
+    rr = create_rendering_region_for_size(reader->width, reader->height,
+                                          monitor, bg_mode);
+    if (!frame_region_fits(&rr, monitor)) return NULL;
+
+    stripes = g_new0(WallpaperStripes, 1);
+    stripes->reader = reader;
+    stripes->rr = rr;
+    stripes->monitor_width = monitor->width;
+    stripes->monitor_height = monitor->height;
+    stripes->max_rows = max_rows;
+    stripes->blend = rr.width != monitor->width ||
+                     rr.height != monitor->height || reader->has_alpha;
+    stripes->row = malloc((gsize)reader->width * 4);
+    stripes->stream = resample_stream_new(
+        (guint)rr.src_width, (guint)rr.src_height, (guint)rr.width,
+        (guint)rr.height, native_filter(quality), max_rows, next_window_row,
+        stripes);
+    if (stripes->blend) {
+        parse_fallback_color(bg_fallback_color, stripes->color);
+        stripes->scaled = malloc(rr.width * max_rows * 4);
+    }
+    if (!stripes->row || !stripes->stream ||
+        (stripes->blend && !stripes->scaled)) {
+        free_wallpaper_stripes(stripes);
+        return NULL;
+    }
+    return stripes;
+}
+
+/*
+ * Function: read_wallpaper_stripe
+ * -------------------------------
+ * Renders the next rows monitor rows into dst, monitor->width RGBA pixels
+ * per row.
+ *
+ * Returns:
+ *   FALSE if the image could not be decoded or resampled.
+ */
+extern gboolean read_wallpaper_stripe(WallpaperStripes *stripes, guchar *dst,
+                                      guint rows) {
+    RenderingRegion *rr = &stripes->rr;
+    gsize dst_stride = (gsize)stripes->monitor_width * 4;
+    guint first, last, y;
+
+    if (rows > stripes->monitor_height - stripes->next_row) return FALSE;
+
+    if (!stripes->blend) {
+        stripes->next_row += rows;
+        return resample_stream_read(stripes->stream, dst, rows);
+    }
+
+    memcpy(dst, stripes->color, sizeof(stripes->color));
+    fill_by_doubling(dst, sizeof(stripes->color), dst_stride * rows);
+
+    /* the monitor rows of this stripe the image covers */
+    first = MAX(stripes->next_row, (guint)rr->monitor_y);
+    last = MIN(stripes->next_row + rows,
+               (guint)((gulong)rr->monitor_y + rr->height));
+    if (first < last) {
+        if (!resample_stream_read(stripes->stream, stripes->scaled,
+                                  last - first)) {
+            return FALSE;
+        }
+        for (y = first; y < last; y++) {
+            blend_row(dst + (y - stripes->next_row) * dst_stride +
+                          (gsize)rr->monitor_x * 4,
+                      stripes->scaled + (gsize)(y - first) * rr->width * 4,
+                      rr->width);
+        }
+    }
+    stripes->next_row += rows;
+    return TRUE;
+}
+
+/*
+ * Function: wallpaper_stripes_size
+ * --------------------------------
+ * Returns how many bytes of buffers the stripes hold, not counting the
+ * decoder's own state.
+ */
+extern gsize wallpaper_stripes_size(const WallpaperStripes *stripes) {
+    gsize size = (gsize)stripes->reader->width * 4 +
+                 resample_stream_size(stripes->stream);
+    if (stripes->scaled) {
+        size += (gsize)stripes->rr.width * 4 * stripes->max_rows;
+    }
+    return size;
+}
+
+extern void free_wallpaper_stripes(WallpaperStripes *stripes) {
+    if (!stripes) return;
+    resample_stream_free(stripes->stream);
+    free(stripes->row);
+    free(stripes->scaled);
+    g_free(stripes);
+}
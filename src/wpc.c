@@ -2,6 +2,7 @@
 
 #include <glib.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 
@@ -17,10 +18,15 @@ __attribute__((used)) static void _mark_magick_used(void) {
 
 static int set_backgrounds_and_exit(void) {
     Config *config = load_config();
+    ScanOptions scan_options = {0};
     MonitorArray *monitor_array;
     WallpaperQueue *queue;
     monitor_array = list_monitors(TRUE);
-    queue = new_wallpaper_queue(config->source_directory);
+    scan_options.workers = config->scan_workers;
+    scan_options.recursive = config->recursive_scan;
+    /* the monitors are painted as soon as enough wallpapers are found, the
+       scan finishes in the background to keep the library index current */
+    queue = new_wallpaper_queue(config->source_directory, &scan_options);
     set_wallpapers(config, queue, monitor_array);
     free_wallpaper_queue(queue);
     free_config(config);
@@ -28,6 +34,67 @@ static int set_backgrounds_and_exit(void) {
     return 0;
 }
 
+static Monitor *find_monitor(MonitorArray *monitor_array,
+                             const char *monitor_name) {
+    Monitor *monitors = (Monitor *)monitor_array->data;
+    gushort i;
+    for (i = 0; i < monitor_array->amount_used; i++) {
+        if (g_strcmp0(monitors[i].name, monitor_name) == 0) {
+            return &monitors[i];
+        }
+    }
+    return NULL;
+}
+
+static int set_monitor_background(Options *options) {
+    Config *config;
+    ConfigMonitor *config_monitor;
+    MonitorArray *monitor_array;
+    Monitor *monitor;
+    gchar *image_path;
+    int status = 0;
+
+    if (!g_file_test(options->image_path, G_FILE_TEST_IS_REGULAR)) {
+        fprintf(stderr, "%s is not a file\n", options->image_path);
+        return 1;
+    }
+
+    config = load_config();
+    if (!config) return 1;
+    monitor_array = list_monitors(TRUE);
+    monitor = find_monitor(monitor_array, options->monitor_name);
+    if (!monitor) {
+        fprintf(stderr, "monitor %s not found\n", options->monitor_name);
+        status = 1;
+        goto cleanup;
+    }
+
+    image_path = g_canonicalize_filename(options->image_path, NULL);
+    config_monitor = get_config_monitor(config, monitor->name);
+    if (config_monitor) {
+        free(config_monitor->image_path);
+        config_monitor->image_path = image_path;
+        if (options->bg_mode != BG_MODE_NOT_SET) {
+            config_monitor->bg_mode = options->bg_mode;
+        }
+    } else {
+        init_config_monitor(config, monitor->name, image_path,
+                            options->bg_mode != BG_MODE_NOT_SET
+                                ? options->bg_mode
+                                : BG_MODE_FILL);
+        config->number_of_monitors++;
+        g_free(image_path);
+    }
+
+    dump_config(config);
+    set_wallpaper_for_monitor(config, monitor_array, monitor);
+
+cleanup:
+    free_config(config);
+    free_monitors(monitor_array);
+    return status;
+}
+
 volatile static bool terminate = FALSE;
 
 static void handle_termination(int signal) {
@@ -38,6 +105,7 @@ static void handle_termination(int signal) {
 static int fork_and_exit(void) {
     pid_t pid = fork();
     Config *config;
+    ScanOptions scan_options = {0};
     MonitorArray *monitor_array;
     WallpaperQueue *queue;
     if (pid == 0) {
@@ -48,7 +116,10 @@ static int fork_and_exit(void) {
         init_x11();
         monitor_array = list_monitors(TRUE);
         MagickWandGenesis();
-        queue = new_wallpaper_queue(config->source_directory);
+        scan_options.workers = config->scan_workers;
+        scan_options.recursive = config->recursive_scan;
+        /* the first wallpapers are set while the rest are still found */
+        queue = new_wallpaper_queue(config->source_directory, &scan_options);
         while (!terminate) {
             set_wallpapers(config, queue, monitor_array);
             sleep(350);
@@ -79,6 +150,9 @@ extern int main(int argc, char **argv) {
     case DAEMON_SET_BACKGROUNDS:
         status = fork_and_exit();
         break;
+    case SET_MONITOR_BACKGROUND:
+        status = set_monitor_background(options);
+        break;
     default:
         status = initialize_application(argc, argv);
         break;
@@ -0,0 +1,216 @@
+// Copyright 2025 webdevred
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xrender.h>
+#include <glib.h>
+#include <stdlib.h>
+
+#include "wpc/rendering_region.h"
+#include "wpc/xrender.h"
+
+static Display *xrender_checked_display = NULL;
+static gboolean xrender_usable = FALSE;
+
+/*
+ * Function: xrender_available
+ * ---------------------------
+ * Checks whether the server can scale wallpapers itself, which needs the
+ * RENDER extension, a picture format for the root visual and one for 32
+ * bit ARGB sources.
+ */
+extern gboolean xrender_available(Display *display, Visual *visual) {
+    int event_base, error_base;
+
+    if (display != xrender_checked_display) {
+        xrender_checked_display = display;
+        xrender_usable =
+            XRenderQueryExtension(display, &event_base, &error_base) &&
+            XRenderFindVisualFormat(display, visual) != NULL &&
+            XRenderFindStandardFormat(display, PictStandardARGB32) != NULL;
+        g_info("XRender scaling %s", xrender_usable ? "available"
+                                                     : "not available");
+    }
+    return xrender_usable;
+}
+
+/*
+ * Function: premultiply_rgba
+ * --------------------------
+ * Converts 8 bit RGBA pixels into the premultiplied ARGB32 layout RENDER
+ * expects, one little endian 32 bit word per pixel. src and dst may be the
+ * same buffer.
+ */
+extern void premultiply_rgba(const guchar *src, guint width, guint height,
+                             guchar *dst) {
+    gsize i, count = (gsize)width * height;
+    guint red, green, blue, alpha;
+
+    for (i = 0; i < count; i++) {
+        red = src[0];
+        green = src[1];
+        blue = src[2];
+        alpha = src[3];
+        dst[0] = (guchar)((blue * alpha + 127) / 255);
+        dst[1] = (guchar)((green * alpha + 127) / 255);
+        dst[2] = (guchar)((red * alpha + 127) / 255);
+        dst[3] = (guchar)alpha;
+        src += 4;
+        dst += 4;
+    }
+}
+
+/*
+ * Function: upload_server_image
+ * -----------------------------
+ * Uploads premultiplied ARGB32 pixels, see premultiply_rgba, into a 32 bit
+ * pixmap and wraps it in a picture that every monitor showing the image
+ * can be composited from.
+ *
+ * Returns:
+ *   The image, or NULL if it is larger than SERVER_IMAGE_MAX_SIZE on a side
+ *   or the server failed to allocate or fill the pixmap.
+ */
+extern ServerImage *upload_server_image(Display *display, Drawable root,
+                                        Visual *visual, guchar *pixels,
+                                        guint width, guint height,
+                                        gboolean has_alpha) {
+    ServerImage *image;
+    XImage *ximage;
+    GC gc;
+
+    if (width > SERVER_IMAGE_MAX_SIZE || height > SERVER_IMAGE_MAX_SIZE) {
+        return NULL;
+    }
+    ximage = XCreateImage(display, visual, 32, ZPixmap, 0, (char *)pixels,
+                          width, height, 32, 0);
+    if (!ximage) return NULL;
+    /* Xlib swaps the words if the server is big endian */
+    ximage->byte_order = LSBFirst;
+
+    image = g_new0(ServerImage, 1);
+    image->width = width;
+    image->height = height;
+    image->has_alpha = has_alpha;
+
+    /* a pixmap this large may well exceed what the server can allocate */
+    trap_x_errors(display);
+    image->pixmap = XCreatePixmap(display, root, width, height, 32);
+    gc = XCreateGC(display, image->pixmap, 0, NULL);
+    XPutImage(display, image->pixmap, gc, ximage, 0, 0, 0, 0, width, height);
+    XFreeGC(display, gc);
+    image->picture = XRenderCreatePicture(
+        display, image->pixmap,
+        XRenderFindStandardFormat(display, PictStandardARGB32), 0, NULL);
+    ximage->data = NULL;
+    XDestroyImage(ximage);
+    if (untrap_x_errors(display)) {
+        /* whatever was not created must not be fatal to free either */
+        trap_x_errors(display);
+        destroy_server_image(display, image);
+        untrap_x_errors(display);
+        return NULL;
+    }
+    return image;
+}
+
+static const char *server_filter(Quality quality) {
+    switch (quality) {
+    case QUALITY_FAST:
+        return FilterFast;
+    case QUALITY_BALANCED:
+        return FilterGood;
+    default:
+        return FilterBest;
+    }
+}
+
+static XRenderColor render_color(const guchar *rgba) {
+    XRenderColor color;
+    /* 8 to 16 bits, premultiplied */
+    color.red = (gushort)(rgba[0] * rgba[3] * 257 / 255);
+    color.green = (gushort)(rgba[1] * rgba[3] * 257 / 255);
+    color.blue = (gushort)(rgba[2] * rgba[3] * 257 / 255);
+    color.alpha = (gushort)(rgba[3] * 257);
+    return color;
+}
+
+/*
+ * Function: paint_server_image
+ * ----------------------------
+ * Lets the server scale the image onto the monitor's area of drawable,
+ * with the same rendering region the client side scalers use. The source
+ * transform maps the center of every destination pixel into the visible
+ * window of the image, edges are padded so they do not fade to black.
+ * Tiles are repeated by the server at their own size.
+ *
+ * Notes:
+ *   Only requests are queued, the scaling happens when the server gets to
+ *   them.
+ */
+extern void paint_server_image(Display *display, ServerImage *image,
+                               Drawable drawable, Visual *visual,
+                               Monitor *monitor, BgMode bg_mode,
+                               const guchar *bg_fallback_rgba,
+                               Quality quality) {
+    XRenderPictureAttributes attributes;
+    XTransform transform = {{{XDoubleToFixed(1.0), 0, 0},
+                             {0, XDoubleToFixed(1.0), 0},
+                             {0, 0, XDoubleToFixed(1.0)}}};
+    XRenderColor fill;
+    RenderingRegion rr;
+    Picture dst;
+    gboolean covers;
+
+    dst = XRenderCreatePicture(display, drawable,
+                               XRenderFindVisualFormat(display, visual), 0,
+                               NULL);
+
+    if (bg_mode == BG_MODE_TILE) {
+        attributes.repeat = RepeatNormal;
+        XRenderChangePicture(display, image->picture, CPRepeat, &attributes);
+        XRenderSetPictureTransform(display, image->picture, &transform);
+        XRenderSetPictureFilter(display, image->picture, FilterNearest, NULL,
+                                0);
+        XRenderComposite(display, PictOpSrc, image->picture, None, dst, 0, 0,
+                         0, 0, monitor->left_x, monitor->top_y,
+                         monitor->width, monitor->height);
+        XRenderFreePicture(display, dst);
+        return;
+    }
+
+    rr = create_rendering_region_for_size(image->width, image->height,
+                                          monitor, bg_mode);
+    covers = rr.width == monitor->width && rr.height == monitor->height &&
+             !image->has_alpha;
+    if (!covers) {
+        fill = render_color(bg_fallback_rgba);
+        XRenderFillRectangle(display, PictOpSrc, dst, &fill, monitor->left_x,
+                             monitor->top_y, monitor->width, monitor->height);
+    }
+
+    transform.matrix[0][0] =
+        XDoubleToFixed((double)rr.src_width / (double)rr.width);
+    transform.matrix[0][2] = XDoubleToFixed((double)rr.src_x);
+    transform.matrix[1][1] =
+        XDoubleToFixed((double)rr.src_height / (double)rr.height);
+    transform.matrix[1][2] = XDoubleToFixed((double)rr.src_y);
+    attributes.repeat = RepeatPad;
+    XRenderChangePicture(display, image->picture, CPRepeat, &attributes);
+    XRenderSetPictureTransform(display, image->picture, &transform);
+    XRenderSetPictureFilter(display, image->picture, server_filter(quality),
+                            NULL, 0);
+    XRenderComposite(display, covers ? PictOpSrc : PictOpOver, image->picture,
+                     None, dst, 0, 0, 0, 0,
+                     monitor->left_x + (gint)rr.monitor_x,
+                     monitor->top_y + (gint)rr.monitor_y, (guint)rr.width,
+                     (guint)rr.height);
+    XRenderFreePicture(display, dst);
+}
+
+extern void destroy_server_image(Display *display, ServerImage *image) {
+    if (!image) return;
+    XRenderFreePicture(display, image->picture);
+    XFreePixmap(display, image->pixmap);
+    g_free(image);
+}
@@ -0,0 +1,354 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wpc/resample.h"
+#include "wpc/wpc_imagemagick.h"
+__attribute__((used)) static void _mark_magick_used(void) {
+    _wpc_magick_include_marker();
+}
+
+#ifdef WPC_IMAGEMAGICK_7
+typedef FilterType MagickFilter;
+#else
+typedef FilterTypes MagickFilter;
+#endif
+
+/*
+ * Checks that the built-in resampler stays equivalent to MagickResizeImage
+ * with the filter each quality replaces, that every instruction set gives
+ * the same bytes, and that plan_resample takes the exact shortcuts only
+ * where they are exact.
+ *
+ * resample_rgba filters the rows first and rounds and clips to 8 bits
+ * before it filters the columns. The reference does the same, it resizes
+ * one axis at a time with ImageMagick and exports 8 bits in between, so
+ * ringing at hard edges is clipped the same way whatever quantum depth or
+ * HDRI ImageMagick was built with. What is left is fixed point: weights
+ * rounded to 14 bits and a rounded sum per pass, and the error of the
+ * first pass carried through the weights of the second. That is a few
+ * levels at most, so every case allows 4 in a single channel and a small
+ * fraction of a level on average.
+ */
+
+#define MAX_MEAN_ERROR 0.25
+#define MAX_ERROR 4
+
+typedef enum { PATTERN_GRADIENT, PATTERN_CHECKERBOARD, PATTERN_NOISE } Pattern;
+
+typedef struct {
+    const gchar *name;
+    Pattern pattern;
+    ResampleFilter filter;
+    guint src_width, src_height;
+    guint dst_width, dst_height;
+} ResampleCase;
+
+#define DOWN 1000, 700, 313, 219
+#define UP 200, 150, 517, 389
+
+static const ResampleCase cases[] = {
+    {"lanczos gradient down", PATTERN_GRADIENT, RESAMPLE_FILTER_LANCZOS, DOWN},
+    {"lanczos gradient up", PATTERN_GRADIENT, RESAMPLE_FILTER_LANCZOS, UP},
+    {"lanczos gradient 4k to 1080p", PATTERN_GRADIENT,
+     RESAMPLE_FILTER_LANCZOS, 3840, 2160, 1920, 1080},
+    {"lanczos checkerboard down", PATTERN_CHECKERBOARD,
+     RESAMPLE_FILTER_LANCZOS, DOWN},
+    {"lanczos checkerboard up", PATTERN_CHECKERBOARD, RESAMPLE_FILTER_LANCZOS,
+     UP},
+    {"lanczos noise down", PATTERN_NOISE, RESAMPLE_FILTER_LANCZOS, DOWN},
+    {"lanczos noise up", PATTERN_NOISE, RESAMPLE_FILTER_LANCZOS, UP},
+    {"triangle gradient down", PATTERN_GRADIENT, RESAMPLE_FILTER_TRIANGLE,
+     DOWN},
+    {"triangle checkerboard down", PATTERN_CHECKERBOARD,
+     RESAMPLE_FILTER_TRIANGLE, DOWN},
+    {"triangle checkerboard up", PATTERN_CHECKERBOARD,
+     RESAMPLE_FILTER_TRIANGLE, UP},
+    {"triangle noise down", PATTERN_NOISE, RESAMPLE_FILTER_TRIANGLE, DOWN},
+    {"box gradient down", PATTERN_GRADIENT, RESAMPLE_FILTER_BOX, DOWN},
+    {"box checkerboard down", PATTERN_CHECKERBOARD, RESAMPLE_FILTER_BOX,
+     DOWN},
+    {"box noise down", PATTERN_NOISE, RESAMPLE_FILTER_BOX, DOWN},
+};
+
+static const MagickFilter magick_filters[] = {BoxFilter, TriangleFilter,
+                                              LanczosFilter};
+
+static const gchar *isas[] = {"scalar", "sse4.1", "avx2"};
+
+typedef struct {
+    guint src_width, src_height;
+    guint dst_width, dst_height;
+    ResamplePlan plan;
+} PlanCase;
+
+/* box sums are 16 bits, so a block may hold at most 257 pixels */
+static const PlanCase plan_cases[] = {
+    {1920, 1080, 1920, 1080, RESAMPLE_PLAN_COPY},
+    {3840, 2160, 1920, 1080, RESAMPLE_PLAN_INTEGER_BOX},
+    {5760, 3240, 1920, 1080, RESAMPLE_PLAN_INTEGER_BOX},
+    {1920, 1080, 1920, 540, RESAMPLE_PLAN_INTEGER_BOX},
+    {1600, 800, 100, 50, RESAMPLE_PLAN_INTEGER_BOX},
+    {1028, 8, 4, 8, RESAMPLE_PLAN_INTEGER_BOX},
+    {1032, 8, 4, 8, RESAMPLE_PLAN_GENERAL},
+    {1700, 800, 100, 50, RESAMPLE_PLAN_GENERAL},
+    {3840, 2160, 1919, 1080, RESAMPLE_PLAN_GENERAL},
+    {1920, 1080, 3840, 2160, RESAMPLE_PLAN_GENERAL},
+};
+
+/* exact reductions, checked against the block averages */
+static const PlanCase box_cases[] = {
+    {600, 400, 300, 200, RESAMPLE_PLAN_INTEGER_BOX},
+    {600, 402, 200, 134, RESAMPLE_PLAN_INTEGER_BOX},
+    {97, 61, 97, 61, RESAMPLE_PLAN_COPY},
+};
+
+/* opaque test images, the noise is the same on every run */
+static void fill_pattern(guchar *rgba, guint width, guint height,
+                         Pattern pattern) {
+    guint32 state = 2463534242u;
+    guint x, y, c;
+    guchar *pixel = rgba;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            for (c = 0; c < 3; c++) {
+                switch (pattern) {
+                case PATTERN_GRADIENT:
+                    pixel[c] = (guchar)(c == 0   ? x * 255 / width
+                                        : c == 1 ? y * 255 / height
+                                                 : (x * 255 / width +
+                                                    y * 255 / height) /
+                                                       2);
+                    break;
+                case PATTERN_CHECKERBOARD:
+                    pixel[c] = ((x / 8 + y / 8) % 2) ? 255 : 0;
+                    break;
+                default:
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    pixel[c] = (guchar)state;
+                }
+            }
+            pixel[3] = 255;
+            pixel += 4;
+        }
+    }
+}
+
+/* resizes one axis with ImageMagick and exports the result as 8 bits */
+static gboolean resize_pass(const guchar *src, guint src_width,
+                            guint src_height, guchar *dst, guint dst_width,
+                            guint dst_height, MagickFilter filter) {
+    MagickWand *wand = NewMagickWand();
+    gboolean resized;
+
+    /* no alpha channel, so ImageMagick does not weigh colors by it */
+    resized = MagickConstituteImage(wand, src_width, src_height, "RGBP",
+                                    CharPixel, src) == MagickTrue;
+#ifdef WPC_IMAGEMAGICK_7
+    resized = resized && MagickResizeImage(wand, dst_width, dst_height,
+                                           filter) == MagickTrue;
+#else
+    resized = resized && MagickResizeImage(wand, dst_width, dst_height,
+                                           filter, 1.0) == MagickTrue;
+#endif
+    resized = resized &&
+              MagickExportImagePixels(wand, 0, 0, dst_width, dst_height,
+                                      "RGBA", CharPixel, dst) == MagickTrue;
+    DestroyMagickWand(wand);
+    return resized;
+}
+
+static gboolean resize_with_magick(const guchar *src, const ResampleCase *rc,
+                                   guchar *dst) {
+    guchar *rows = malloc((gsize)rc->dst_width * rc->src_height * 4);
+    gboolean resized;
+
+    resized = rows &&
+              resize_pass(src, rc->src_width, rc->src_height, rows,
+                          rc->dst_width, rc->src_height,
+                          magick_filters[rc->filter]) &&
+              resize_pass(rows, rc->dst_width, rc->src_height, dst,
+                          rc->dst_width, rc->dst_height,
+                          magick_filters[rc->filter]);
+    free(rows);
+    return resized;
+}
+
+/*
+ * Function: resample_on_every_isa
+ * -------------------------------
+ * Resamples src on every instruction set the CPU runs into dst, and checks
+ * that all of them give the bytes the scalar code gives.
+ */
+static gboolean resample_on_every_isa(const guchar *src, guint src_width,
+                                      guint src_height, guchar *dst,
+                                      guint dst_width, guint dst_height,
+                                      ResampleFilter filter,
+                                      const gchar *name) {
+    gsize size = (gsize)dst_width * dst_height * 4;
+    guchar *other = malloc(size);
+    gboolean same = other != NULL;
+    guint i;
+
+    for (i = 0; same && i < G_N_ELEMENTS(isas); i++) {
+        if (!resample_set_isa(isas[i])) break;
+        same = resample_rgba(src, (gsize)src_width * 4, src_width,
+                             src_height, i ? other : dst, dst_width,
+                             dst_height, filter) &&
+               (i == 0 || memcmp(dst, other, size) == 0);
+        if (!same) {
+            printf("FAIL %s: %s does not give the bytes scalar gives\n", name,
+                   isas[i]);
+        }
+    }
+    resample_set_isa(NULL);
+    free(other);
+    return same;
+}
+
+static gboolean run_case(const ResampleCase *rc) {
+    guchar *src, *native, *magick;
+    gsize i, count;
+    guint error, max_error = 0;
+    guint64 error_sum = 0;
+    double mean_error;
+    gboolean passed = FALSE;
+
+    count = (gsize)rc->dst_width * rc->dst_height * 4;
+    src = malloc((gsize)rc->src_width * rc->src_height * 4);
+    native = malloc(count);
+    magick = malloc(count);
+    if (!src || !native || !magick) goto cleanup;
+
+    fill_pattern(src, rc->src_width, rc->src_height, rc->pattern);
+    if (!resample_on_every_isa(src, rc->src_width, rc->src_height, native,
+                               rc->dst_width, rc->dst_height, rc->filter,
+                               rc->name)) {
+        goto cleanup;
+    }
+    if (!resize_with_magick(src, rc, magick)) {
+        printf("FAIL %s: could not resize with ImageMagick\n", rc->name);
+        goto cleanup;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (i % 4 == 3) continue;
+        error = (guint)abs(native[i] - magick[i]);
+        error_sum += error;
+        max_error = MAX(max_error, error);
+    }
+    mean_error = (double)error_sum / (double)(count / 4 * 3);
+
+    passed = mean_error <= MAX_MEAN_ERROR && max_error <= MAX_ERROR;
+    printf("%s %s: %ux%u to %ux%u, mean error %.3f (at most %.2f), max "
+           "error %u (at most %u)\n",
+           passed ? "ok  " : "FAIL", rc->name, rc->src_width, rc->src_height,
+           rc->dst_width, rc->dst_height, mean_error, MAX_MEAN_ERROR,
+           max_error, MAX_ERROR);
+
+cleanup:
+    free(src);
+    free(native);
+    free(magick);
+    return passed;
+}
+
+static gboolean run_plan_case(const PlanCase *pc) {
+    ResamplePlan plan = plan_resample(pc->src_width, pc->src_height,
+                                      pc->dst_width, pc->dst_height);
+    gboolean passed = plan == pc->plan;
+
+    printf("%s plan %ux%u to %ux%u: %s (expected %s)\n",
+           passed ? "ok  " : "FAIL", pc->src_width, pc->src_height,
+           pc->dst_width, pc->dst_height, resample_plan_name(plan),
+           resample_plan_name(pc->plan));
+    return passed;
+}
+
+/* every output pixel must be the rounded average of its block */
+static gboolean run_box_case(const PlanCase *pc, ResampleFilter filter) {
+    guint factor_x = pc->src_width / pc->dst_width;
+    guint factor_y = pc->src_height / pc->dst_height;
+    guint area = factor_x * factor_y;
+    gsize stride = (gsize)pc->src_width * 4;
+    guchar *src = malloc(stride * pc->src_height);
+    guchar *dst = malloc((gsize)pc->dst_width * pc->dst_height * 4);
+    guint x, y, c, i, j, sum, mismatches = 0;
+    gboolean passed;
+    gchar *name;
+
+    name = g_strdup_printf("%s %ux%u to %ux%u",
+                           resample_plan_name(pc->plan), pc->src_width,
+                           pc->src_height, pc->dst_width, pc->dst_height);
+    passed = src && dst &&
+             plan_resample(pc->src_width, pc->src_height, pc->dst_width,
+                           pc->dst_height) == pc->plan;
+    if (passed) {
+        fill_pattern(src, pc->src_width, pc->src_height, PATTERN_NOISE);
+        passed = resample_on_every_isa(src, pc->src_width, pc->src_height,
+                                       dst, pc->dst_width, pc->dst_height,
+                                       filter, name);
+    }
+
+    for (y = 0; passed && y < pc->dst_height; y++) {
+        for (x = 0; x < pc->dst_width; x++) {
+            for (c = 0; c < 4; c++) {
+                sum = 0;
+                for (j = 0; j < factor_y; j++) {
+                    for (i = 0; i < factor_x; i++) {
+                        sum += src[(y * factor_y + j) * stride +
+                                   (x * factor_x + i) * 4 + c];
+                    }
+                }
+                if (dst[((gsize)y * pc->dst_width + x) * 4 + c] !=
+                    (sum + area / 2) / area) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    passed = passed && mismatches == 0;
+    printf("%s %s with the %s filter: %u channels differ from the block "
+           "averages\n",
+           passed ? "ok  " : "FAIL", name,
+           filter == RESAMPLE_FILTER_BOX        ? "box"
+           : filter == RESAMPLE_FILTER_TRIANGLE ? "triangle"
+                                                : "lanczos",
+           mismatches);
+
+    g_free(name);
+    free(src);
+    free(dst);
+    return passed;
+}
+
+extern int main(void) {
+    guint i, f, checked = 0, failed = 0;
+
+    printf("resampling on %s\n", resample_isa_name());
+    MagickWandGenesis();
+    for (i = 0; i < G_N_ELEMENTS(cases); i++, checked++) {
+        if (!run_case(&cases[i])) failed++;
+    }
+    MagickWandTerminus();
+
+    for (i = 0; i < G_N_ELEMENTS(plan_cases); i++, checked++) {
+        if (!run_plan_case(&plan_cases[i])) failed++;
+    }
+    /* the exact plans ignore the filter that was asked for */
+    for (i = 0; i < G_N_ELEMENTS(box_cases); i++) {
+        for (f = RESAMPLE_FILTER_BOX; f <= RESAMPLE_FILTER_LANCZOS;
+             f++, checked++) {
+            if (!run_box_case(&box_cases[i], (ResampleFilter)f)) failed++;
+        }
+    }
+
+    printf("%u of %u resample cases passed\n", checked - failed, checked);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+// Copyright 2025 webdevred
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wpc/decoder.h"
+#include "wpc/rendering_region.h"
+#include "wpc/resample.h"
+#include "wpc/wallpaper_transformation.h"
+#include "wpc/wpc_imagemagick.h"
+__attribute__((used)) static void _mark_magick_used(void) {
+    _wpc_magick_include_marker();
+}
+
+/*
+ * Checks that streaming renders exactly what rendering at once does. A
+ * ResampleStream read a few rows at a time must produce the bytes
+ * resample_rgba produces, and a wallpaper rendered in stripes from an
+ * ImageReader must produce the frame transform_wallpaper_pixels renders
+ * and the server completes with the fallback color, for every mode that
+ * is striped. The window of source rows a stream keeps is sized for
+ * max_rows, so small and odd stripe heights are the ones that could go
+ * wrong.
+ */
+
+#define FALLBACK_COLOR "#336699"
+
+typedef struct {
+    guint src_width, src_height;
+    guint dst_width, dst_height;
+} StreamSize;
+
+static const StreamSize stream_sizes[] = {
+    {301, 173, 160, 91},  {301, 173, 517, 389}, {173, 301, 301, 173},
+    {300, 200, 150, 100}, {300, 201, 100, 67},  {97, 61, 97, 61},
+};
+
+static const guint stripe_rows[] = {1, 2, 3, 7, 16, 0};
+
+static const gchar *filter_names[] = {"box", "triangle", "lanczos"};
+
+static const BgMode bg_modes[] = {BG_MODE_CENTER, BG_MODE_FILL, BG_MODE_MAX,
+                                  BG_MODE_SCALE};
+
+static const gchar *bg_mode_names[] = {"", "center", "fill", "max", "scale"};
+
+static const guint monitor_sizes[][2] = {{160, 120}, {480, 360}, {333, 199}};
+
+typedef struct {
+    const gchar *name;
+    gboolean has_alpha;
+    gboolean interlaced;
+} TestImage;
+
+/* one streams, the other is decoded whole on the first read */
+static const TestImage test_images[] = {
+    {"opaque.png", FALSE, FALSE},
+    {"interlaced.png", TRUE, TRUE},
+};
+
+#define IMAGE_WIDTH 301
+#define IMAGE_HEIGHT 173
+
+/* edges, gradients and, for the transparent image, varying alpha */
+static void fill_pixels(guchar *rgba, guint width, guint height,
+                        gboolean has_alpha) {
+    guint x, y;
+    guchar *pixel = rgba;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            pixel[0] = (guchar)(x * 255 / width);
+            pixel[1] = ((x / 7 + y / 5) % 2) ? 230 : 20;
+            pixel[2] = (guchar)((x * y) % 251);
+            pixel[3] = has_alpha ? (guchar)((x + y * 3) % 256) : 255;
+            pixel += 4;
+        }
+    }
+}
+
+static gboolean write_png(const gchar *path, const guchar *rgba, guint width,
+                          guint height, const TestImage *ti) {
+    FILE *file = fopen(path, "wb");
+    png_structp png;
+    png_infop info;
+    guchar *row = malloc((gsize)width * 4);
+    guint y, x;
+    int pass, passes;
+
+    if (!file || !row) {
+        if (file) fclose(file);
+        free(row);
+        return FALSE;
+    }
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        free(row);
+        return FALSE;
+    }
+
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 8,
+                 ti->has_alpha ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB,
+                 ti->interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    passes = png_set_interlace_handling(png);
+    for (pass = 0; pass < passes; pass++) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                memcpy(row + x * (ti->has_alpha ? 4 : 3),
+                       rgba + ((gsize)y * width + x) * 4,
+                       ti->has_alpha ? 4 : 3);
+            }
+            png_write_row(png, row);
+        }
+    }
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    free(row);
+    return fclose(file) == 0;
+}
+
+typedef struct {
+    const guchar *pixels;
+    gsize stride;
+} SourceRows;
+
+static const guchar *next_row(gpointer data) {
+    SourceRows *rows = data;
+    const guchar *row = rows->pixels;
+    rows->pixels += rows->stride;
+    return row;
+}
+
+static gboolean check_stream(const guchar *src, const StreamSize *ss,
+                             ResampleFilter filter, guint max_rows) {
+    ResampleStream *stream;
+    SourceRows rows;
+    gsize size = (gsize)ss->dst_width * ss->dst_height * 4;
+    guchar *whole = malloc(size), *streamed = malloc(size);
+    guint y, chunk;
+    gboolean same = FALSE;
+
+    if (!max_rows) max_rows = ss->dst_height;
+    rows.pixels = src;
+    rows.stride = (gsize)ss->src_width * 4;
+    stream = resample_stream_new(ss->src_width, ss->src_height, ss->dst_width,
+                                 ss->dst_height, filter, max_rows, next_row,
+                                 &rows);
+    if (whole && streamed && stream &&
+        resample_rgba(src, (gsize)ss->src_width * 4, ss->src_width,
+                      ss->src_height, whole, ss->dst_width, ss->dst_height,
+                      filter)) {
+        same = TRUE;
+        for (y = 0; same && y < ss->dst_height; y += chunk) {
+            chunk = MIN(max_rows, ss->dst_height - y);
+            same = resample_stream_read(
+                stream, streamed + (gsize)y * ss->dst_width * 4, chunk);
+        }
+        same = same && memcmp(whole, streamed, size) == 0;
+    }
+    if (!same) {
+        printf("FAIL %ux%u to %ux%u (%s) with %s, %u rows at a time\n",
+               ss->src_width, ss->src_height, ss->dst_width, ss->dst_height,
+               resample_plan_name(plan_resample(ss->src_width, ss->src_height,
+                                                ss->dst_width,
+                                                ss->dst_height)),
+               filter_names[filter], max_rows);
+    }
+
+    resample_stream_free(stream);
+    free(whole);
+    free(streamed);
+    return same;
+}
+
+/* the frame the whole path renders, completed with the margins the server
+   fills */
+static gboolean render_whole(const DecodedImage *image, Monitor *monitor,
+                             BgMode bg_mode, Quality quality, guchar *frame) {
+    RenderingRegion rr = create_rendering_region_for_size(
+        image->width, image->height, monitor, bg_mode);
+    gsize stride = (gsize)monitor->width * 4;
+    guchar color[4];
+    guchar *region = malloc(rr.width * rr.height * 4);
+    gsize i;
+    guint y;
+    gboolean rendered;
+
+    parse_fallback_color(FALLBACK_COLOR, color);
+    rendered = region &&
+               transform_wallpaper_pixels(image, &rr, color, quality, region);
+    for (i = 0; rendered && i < stride * monitor->height; i += 4) {
+        memcpy(frame + i, color, 4);
+    }
+    for (y = 0; rendered && y < rr.height; y++) {
+        memcpy(frame + ((gsize)rr.monitor_y + y) * stride +
+                   (gsize)rr.monitor_x * 4,
+               region + (gsize)y * rr.width * 4, rr.width * 4);
+    }
+    free(region);
+    return rendered;
+}
+
+static gboolean render_striped(const gchar *path, Monitor *monitor,
+                               BgMode bg_mode, Quality quality, guint rows,
+                               guchar *frame) {
+    ImageReader *reader = open_image_reader(path, NULL, NULL);
+    WallpaperStripes *stripes = NULL;
+    gsize stride = (gsize)monitor->width * 4;
+    guint y, chunk;
+    gboolean rendered;
+
+    if (reader) {
+        stripes = new_wallpaper_stripes(reader, monitor, bg_mode,
+                                        FALLBACK_COLOR, quality, rows);
+    }
+    rendered = stripes != NULL;
+    for (y = 0; rendered && y < monitor->height; y += chunk) {
+        chunk = MIN(rows, monitor->height - y);
+        rendered = read_wallpaper_stripe(stripes, frame + y * stride, chunk);
+    }
+    free_wallpaper_stripes(stripes);
+    close_image_reader(reader);
+    return rendered;
+}
+
+static gboolean check_stripes(const gchar *path, const TestImage *ti,
+                              const DecodedImage *image, Monitor *monitor,
+                              BgMode bg_mode, Quality quality, guint rows) {
+    gsize size = (gsize)monitor->width * monitor->height * 4;
+    guchar *whole = malloc(size), *striped = malloc(size);
+    gboolean same;
+
+    if (!rows) rows = monitor->height;
+    same = whole && striped &&
+           render_whole(image, monitor, bg_mode, quality, whole) &&
+           render_striped(path, monitor, bg_mode, quality, rows, striped) &&
+           memcmp(whole, striped, size) == 0;
+    if (!same) {
+        printf("FAIL %s on %ux%u, %s, quality %d, stripes of %u rows\n",
+               ti->name, monitor->width, monitor->height,
+               bg_mode_names[bg_mode], quality, rows);
+    }
+    free(whole);
+    free(striped);
+    return same;
+}
+
+static guint run_stream_cases(void) {
+    guchar *src;
+    guint s, f, r, checked = 0, failed = 0;
+    const StreamSize *ss;
+
+    for (s = 0; s < G_N_ELEMENTS(stream_sizes); s++) {
+        ss = &stream_sizes[s];
+        src = malloc((gsize)ss->src_width * ss->src_height * 4);
+        if (!src) return 1;
+        fill_pixels(src, ss->src_width, ss->src_height, TRUE);
+        for (f = 0; f < G_N_ELEMENTS(filter_names); f++) {
+            for (r = 0; r < G_N_ELEMENTS(stripe_rows); r++) {
+                if (!check_stream(src, ss, (ResampleFilter)f,
+                                  stripe_rows[r])) {
+                    failed++;
+                }
+                checked++;
+            }
+        }
+        free(src);
+    }
+    printf("%s %u of %u streamed resizes match resample_rgba\n",
+           failed ? "FAIL" : "ok  ", checked - failed, checked);
+    return failed;
+}
+
+static guint run_image_cases(const gchar *dir, const TestImage *ti,
+                             const guchar *rgba) {
+    gchar *path = g_build_filename(dir, ti->name, NULL);
+    DecodedImage *image = NULL;
+    Monitor monitor = {0};
+    guint m, b, q, r, checked = 0, failed = 0;
+
+    if (write_png(path, rgba, IMAGE_WIDTH, IMAGE_HEIGHT, ti)) {
+        image = decode_image(path, NULL, NULL);
+    }
+    if (!image) {
+        printf("FAIL %s: could not write and decode it\n", ti->name);
+        g_remove(path);
+        g_free(path);
+        return 1;
+    }
+
+    monitor.name = "test";
+    for (m = 0; m < G_N_ELEMENTS(monitor_sizes); m++) {
+        monitor.width = monitor_sizes[m][0];
+        monitor.height = monitor_sizes[m][1];
+        for (b = 0; b < G_N_ELEMENTS(bg_modes); b++) {
+            for (q = QUALITY_BEST; q <= QUALITY_FAST; q++) {
+                for (r = 0; r < G_N_ELEMENTS(stripe_rows); r++) {
+                    if (!check_stripes(path, ti, image, &monitor,
+                                       bg_modes[b], (Quality)q,
+                                       stripe_rows[r])) {
+                        failed++;
+                    }
+                    checked++;
+                }
+            }
+        }
+    }
+    printf("%s %u of %u striped frames of %s match the whole frame\n",
+           failed ? "FAIL" : "ok  ", checked - failed, checked, ti->name);
+
+    decoded_image_unref(image);
+    g_remove(path);
+    g_free(path);
+    return failed;
+}
+
+extern int main(void) {
+    GError *error = NULL;
+    gchar *dir;
+    guchar *rgba;
+    guint i, failed;
+
+    dir = g_dir_make_tmp("wpc-stream-test-XXXXXX", &error);
+    if (!dir) {
+        fprintf(stderr, "Failed to create a directory: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    MagickWandGenesis();
+    failed = run_stream_cases();
+    for (i = 0; i < G_N_ELEMENTS(test_images); i++) {
+        rgba = malloc((gsize)IMAGE_WIDTH * IMAGE_HEIGHT * 4);
+        if (!rgba) {
+            failed++;
+            break;
+        }
+        fill_pixels(rgba, IMAGE_WIDTH, IMAGE_HEIGHT,
+                    test_images[i].has_alpha);
+        failed += run_image_cases(dir, &test_images[i], rgba);
+        free(rgba);
+    }
+    MagickWandTerminus();
+
+    g_rmdir(dir);
+    g_free(dir);
+    return failed ? 1 : 0;
+}